@@ -0,0 +1,141 @@
+/*
+ * HashMap.h
+ *
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ * 	HashMap es una libreria que permite indexar valores mediante claves de texto, en una tabla hash de
+ *	direccionamiento abierto (sondeo lineal) que crece automaticamente al superar el 75% de ocupacion.
+ *	Las claves no se copian: deben permanecer validas mientras esten registradas en la tabla. Las busquedas
+ *	pueden realizarse con claves no finalizadas en '\0' (ej. un tramo de un topic), indicando su longitud.
+ *	Los valores pueden ser de cualquier tipo copiable, ya que la tabla se define como un template.
+ */
+
+#ifndef __HASHMAP_H
+#define __HASHMAP_H
+
+#include <stdint.h>
+
+
+
+template<typename V>
+class HashMap {
+public:
+
+	/** Errores generados por la libreria */
+    enum Exception {
+		SUCCESS = 0,          	///< No exceptions raised
+		NULL_POINTER,         	///< Null pointer in operation
+		OUT_OF_MEMORY,          ///< No more dynamic memory
+		ITEM_NOT_FOUND,			///< Item not found in table
+		ITEM_EXISTS,			///< Key already registered
+	};
+
+
+    /** @fn HashMap
+     *  @brief Constructor que crea una tabla vacia
+     *  @param size Numero inicial de entradas (se redondea a potencia de 2)
+     */
+    HashMap(uint32_t size = 16);
+
+
+    /** @fn ~HashMap
+     *  @brief Destructor por defecto
+     */
+    ~HashMap();
+
+
+    /** @fn addItem
+     *  @brief Registra un valor asociado a una clave
+     *  @param key Clave (finalizada en '\0'), debe permanecer valida mientras este registrada
+     *  @param value Valor a registrar
+     *  @return Resultado
+     */
+    int32_t addItem(const char* key, V value);
+
+
+    /** @fn removeItem
+     *  @brief Elimina la entrada asociada a una clave
+     *  @param key Clave
+     *  @param len Longitud de la clave
+     *  @return Resultado
+     */
+    int32_t removeItem(const char* key, uint16_t len);
+    int32_t removeItem(const char* key);
+
+
+    /** @fn getItem
+     *  @brief Busca el valor asociado a una clave
+     *  @param key Clave
+     *  @param len Longitud de la clave
+     *  @param value Recibe el valor encontrado
+     *  @return True si existe, False si no existe
+     */
+    bool getItem(const char* key, uint16_t len, V* value);
+    bool getItem(const char* key, V* value);
+
+
+    /** @fn setItem
+     *  @brief Actualiza el valor asociado a una clave registrada, sin reservar memoria
+     *  @param key Clave
+     *  @param value Nuevo valor
+     *  @return Resultado
+     */
+    int32_t setItem(const char* key, V value);
+
+
+    /** @fn removeAll
+     *  @brief Borra todas las entradas de la tabla
+     */
+    void removeAll();
+
+
+    /** @fn getItemCount
+     *  @brief Obtiene el numero de entradas registradas
+     *  @return Numero de entradas
+     */
+    uint32_t getItemCount();
+
+
+    /** @fn hash
+     *  @brief Calcula el hash (FNV-1a) de una clave
+     *  @param key Clave
+     *  @param len Longitud de la clave
+     *  @return Hash de 32 bits
+     */
+    static uint32_t hash(const char* key, uint16_t len);
+
+private:
+
+    /** Estructura de las entradas de la tabla */
+    struct Slot{
+        const char* key;            ///< Clave registrada (NULL si la entrada esta libre)
+        uint32_t hash;              ///< Hash de la clave
+        V value;                    ///< Valor asociado
+    };
+
+    Slot*    _slots;        ///< Tabla de entradas
+    uint32_t _size;         ///< Numero de entradas (potencia de 2)
+    uint32_t _count;        ///< Numero de entradas ocupadas
+
+
+    /** @fn findSlot
+     *  @brief Busca la entrada asociada a una clave
+     *  @return Posicion de la entrada o _size si no existe
+     */
+    uint32_t findSlot(const char* key, uint16_t len, uint32_t h);
+
+
+    /** @fn resize
+     *  @brief Redimensiona la tabla, reubicando todas las entradas
+     *  @param size Nuevo tamano (potencia de 2)
+     *  @return Resultado
+     */
+    int32_t resize(uint32_t size);
+
+};
+
+#include "HashMap_tpp.h"
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * HashMap.tpp
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ *  Implementacion de la libreria HashMap.
+ */
+
+/** Archivo de cabecera para abstraer las reservas de memoria del Heap */
+#include "Heap.h"
+#include <string.h>
+
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC FUNCTIONS ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename V>
+HashMap<V>::HashMap(uint32_t size){
+    _slots = 0;
+    _size = 0;
+    _count = 0;
+    uint32_t s = 4;
+    while(s < size){
+        s <<= 1;
+    }
+    resize(s);
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+HashMap<V>::~HashMap(){
+    if(_slots){
+        Heap::memFree(_slots);
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+int32_t HashMap<V>::addItem(const char* key, V value){
+    if(!key || !_slots){
+        return(NULL_POINTER);
+    }
+    uint16_t len = strlen(key);
+    uint32_t h = hash(key, len);
+    if(findSlot(key, len, h) < _size){
+        return(ITEM_EXISTS);
+    }
+    // si supera el 75% de ocupacion, duplica el tamano de la tabla
+    if(((_count + 1) << 2) > (_size * 3)){
+        if(resize(_size << 1) != SUCCESS){
+            return(OUT_OF_MEMORY);
+        }
+    }
+    uint32_t mask = _size - 1;
+    uint32_t i = h & mask;
+    while(_slots[i].key){
+        i = (i + 1) & mask;
+    }
+    _slots[i].key = key;
+    _slots[i].hash = h;
+    _slots[i].value = value;
+    _count++;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+int32_t HashMap<V>::removeItem(const char* key, uint16_t len){
+    if(!key || !_slots){
+        return(NULL_POINTER);
+    }
+    uint32_t i = findSlot(key, len, hash(key, len));
+    if(i >= _size){
+        return(ITEM_NOT_FOUND);
+    }
+    // borrado con desplazamiento hacia atras, para no dejar huecos en las cadenas de sondeo
+    uint32_t mask = _size - 1;
+    uint32_t j = i;
+    for(;;){
+        j = (j + 1) & mask;
+        if(!_slots[j].key){
+            break;
+        }
+        // posicion ideal de la entrada j
+        uint32_t k = _slots[j].hash & mask;
+        // si k no esta en el rango circular (i, j], la entrada j puede ocupar el hueco i
+        if((i <= j)? (i < k && k <= j) : (i < k || k <= j)){
+            continue;
+        }
+        _slots[i] = _slots[j];
+        i = j;
+    }
+    _slots[i].key = 0;
+    _count--;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+int32_t HashMap<V>::removeItem(const char* key){
+    if(!key){
+        return(NULL_POINTER);
+    }
+    return removeItem(key, strlen(key));
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+bool HashMap<V>::getItem(const char* key, uint16_t len, V* value){
+    if(!key || !_slots){
+        return false;
+    }
+    uint32_t i = findSlot(key, len, hash(key, len));
+    if(i >= _size){
+        return false;
+    }
+    if(value){
+        *value = _slots[i].value;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+bool HashMap<V>::getItem(const char* key, V* value){
+    if(!key){
+        return false;
+    }
+    return getItem(key, strlen(key), value);
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+int32_t HashMap<V>::setItem(const char* key, V value){
+    if(!key || !_slots){
+        return(NULL_POINTER);
+    }
+    uint16_t len = strlen(key);
+    uint32_t i = findSlot(key, len, hash(key, len));
+    if(i >= _size){
+        return(ITEM_NOT_FOUND);
+    }
+    _slots[i].value = value;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+void HashMap<V>::removeAll(){
+    if(_slots){
+        memset(_slots, 0, _size * sizeof(Slot));
+    }
+    _count = 0;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+uint32_t HashMap<V>::getItemCount(){
+    return _count;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+uint32_t HashMap<V>::hash(const char* key, uint16_t len){
+    uint32_t h = 2166136261u;
+    for(uint16_t i = 0; i < len; i++){
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+//------------------------------------------------------------------------------------
+//-- PRIVATE FUNCTIONS ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename V>
+uint32_t HashMap<V>::findSlot(const char* key, uint16_t len, uint32_t h){
+    uint32_t mask = _size - 1;
+    uint32_t i = h & mask;
+    while(_slots[i].key){
+        // compara la clave completa, no solo los primeros 'len' caracteres
+        if(_slots[i].hash == h && strncmp(_slots[i].key, key, len) == 0 && _slots[i].key[len] == 0){
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return _size;
+}
+
+//------------------------------------------------------------------------------------
+template<typename V>
+int32_t HashMap<V>::resize(uint32_t size){
+    Slot* slots = (Slot*)Heap::memAlloc(size * sizeof(Slot));
+    if(!slots){
+        return(OUT_OF_MEMORY);
+    }
+    memset(slots, 0, size * sizeof(Slot));
+    uint32_t mask = size - 1;
+    for(uint32_t n = 0; n < _size; n++){
+        if(_slots[n].key){
+            uint32_t i = _slots[n].hash & mask;
+            while(slots[i].key){
+                i = (i + 1) & mask;
+            }
+            slots[i] = _slots[n];
+        }
+    }
+    if(_slots){
+        Heap::memFree(_slots);
+    }
+    _slots = slots;
+    _size = size;
+    return SUCCESS;
+}
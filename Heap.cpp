@@ -8,6 +8,167 @@
 
 #include "Heap.h"
 
-/** Mutex para Heap */
+#include <atomic>
 
-Mutex Heap::_mtx;
+
+#if HEAP_POOL_ENABLED == 1
+
+/** Configuracion de una clase del pool */
+struct PoolClass{
+	uint8_t* mem;				/// Bloques de la clase (contiguos)
+	uint16_t block_size;		/// Tamano de cada bloque
+	uint16_t blocks;			/// Numero de bloques
+};
+
+/** Estado de una clase del pool. Todos los campos se modifican sin bloqueo (CAS) */
+struct PoolState{
+	std::atomic<uint32_t> head;			/// Lista de bloques libres [etiqueta:16 | indice+1:16] (0 = vacia)
+	std::atomic<uint32_t> next_unused;	/// Primer bloque aun no utilizado
+	std::atomic<uint32_t> used;			/// Bloques en uso
+	std::atomic<uint32_t> hits;			/// Reservas atendidas por la clase
+	std::atomic<uint32_t> misses;		/// Reservas derivadas a malloc por agotamiento de la clase
+};
+
+static_assert(HEAP_POOL_BLOCKS_16 <= 0xFFFF && HEAP_POOL_BLOCKS_32 <= 0xFFFF && HEAP_POOL_BLOCKS_64 <= 0xFFFF &&
+			  HEAP_POOL_BLOCKS_128 <= 0xFFFF && HEAP_POOL_BLOCKS_256 <= 0xFFFF, "Heap pool class too big");
+
+/** Memoria de los bloques, alineada a 8 bytes */
+static uint64_t _pool_mem_16[(HEAP_POOL_BLOCKS_16 * 16) / 8];
+static uint64_t _pool_mem_32[(HEAP_POOL_BLOCKS_32 * 32) / 8];
+static uint64_t _pool_mem_64[(HEAP_POOL_BLOCKS_64 * 64) / 8];
+static uint64_t _pool_mem_128[(HEAP_POOL_BLOCKS_128 * 128) / 8];
+static uint64_t _pool_mem_256[(HEAP_POOL_BLOCKS_256 * 256) / 8];
+
+/** Clases del pool, ordenadas por tamano */
+static const PoolClass _pool_class[Heap::PoolClassCount] = {
+	{(uint8_t*)_pool_mem_16,  16,  HEAP_POOL_BLOCKS_16},
+	{(uint8_t*)_pool_mem_32,  32,  HEAP_POOL_BLOCKS_32},
+	{(uint8_t*)_pool_mem_64,  64,  HEAP_POOL_BLOCKS_64},
+	{(uint8_t*)_pool_mem_128, 128, HEAP_POOL_BLOCKS_128},
+	{(uint8_t*)_pool_mem_256, 256, HEAP_POOL_BLOCKS_256},
+};
+
+/** Estado de las clases, inicializado a 0 (sin bloques libres ni utilizados) */
+static PoolState _pool_state[Heap::PoolClassCount];
+
+/** Reservas mayores que la clase mas grande */
+static std::atomic<uint32_t> _pool_large;
+
+
+//------------------------------------------------------------------------------------
+void* Heap::poolAlloc(size_t size){
+	uint8_t cls = 0;
+	while(cls < PoolClassCount && _pool_class[cls].block_size < size){
+		cls++;
+	}
+	if(cls == PoolClassCount){
+		_pool_large.fetch_add(1, std::memory_order_relaxed);
+		return NULL;
+	}
+	const PoolClass& pc = _pool_class[cls];
+	PoolState& ps = _pool_state[cls];
+
+	// extrae un bloque de la lista de libres. La etiqueta evita el problema ABA, si otro hilo
+	// extrae y devuelve el mismo bloque entre la lectura de 'next' y el CAS, el CAS falla
+	uint32_t head = ps.head.load(std::memory_order_acquire);
+	while((head & 0xFFFF) != 0){
+		uint8_t* block = pc.mem + ((head & 0xFFFF) - 1) * pc.block_size;
+		uint16_t next = *(volatile uint16_t*)block;
+		if(ps.head.compare_exchange_weak(head, ((head + 0x10000) & 0xFFFF0000) | next, std::memory_order_acquire, std::memory_order_acquire)){
+			ps.used.fetch_add(1, std::memory_order_relaxed);
+			ps.hits.fetch_add(1, std::memory_order_relaxed);
+			return block;
+		}
+	}
+
+	// si no hay libres, utiliza un bloque nuevo
+	uint32_t n = ps.next_unused.load(std::memory_order_relaxed);
+	while(n < pc.blocks){
+		if(ps.next_unused.compare_exchange_weak(n, n + 1, std::memory_order_relaxed)){
+			ps.used.fetch_add(1, std::memory_order_relaxed);
+			ps.hits.fetch_add(1, std::memory_order_relaxed);
+			return pc.mem + n * pc.block_size;
+		}
+	}
+	ps.misses.fetch_add(1, std::memory_order_relaxed);
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+bool Heap::poolFree(void* ptr){
+	uint8_t* block = (uint8_t*)ptr;
+	for(uint8_t cls = 0; cls < PoolClassCount; cls++){
+		const PoolClass& pc = _pool_class[cls];
+		if(block < pc.mem || block >= pc.mem + pc.blocks * pc.block_size){
+			continue;
+		}
+		PoolState& ps = _pool_state[cls];
+		uint32_t index = ((block - pc.mem) / pc.block_size) + 1;
+		uint32_t head = ps.head.load(std::memory_order_relaxed);
+		do{
+			*(volatile uint16_t*)block = (uint16_t)(head & 0xFFFF);
+		}while(!ps.head.compare_exchange_weak(head, ((head + 0x10000) & 0xFFFF0000) | index, std::memory_order_release, std::memory_order_relaxed));
+		ps.used.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+
+//------------------------------------------------------------------------------------
+bool Heap::getPoolStats(uint8_t cls, PoolStats* stats){
+	if(cls >= PoolClassCount || !stats){
+		return false;
+	}
+	stats->block_size = _pool_class[cls].block_size;
+	stats->blocks = _pool_class[cls].blocks;
+	stats->used = _pool_state[cls].used.load(std::memory_order_relaxed);
+	stats->hits = _pool_state[cls].hits.load(std::memory_order_relaxed);
+	stats->misses = _pool_state[cls].misses.load(std::memory_order_relaxed);
+	return true;
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t Heap::getLargeAllocCount(){
+	return _pool_large.load(std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------------
+void Heap::resetPoolStats(){
+	for(uint8_t cls = 0; cls < PoolClassCount; cls++){
+		_pool_state[cls].hits.store(0, std::memory_order_relaxed);
+		_pool_state[cls].misses.store(0, std::memory_order_relaxed);
+	}
+	_pool_large.store(0, std::memory_order_relaxed);
+}
+
+#else
+
+//------------------------------------------------------------------------------------
+void* Heap::poolAlloc(size_t){
+	return NULL;
+}
+
+//------------------------------------------------------------------------------------
+bool Heap::poolFree(void*){
+	return false;
+}
+
+//------------------------------------------------------------------------------------
+bool Heap::getPoolStats(uint8_t, PoolStats*){
+	return false;
+}
+
+//------------------------------------------------------------------------------------
+uint32_t Heap::getLargeAllocCount(){
+	return 0;
+}
+
+//------------------------------------------------------------------------------------
+void Heap::resetPoolStats(){
+}
+
+#endif
@@ -25,6 +25,29 @@ using namespace rtos;
 #include "sdkconfig.h"
 #endif
 
+/** Configuracion del pool de bloques: es opcional (HEAP_POOL_ENABLED=1) ya que reserva de forma estatica
+ *  unos 14KB con los tamanos por defecto. El numero de bloques de cada clase (16, 32, 64, 128 y 256 bytes)
+ *  puede ajustarse desde la compilacion.
+ */
+#ifndef HEAP_POOL_ENABLED
+#define HEAP_POOL_ENABLED		0
+#endif
+#ifndef HEAP_POOL_BLOCKS_16
+#define HEAP_POOL_BLOCKS_16		128
+#endif
+#ifndef HEAP_POOL_BLOCKS_32
+#define HEAP_POOL_BLOCKS_32		128
+#endif
+#ifndef HEAP_POOL_BLOCKS_64
+#define HEAP_POOL_BLOCKS_64		64
+#endif
+#ifndef HEAP_POOL_BLOCKS_128
+#define HEAP_POOL_BLOCKS_128	16
+#endif
+#ifndef HEAP_POOL_BLOCKS_256
+#define HEAP_POOL_BLOCKS_256	8
+#endif
+
 class Heap{
 public:
 
@@ -62,78 +85,99 @@ public:
         esp_log_level_set("[Heap]..........", log_level);
 	}
 
-	/** Allocates memory
+	/** Reserva memoria. Los bloques pequenos se obtienen del pool (sin bloqueo), los bloques mayores o
+	 *  las reservas en una clase agotada se derivan a malloc. Desde una ISR solo se utiliza el pool, por
+	 *  lo que la reserva devuelve NULL si el pool esta deshabilitado o no puede atenderla.
 	 *
-	 * @param size Size in bytes to allocate
-	 * @param dbg_trace
-	 * @return pointer to the allocated memory or NULL
+	 * @param size Tamano en bytes a reservar
+	 * @return Puntero a la memoria reservada o NULL
 	 */
 	static void* memAlloc(size_t size){
-		uint32_t prev_size=0;
-		uint32_t post_size=0;
-		#if __MBED__==1
-		mbed_stats_heap_t heap_stats;
-		#endif
-		if(!IS_ISR()){
-			_mtx.lock();
-			#if ESP_PLATFORM == 1
-			prev_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-			#elif __MBED__==1
-			mbed_stats_heap_get(&heap_stats);
-			prev_size = (heap_stats.reserved_size - heap_stats.current_size);
-			#endif
+		void *ptr = poolAlloc(size);
+		if(ptr || IS_ISR()){
+			return ptr;
 		}
-        void *ptr = malloc(size);
+        ptr = malloc(size);
         if(!ptr){
             volatile int i = 0;
             while(i==0){
             }
         }
-		if(!IS_ISR()){
-			_mtx.unlock();
-			#if ESP_PLATFORM == 1
-			post_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-			#elif __MBED__==1
-			mbed_stats_heap_get(&heap_stats);
-			post_size = (heap_stats.reserved_size - heap_stats.current_size);
-			#endif
-		}
         return ptr;
     }
 
-	/** Releases allocated memory
+	/** Libera memoria reservada. Desde una ISR solo pueden liberarse bloques del pool
 	 *
-	 * @param ptr Pointer to release
+	 * @param ptr Puntero a liberar
 	 */
     static void memFree(void* ptr){
-		uint32_t prev_size=0;
-		uint32_t post_size=0;
-		#if __MBED__==1
-		mbed_stats_heap_t heap_stats;
-		#endif
-		if(!IS_ISR()){
-			_mtx.lock();
-			#if ESP_PLATFORM == 1
-			prev_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-
-			#elif __MBED__==1
-			mbed_stats_heap_get(&heap_stats);
-			prev_size = heap_stats.reserved_size - heap_stats.current_size;
-			#endif
+		if(poolFree(ptr)){
+			return;
 		}
         free(ptr);
-		if(!IS_ISR()){
-			#if ESP_PLATFORM == 1
-			post_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-			#elif __MBED__==1
-			mbed_stats_heap_get(&heap_stats);
-			post_size = (heap_stats.reserved_size - heap_stats.current_size);
-			#endif
-			_mtx.unlock();
-		}
     }
+
+	/** Estadisticas de una clase del pool */
+	struct PoolStats{
+		uint16_t block_size;	///< Tamano de bloque en bytes
+		uint16_t blocks;		///< Numero de bloques de la clase
+		uint16_t used;			///< Bloques en uso
+		uint32_t hits;			///< Reservas atendidas por la clase
+		uint32_t misses;		///< Reservas derivadas a malloc por agotamiento de la clase
+	};
+
+	/** Numero de clases del pool */
+	static const uint8_t PoolClassCount = 5;
+
+	/** Obtiene las estadisticas de una clase del pool
+	 *
+	 * @param cls Clase (0 .. PoolClassCount-1)
+	 * @param stats Recibe las estadisticas
+	 * @return True si la clase existe
+	 */
+	static bool getPoolStats(uint8_t cls, PoolStats* stats);
+
+	/** Obtiene el numero de reservas mayores que la clase mas grande
+	 *
+	 * @return Numero de reservas derivadas a malloc por su tamano
+	 */
+	static uint32_t getLargeAllocCount();
+
+	/** Reinicia los contadores de aciertos, fallos y reservas grandes */
+	static void resetPoolStats();
+
+	/** Muestra la tasa de aciertos de cada clase del pool
+	 *
+	 * @param added_text Texto anadido a la traza
+	 */
+	static void printPoolStats(const char* added_text=""){
+		PoolStats st;
+		for(uint8_t i = 0; i < PoolClassCount; i++){
+			if(!getPoolStats(i, &st)){
+				return;
+			}
+			uint32_t total = st.hits + st.misses;
+			DEBUG_TRACE_W(!IS_ISR(), "[Heap]..........", "POOL_%d used=%d/%d, hits=%d, misses=%d, hit_rate=%d%%, %s",
+					st.block_size, st.used, st.blocks, st.hits, st.misses, (total)? ((st.hits * 100) / total) : 100, added_text);
+		}
+		DEBUG_TRACE_W(!IS_ISR(), "[Heap]..........", "POOL_large allocs=%d, %s", getLargeAllocCount(), added_text);
+	}
+
 private:
-    static Mutex _mtx;
+
+	/** Reserva un bloque de la clase mas pequena en la que cabe
+	 *
+	 * @param size Tamano en bytes a reservar
+	 * @return Puntero al bloque o NULL si no cabe en ninguna clase o la clase esta agotada
+	 */
+	static void* poolAlloc(size_t size);
+
+	/** Devuelve un bloque a su clase
+	 *
+	 * @param ptr Puntero a liberar
+	 * @return True si el bloque pertenece al pool, False si debe liberarse con free
+	 */
+	static bool poolFree(void* ptr);
 };
 
 
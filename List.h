@@ -17,6 +17,19 @@
 
 
 
+/** @struct ListNode
+ *  @brief Nodo de una lista. Puede integrarse en el propio objeto (lista intrusiva) para insertarlo
+ *         sin reservar memoria, y permite eliminarlo de la lista en O(1) mediante "removeNode".
+ */
+template<typename T>
+struct ListNode{
+    ListNode<T> *prev;          ///< Puntero al anterior
+    ListNode<T> *next;          ///< Puntero al siguiente
+    T * item;                   ///< Objeto insertado (NULL si el nodo no est en ninguna lista)
+    bool external;              ///< El nodo pertenece al objeto y no se libera al eliminarlo
+};
+
+
 template<typename T>
 class List {
 public:
@@ -57,6 +70,16 @@ public:
      */
     int32_t addItem(T* item);
 
+    /** @fn addItem
+     *  @brief Aade un objeto a la lista utilizando un nodo proporcionado por el llamante (normalmente
+     *         integrado en el propio objeto), de forma que no se reserva memoria. El nodo debe permanecer
+     *         vlido mientras el objeto est en la lista y no puede estar en otra lista.
+     *  @param item Objeto a aadir
+     *  @param node Nodo a utilizar
+     *  @return Resultado
+     */
+    int32_t addItem(T* item, ListNode<T>* node);
+
     /** @fn insertItem
      *  @brief Inserta un objeto en la lista
      *  @param item Objeto a aadir
@@ -71,6 +94,13 @@ public:
      */
     int32_t removeItem(T* item);
 
+    /** @fn removeNode
+     *  @brief Elimina un objeto de la lista en O(1) a partir de su nodo
+     *  @param node Nodo del objeto a eliminar
+     *  @param Resultado
+     */
+    int32_t removeNode(ListNode<T>* node);
+
 
     /** @fn removeAll
      *  @brief Borra todas las entradas de la lista
@@ -120,14 +150,44 @@ public:
      */
     T* searchItem(T* item);
 
+
+    /** @class Iterator
+     *  @brief Iterador externo de la lista. Mantiene su propia posicin, de forma que varios recorridos
+     *         pueden realizarse en paralelo o anidados sin alterar el puntero de bsqueda de la lista.
+     *         El siguiente nodo se obtiene antes de visitar el actual, por lo que el objeto visitado
+     *         puede eliminarse de la lista durante el recorrido (pero no el siguiente).
+     *         Ej: for(T* item : list){...}
+     */
+    class Iterator{
+    public:
+        Iterator(ListNode<T>* node) : _node(node), _next((node)? node->next : 0){}
+        T* operator*() const { return _node->item; }
+        Iterator& operator++(){ _node = _next; _next = (_node)? _node->next : 0; return *this; }
+        bool operator==(const Iterator& it) const { return _node == it._node; }
+        bool operator!=(const Iterator& it) const { return _node != it._node; }
+    private:
+        ListNode<T>* _node;     ///< Nodo actual
+        ListNode<T>* _next;     ///< Nodo siguiente
+    };
+
+
+    /** @fn begin
+     *  @brief Obtiene un iterador al primer objeto de la lista
+     *  @return Iterador
+     */
+    Iterator begin() const;
+
+
+    /** @fn end
+     *  @brief Obtiene el iterador de fin de la lista
+     *  @return Iterador
+     */
+    Iterator end() const;
+
 private:
 	
     /** Estructura de los items a insertar en la lista */
-    struct ListItem{
-        struct ListItem *prev;      ///< Puntero al anterior
-        struct ListItem *next;      ///< Puntero al siguiente
-        T * item;                   ///< Objeto insertado
-    };
+    typedef ListNode<T> ListItem;
 
     ListItem *_first;       ///< Puntero al primer elemento
     ListItem *_last;        ///< Puntero al ltimo elemento
@@ -143,6 +203,21 @@ private:
      */
     int32_t removeListItem(ListItem * listitem);
 
+
+    /** @fn appendListItem
+     *  @brief Aade una entrada al final de la lista
+     *  @param listitem Registro a aadir
+     *  @param item Objeto asociado
+     */
+    void appendListItem(ListItem * listitem, T* item);
+
+
+    /** @fn releaseListItem
+     *  @brief Libera una entrada eliminada de la lista, o la desvincula si pertenece al objeto
+     *  @param listitem Registro a liberar
+     */
+    void releaseListItem(ListItem * listitem);
+
 };
 
 #include "List_tpp.h"
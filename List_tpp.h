@@ -57,23 +57,22 @@ int32_t List<T>::addItem(T* item){
     if(!listitem){
         return(OUT_OF_MEMORY);
     }
-    listitem->item = item;
-    // si es el primero, inicializa los punteros
-    if(!_count){
-        _first = listitem;
-        _last = listitem;
-        listitem->prev = 0;
-        listitem->next = 0;
+    listitem->external = false;
+    appendListItem(listitem, item);
+	return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+int32_t List<T>::addItem(T* item, ListNode<T>* node){
+    if(!item || !node){
+        return(NULL_POINTER);
     }
-    // sino, lo aade al final
-    else{
-        ListItem* last = _last;
-        last->next = listitem;
-        listitem->prev = last;
-        listitem->next = 0;
-        _last = listitem;
+    if(_count >= _numItems){
+        return(LIMIT_EXCEEDED);
     }
-    _count++;
+    node->external = true;
+    appendListItem(node, item);
 	return SUCCESS;
 }
 
@@ -91,6 +90,7 @@ int32_t List<T>::insertItem(T* item){
         return(OUT_OF_MEMORY);
     }
     listitem->item = item;
+    listitem->external = false;
     // si es el primero, inicializa punteros
     if(!_search){
         _first = listitem;
@@ -149,6 +149,21 @@ int32_t List<T>::removeItem(T* item){
 }
 
 
+//------------------------------------------------------------------------------------
+template<typename T>
+int32_t List<T>::removeNode(ListNode<T>* node){
+    if(!node){
+        return(NULL_POINTER);
+    }
+    if(!node->item){
+        return(ITEM_NOT_FOUND);
+    }
+    // apunta al siguiente, igual que removeItem
+    _search = node->next;
+    return removeListItem(node);
+}
+
+
 //------------------------------------------------------------------------------------
 template<typename T>
 void List<T>::removeAll(){
@@ -242,6 +257,18 @@ T* List<T>::searchItem(T* item){
     return 0;
 }
 
+//------------------------------------------------------------------------------------
+template<typename T>
+typename List<T>::Iterator List<T>::begin() const{
+    return Iterator(_first);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+typename List<T>::Iterator List<T>::end() const{
+    return Iterator(0);
+}
+
 //------------------------------------------------------------------
 template<typename T>
 int32_t List<T>::removeListItem(ListItem *listitem){
@@ -253,14 +280,14 @@ int32_t List<T>::removeListItem(ListItem *listitem){
             _last = 0;
             _count = 0;
             _search = 0;
-            Heap::memFree(listitem);
+            releaseListItem(listitem);
             return SUCCESS;
         }
         _first = listitem->next;
         listitem->next->prev = 0;
         _count--;
-         Heap::memFree(listitem);
-         return SUCCESS;
+        releaseListItem(listitem);
+        return SUCCESS;
     }
     // si no es el primero, lo suprime
     listitem->prev->next = listitem->next;
@@ -271,6 +298,41 @@ int32_t List<T>::removeListItem(ListItem *listitem){
         _last = listitem->prev;
 	}
     _count--;
-    Heap::memFree(listitem); 
+    releaseListItem(listitem);
 	return SUCCESS;
 }
+
+//------------------------------------------------------------------
+template<typename T>
+void List<T>::appendListItem(ListItem *listitem, T* item){
+    listitem->item = item;
+    // si es el primero, inicializa los punteros
+    if(!_count){
+        _first = listitem;
+        _last = listitem;
+        listitem->prev = 0;
+        listitem->next = 0;
+    }
+    // sino, lo aade al final
+    else{
+        ListItem* last = _last;
+        last->next = listitem;
+        listitem->prev = last;
+        listitem->next = 0;
+        _last = listitem;
+    }
+    _count++;
+}
+
+//------------------------------------------------------------------
+template<typename T>
+void List<T>::releaseListItem(ListItem *listitem){
+    // los nodos integrados en el objeto slo se desvinculan
+    if(listitem->external){
+        listitem->prev = 0;
+        listitem->next = 0;
+        listitem->item = 0;
+        return;
+    }
+    Heap::memFree(listitem);
+}
@@ -11,21 +11,106 @@
 /** Mutex para MQBroker */
 Mutex MQ::MQBroker::_mutex;
 
-/** Lista de topics */
-List<MQ::Topic> * MQ::MQBroker::_topic_list = 0;
+/** Tabla de topics */
+TopicTable<MQ::topic_t, MQ::Subscriber> * MQ::MQBroker::_topic_table = 0;
+uint32_t MQ::MQBroker::_cancelled = 0;
+
+/** Indice de topics */
+TopicTree<MQ::MQBroker::TopicRow, MQ::key_t> * MQ::MQBroker::_topic_tree = 0;
 
 /** Variables para el control de tokens y topics */
 bool MQ::MQBroker::_tokenlist_internal = false;
 const char** MQ::MQBroker::_token_provider = 0;
 uint32_t MQ::MQBroker::_token_provider_count = 0;
+uint32_t MQ::MQBroker::_token_provider_size = 0;
+HashMap<MQ::token_t> * MQ::MQBroker::_token_dict = 0;
 uint8_t MQ::MQBroker::_token_bits = 0;
 uint8_t MQ::MQBroker::_max_name_len = 0;
 
 bool MQ::MQBroker::_defdbg = false;
-List<MQ::MQBroker::PendingRequest_t> * MQ::MQBroker::_pending_list = 0;
+MpscQueue<MQ::MQBroker::PendingRequest_t> * MQ::MQBroker::_pending_list = 0;
+uint32_t MQ::MQBroker::_lock_depth = 0;
 
 /** Contador de publicaciones */
 uint32_t MQ::MQBroker::_pub_count = 0;
 
+/** Generacion del conjunto de suscripciones */
+uint32_t MQ::MQBroker::_generation = 1;
+
+/** Recoleccion de tokens */
+uint32_t* MQ::MQBroker::_token_refs = 0;
+uint32_t MQ::MQBroker::_token_unreferenced = 0;
+uint32_t MQ::MQBroker::_token_low = 0;
+uint32_t MQ::MQBroker::_token_generation = 0;
+uint32_t MQ::MQBroker::_token_collect_budget = MQ::MQBroker::DefaultTokenCollectBudget;
+MQ::TokenCollectStats MQ::MQBroker::_token_collect_stats = {0, 0, 0, 0, 0};
+
+/** Prefiltro de publicaciones */
+MQ::MQBroker::Prefilter MQ::MQBroker::_prefilter;
+bool MQ::MQBroker::_prefilter_enabled = true;
+
+/** Flag de entrega sin copia */
+bool MQ::MQBroker::_zero_copy = false;
+
+/** Publicacion sin bloqueo */
+bool MQ::MQBroker::_lock_free = false;
+std::atomic<MQ::MQBroker::Snapshot*> MQ::MQBroker::_snapshot(0);
+MQ::MQBroker::Snapshot* MQ::MQBroker::_retired = 0;
+std::atomic<uint32_t> MQ::MQBroker::_rcu_epoch(0);
+std::atomic<uint32_t> MQ::MQBroker::_rcu_readers[2];
+
+/** Despacho asincrono */
+MQ::MQBroker::Dispatcher* MQ::MQBroker::_dispatchers = 0;
+uint8_t MQ::MQBroker::_dispatcher_count = 0;
+MQ::DispatchNotify MQ::MQBroker::_dispatch_notify = MQ::NotifyOnDelivered;
+
+/** Cola de publicaciones desde interrupcion */
+MpscQueue<MQ::MQBroker::IsrRequest>* MQ::MQBroker::_isr_queue = 0;
+Thread* MQ::MQBroker::_isr_thread = 0;
+Semaphore MQ::MQBroker::_isr_pending(0);
+std::atomic<bool> MQ::MQBroker::_isr_signaled(false);
+std::atomic<bool> MQ::MQBroker::_isr_stop(false);
+MQ::PublishCallback MQ::MQBroker::_null_publisher(&MQ::MQBroker::nullPublishedCb);
+
+/** Publicaciones anidadas */
+bool MQ::MQBroker::_nested_queued = false;
+uint8_t MQ::MQBroker::_nested_max_depth = MQ::MQBroker::DefaultMaxNestedDepth;
+List<MQ::MQBroker::DispatchJob>* MQ::MQBroker::_nested_list = 0;
+uint32_t MQ::MQBroker::_dispatch_depth = 0;
+uint32_t MQ::MQBroker::_dispatch_level = 0;
+bool MQ::MQBroker::_dispatch_draining = false;
+uintptr_t MQ::MQBroker::_dispatch_stack = 0;
+MQ::NestedDispatchStats MQ::MQBroker::_nested_stats = {0, 0, 0, 0};
+
+/** Mensajes retenidos */
+List<MQ::MQBroker::Retained>* MQ::MQBroker::_retained_list = 0;
+HashMap<MQ::MQBroker::Retained*>* MQ::MQBroker::_retained_index = 0;
+uint32_t MQ::MQBroker::_retained_budget = 0;
+uint32_t MQ::MQBroker::_retained_bytes = 0;
+MQ::RetainEviction MQ::MQBroker::_retained_eviction = MQ::RetainEvictOldest;
+
+/** Suscripciones con entrega del ultimo valor por intervalo */
+List<MQ::MQBroker::ConflateSlot>* MQ::MQBroker::_conflate_list = 0;
+HashMap<MQ::MQBroker::ConflateSlot*>* MQ::MQBroker::_conflate_index = 0;
+Mutex MQ::MQBroker::_conflate_mutex;
+Timer MQ::MQBroker::_conflate_clock;
+uint32_t MQ::MQBroker::_conflate_pass = 0;
+Thread* MQ::MQBroker::_flush_thread = 0;
+Semaphore MQ::MQBroker::_flush_wakeup(0);
+std::atomic<bool> MQ::MQBroker::_flush_stop(false);
+uint32_t MQ::MQBroker::_flush_period = MQ::MQBroker::DefaultConflateFlushPeriod;
+
 /** Gestor de bridges */
-std::map<std::string, std::list<MQ::BridgeCallback*>*> MQ::MQClient::_bridges;
+MQ::MQClient::Bridge* MQ::MQClient::_bridges = 0;
+uint16_t MQ::MQClient::_bridge_count = 0;
+uint16_t MQ::MQClient::_bridge_size = 0;
+uint32_t MQ::MQClient::_bridge_generation = 1;
+uint32_t MQ::MQClient::_bridge_tokens = 0;
+
+/** Cache de publicaciones */
+MQ::MQClient::CacheEntry* MQ::MQClient::_cache = 0;
+uint16_t MQ::MQClient::_cache_size = 0;
+uint16_t MQ::MQClient::_cache_hand = 0;
+HashMap<uint16_t>* MQ::MQClient::_cache_index = 0;
+MQ::PublishCacheStats MQ::MQClient::_cache_stats = {0, 0, 0};
+Mutex MQ::MQClient::_cache_mutex;
@@ -44,17 +44,19 @@
  *  sin necesidad de tocar esos par�metros. Sin embargo, podr�an modificarse adapt�ndola a casos especiales. Las limitaciones
  *  son �stas:
  *
- *  Identificador de topic: Variable entera 64-bit (uint64_t)
+ *  Identificador de topic: un identificador de token por nivel (MQ::token_t) mas los valores de los niveles numericos
+ *  (MQ::topic_t, empaquetado).
  *
- *  Relaci�n entre "Identificador de token" vs "Niveles de profundidad"
- *     TokenId_size vs  NivelesDeProfundidad   
- *      8bit_token  -> 8 niveles (m�ximo de 256 tokens)
- *      9bit_token  -> 7 niveles (m�ximo de 512 tokens)
- *      10bit_token -> 6 niveles (m�ximo de 1024 tokens)
- *      13bit_token -> 5 niveles (m�ximo de 8192 tokens)
- *      16bit_token -> 4 niveles (m�ximo de 65536 tokens)
- *
- *  La configuraci�n se selecciona mediante el par�metro MQ_CONFIG_VALUE
+ *  El ancho del identificador de token, la profundidad de los topics y los limites del broker se fijan en tiempo de
+ *  compilacion mediante el parametro MQ_CONFIG_VALUE:
+ *      MQ_CONFIG_SMALL   -> tokens de 8 bits, 10 niveles (maximo de 251 tokens y 256 topics). Por defecto.
+ *      MQ_CONFIG_GATEWAY -> tokens de 16 bits, 16 niveles (maximo de 65531 tokens y 32768 topics).
+ *  MQ_TOKEN_BITS admite cualquier ancho entre 8 y 16 bits (ej: 9, 10 o 13 bits para 507, 1019 u 8187 tokens). Cada
+ *  nivel ocupa un MQ::token_t completo (uint16_t a partir de 9 bits), por lo que el ancho solo limita el tamano del
+ *  diccionario, y la profundidad se fija por separado mediante MQ_MAX_TOKEN_LEVEL.
+ *  Cada parametro (MQ_TOKEN_BITS, MQ_MAX_TOKEN_LEVEL, MQ_MAX_NUMERIC_LEVELS, MQ_MAX_TOPICS, MQ_PREFILTER_BITS) puede
+ *  ajustarse ademas de forma individual desde el build. MQ_PREFILTER_BITS es el tamano por nivel del mapa de bits del
+ *  prefiltro de publicaciones (256 en MQ_CONFIG_SMALL y 1024 en MQ_CONFIG_GATEWAY, ver MQBroker::setPublishPrefilter).
  *
  *  Es posible publicar y suscribirse a topics dedicados relativos a un �mbito concreto que se sale de la norma de identificaci�n
  *  de los topics. El wildcard es '@' de esta forma se genera un �mbito "scope" al que se dirige el mensaje. Dicho scope 
@@ -66,6 +68,11 @@
  *
  *  En caso de no utilizar el wildcard "scope", su valor ser� 0 y se considerar� un topic general.
  *
+ *  Los niveles numericos (ej: el identificador de "@dev/8976/..." o el indice de "stat/var/3") no se registran como
+ *  tokens, sino que se codifican por su valor en el identificador del topic (hasta MQ::MAX_NUMERIC_LEVELS niveles por
+ *  topic, de hasta 9 digitos sin ceros a la izquierda). De esta forma, miles de dispositivos o grupos no agotan el
+ *  diccionario de tokens, y el indice de suscripciones localiza cada valor directamente en su nivel.
+ *
  */
 
 #ifndef MQLIB_H_
@@ -75,10 +82,70 @@
 //------------------------------------------------------------------------------------
 #include "mbed.h"
 #include "List.h"
+#include "TopicTree.h"
+#include "TopicTable.h"
+#include "HashMap.h"
+#include "MpscQueue.h"
 #include "Heap.h"
 #include <list>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <new>
+
+
+/** Configuracion en tiempo de compilacion (ver MQ_CONFIG_VALUE en la descripcion de la libreria). Cualquier parametro
+ *  puede definirse desde el build para sobreescribir el valor del perfil seleccionado.
+ */
+#define MQ_CONFIG_SMALL			0
+#define MQ_CONFIG_GATEWAY		1
+#ifndef MQ_CONFIG_VALUE
+#define MQ_CONFIG_VALUE			MQ_CONFIG_SMALL
+#endif
+#if MQ_CONFIG_VALUE == MQ_CONFIG_GATEWAY
+#ifndef MQ_TOKEN_BITS
+#define MQ_TOKEN_BITS			16
+#endif
+#ifndef MQ_MAX_TOKEN_LEVEL
+#define MQ_MAX_TOKEN_LEVEL		16
+#endif
+#ifndef MQ_MAX_TOPICS
+#define MQ_MAX_TOPICS			32768
+#endif
+#ifndef MQ_PREFILTER_BITS
+#define MQ_PREFILTER_BITS		1024
+#endif
+#elif MQ_CONFIG_VALUE == MQ_CONFIG_SMALL
+#ifndef MQ_TOKEN_BITS
+#define MQ_TOKEN_BITS			8
+#endif
+#ifndef MQ_MAX_TOKEN_LEVEL
+#define MQ_MAX_TOKEN_LEVEL		10
+#endif
+#ifndef MQ_MAX_TOPICS
+#define MQ_MAX_TOPICS			256
+#endif
+#ifndef MQ_PREFILTER_BITS
+#define MQ_PREFILTER_BITS		256
+#endif
+#else
+#error "MQ_CONFIG_VALUE no soportado"
+#endif
+#ifndef MQ_MAX_NUMERIC_LEVELS
+#define MQ_MAX_NUMERIC_LEVELS	3
+#endif
+#if MQ_TOKEN_BITS < 8 || MQ_TOKEN_BITS > 16
+#error "MQ_TOKEN_BITS debe estar entre 8 y 16"
+#endif
+#if MQ_MAX_TOKEN_LEVEL < 1 || MQ_MAX_TOKEN_LEVEL > 64
+#error "MQ_MAX_TOKEN_LEVEL debe estar entre 1 y 64"
+#endif
+#if MQ_MAX_NUMERIC_LEVELS > MQ_MAX_TOKEN_LEVEL
+#error "MQ_MAX_NUMERIC_LEVELS no puede superar MQ_MAX_TOKEN_LEVEL"
+#endif
+#if MQ_PREFILTER_BITS < 32 || (MQ_PREFILTER_BITS & (MQ_PREFILTER_BITS - 1)) != 0
+#error "MQ_PREFILTER_BITS debe ser una potencia de 2 no inferior a 32"
+#endif
 
 
 //------------------------------------------------------------------------------------
@@ -96,13 +163,31 @@ static const uint8_t DefaultMaxTopicNameLength = 64;
 /** @struct MQ::MAX_TOKEN_LEVEL
  *  @brief Tipo definido para definir la profundidad m�xima de los topics
  */
-static const uint8_t MAX_TOKEN_LEVEL = 10;
+static const uint8_t MAX_TOKEN_LEVEL = MQ_MAX_TOKEN_LEVEL;
+
+
+/** @struct MQ::MAX_NUMERIC_LEVELS
+ *  @brief Maximo numero de niveles numericos de un topic que se codifican como valores enteros
+ */
+static const uint8_t MAX_NUMERIC_LEVELS = MQ_MAX_NUMERIC_LEVELS;
    
     
 /** @struct MQ::token_t
  *  @brief Tipo definido para definir el valor de un token
  */
+#if MQ_TOKEN_BITS > 8
+typedef uint16_t token_t;
+#else
 typedef uint8_t token_t;
+#endif
+
+
+/** @struct MQ::key_t
+ *  @brief Tipo definido para las claves de nivel del indice de suscripciones: el identificador del token o,
+ *         en los niveles numericos, su valor marcado con MQ::NumericKey
+ */
+typedef uint32_t key_t;
+static const key_t NumericKey = 0x80000000;
     
     
 /** @struct MQ::Token
@@ -138,6 +223,7 @@ enum ErrorResult{
 	NOT_FOUND,        		///< Fallo por objeto no existente
     OUT_OF_BOUNDS,          ///< Fallo por exceso de tama�o
     LOCK_TIMEOUT,			///< Fallo por timeout en el lock
+    DEFERRED,				///< Operacion aplazada por broker ocupado, se aplicara al liberarse
 };
 	
     
@@ -145,22 +231,233 @@ enum ErrorResult{
  *  @brief Tipo definido para definir el identificador de un topic
  */
 struct __packed topic_t{
-    uint8_t tk[MQ::MAX_TOKEN_LEVEL+1];
+    MQ::token_t tk[MQ::MAX_TOKEN_LEVEL+1];
+    uint32_t num[MQ::MAX_NUMERIC_LEVELS];			/// Valores de los niveles numericos, por orden de aparicion
+};
+
+
+
+/** @enum SubscribeFlags
+ *  @brief Opciones de suscripcion
+ */
+enum SubscribeFlags{
+	SubscribeReadOnly = 0,				///< El suscriptor no modifica el mensaje (admite entrega sin copia)
+	SubscribeMutable = (1 << 0),		///< El suscriptor modifica el mensaje y requiere una copia privada
+	SubscribeConflate = (1 << 1),		///< El suscriptor solo recibe el ultimo mensaje de cada topic por intervalo
+};
+
+
+/** @enum PublishFlags
+ *  @brief Opciones de publicacion
+ */
+enum PublishFlags{
+	PublishDefault = 0,					///< Publicacion sin retencion
+	PublishRetain = (1 << 0),			///< El broker retiene el mensaje como ultimo valor del topic
+};
+
+
+/** @enum RetainEviction
+ *  @brief Politica del almacen de mensajes retenidos cuando un mensaje nuevo no cabe en su presupuesto
+ */
+enum RetainEviction{
+	RetainEvictOldest = 0,				///< Descarta los mensajes retenidos actualizados hace mas tiempo
+	RetainRejectNew,					///< Rechaza el mensaje nuevo (OUT_OF_MEMORY)
+};
+
+
+/** @enum DispatchNotify
+ *  @brief Momento en el que se invoca la PublishCallback en el modo de despacho asincrono
+ */
+enum DispatchNotify{
+	NotifyOnDelivered = 0,				///< Tras entregar el mensaje a todos los suscriptores
+	NotifyOnEnqueued,					///< Al encolar el mensaje para su despacho
+};
+
+
+/** @struct Subscriber
+ *  @brief Entrada de la lista de suscriptores de un topic
+ */
+struct Subscriber{
+	MQ::SubscribeCallback* cb;			/// Manejador de las actualizaciones del topic (NULL si se ha cancelado durante un reparto)
+	uint8_t flags;						/// Opciones de suscripcion (MQ::SubscribeFlags)
+	uint32_t interval;					/// Intervalo minimo entre entregas (ms) con MQ::SubscribeConflate
 };
 
 
+/** @struct NestedDispatchStats
+ *  @brief Estadisticas de las publicaciones realizadas desde un suscriptor durante un reparto
+ */
+struct NestedDispatchStats{
+	uint32_t peak_queue;							/// Maximo numero de publicaciones anidadas encoladas
+	uint32_t peak_level;							/// Maximo nivel de anidamiento alcanzado
+	uint32_t peak_stack;							/// Maximo uso de pila (bytes) desde la publicacion raiz
+	uint32_t rejected;								/// Publicaciones anidadas descartadas
+};
+
+
+/** @struct PublishCacheStats
+ *  @brief Estadisticas de la cache de publicaciones por nombre
+ */
+struct PublishCacheStats{
+	uint32_t hits;									/// Publicaciones resueltas desde la cache, sin cambios
+	uint32_t misses;								/// Publicaciones no encontradas, desactualizadas o en uso
+	uint32_t evictions;								/// Entradas reemplazadas por otro topic
+};
+
+
+/** @struct TokenCollectStats
+ *  @brief Estadisticas de la recoleccion de tokens sin referencias
+ */
+struct TokenCollectStats{
+	uint32_t freed;									/// Tokens liberados
+	uint32_t moved;									/// Tokens reubicados para compactar el diccionario
+	uint32_t passes;								/// Pasadas de recoleccion realizadas
+	uint32_t peak_pause;							/// Maxima duracion de una pasada (us)
+	uint32_t unreferenced;							/// Tokens sin referencias pendientes de liberar
+};
+
+
+/** @struct PublishEntry
+ *  @brief Entrada de una publicacion por lotes
+ */
+struct PublishEntry{
+	const char* name;								/// Nombre del topic
+	void* data;										/// Mensaje
+	uint32_t datasize;								/// Tamano del mensaje
+};
+
+
+/** @type MQ::BatchCallback
+ *  @brief Tipo definido para las callbacks de finalizacion de una publicacion por lotes. Recibe las
+ *         entradas, el resultado de cada una y el numero de entradas.
+ */
+typedef Callback<void(const MQ::PublishEntry*, const int32_t*, uint16_t)> BatchCallback;
+
+
+/** @struct PublishHandle
+ *  @brief Topic pre-resuelto para publicaciones repetidas. Contiene el identificador del topic y las
+ *         listas de suscriptores y bridges que encajan con el, de forma que al publicar no es necesario
+ *         volver a procesar el nombre. Cada lista guarda la generacion con la que se resolvio, y se
+ *         actualiza automaticamente al publicar si el conjunto de suscripciones o de bridges ha cambiado.
+ */
+struct PublishHandle{
+	char* name;										/// Copia del nombre del topic
+	MQ::topic_t id;									/// Identificador del topic
+	uint32_t generation;							/// Generacion de suscripciones resuelta (0: no resuelto)
+	uint32_t* topics;								/// Topics del broker que encajan con el topic
+	uint16_t topic_count;							/// Numero de topics
+	uint16_t topic_size;							/// Capacidad del array de topics
+	uint32_t bridge_generation;						/// Generacion de bridges resuelta (0: no resuelto)
+	MQ::BridgeCallback** bridges;					/// Bridges que encajan con el topic
+	uint16_t bridge_count;							/// Numero de bridges
+	uint16_t bridge_size;							/// Capacidad del array de bridges
+
+	PublishHandle() : name(0), generation(0), topics(0), topic_count(0), topic_size(0),
+					  bridge_generation(0), bridges(0), bridge_count(0), bridge_size(0) {}
+};
+
+
+/** @fn MQ::appendItem
+ *  @brief Inserta un elemento a un array dinamico, ampliando su capacidad si es necesario
+ *  @param array Array de elementos
+ *  @param count Numero de elementos del array
+ *  @param size Capacidad del array
+ *  @param item Elemento a insertar
+ *  @return True si se ha insertado, False si no hay memoria
+ */
+template<typename T>
+static inline bool appendItem(T* &array, uint16_t &count, uint16_t &size, T item){
+	if(count >= size){
+		uint16_t new_size = (size)? (size << 1) : 4;
+		T* new_array = (T*)Heap::memAlloc(new_size * sizeof(T));
+		if(!new_array){
+			return false;
+		}
+		if(array){
+			memcpy(new_array, array, count * sizeof(T));
+			Heap::memFree(array);
+		}
+		array = new_array;
+		size = new_size;
+	}
+	array[count++] = item;
+	return true;
+}
+
 
-/** @struct Topic
- *  @brief Estructura asociada los topics, formada por un nombre y una lista de suscriptores
- *  	   @14Feb2018.001: 'name' cambia de const char* a char*
+/** @struct TopicSpan
+ *  @brief Nivel de un topic: posicion y longitud dentro de su nombre
  */
-struct Topic{
-    MQ::topic_t id;              					/// Identificador del topic
-    char* name;                               		/// Nombre del name asociado a este nivel
-	List<MQ::SubscribeCallback > *subscriber_list; 	/// Lista de suscriptores
+struct TopicSpan{
+	uint16_t from;									/// Posicion del primer caracter
+	uint16_t len;									/// Longitud
 };
 
 
+/** @fn MQ::splitTopic
+ *  @brief Divide el nombre de un topic en sus niveles en una unica pasada y sin reservar memoria. Los separadores
+ *         '/' iniciales, finales o consecutivos no generan niveles vacios.
+ *  @param name Nombre del topic
+ *  @param spans Recibe los niveles
+ *  @param max Capacidad de 'spans'
+ *  @return Numero de niveles, o max+1 si el topic tiene mas niveles de los que caben
+ */
+static inline uint8_t splitTopic(const char* name, TopicSpan* spans, uint8_t max){
+	uint8_t count = 0;
+	const char* p = name;
+	while(*p){
+		if(*p == '/'){
+			p++;
+			continue;
+		}
+		const char* start = p;
+		while(*p && *p != '/'){
+			p++;
+		}
+		if(count >= max){
+			return max + 1;
+		}
+		spans[count].from = (uint16_t)(start - name);
+		spans[count].len = (uint16_t)(p - start);
+		count++;
+	}
+	return count;
+}
+
+
+/** @fn MQ::matchTopic
+ *  @brief Compara el nombre de un topic con un topic que puede contener wildcards ('+' un nivel, '#' el resto de
+ *         niveles, incluido ninguno), nivel a nivel y sin reservar memoria
+ *  @param pattern Topic con wildcards
+ *  @param name Nombre del topic
+ *  @return True si encajan
+ */
+static inline bool matchTopic(const char* pattern, const char* name){
+	TopicSpan ps[MAX_TOKEN_LEVEL], ns[MAX_TOKEN_LEVEL];
+	uint8_t pcount = splitTopic(pattern, ps, MAX_TOKEN_LEVEL);
+	uint8_t ncount = splitTopic(name, ns, MAX_TOKEN_LEVEL);
+	if(pcount > MAX_TOKEN_LEVEL || ncount > MAX_TOKEN_LEVEL){
+		return false;
+	}
+	for(uint8_t i = 0; i < pcount; i++){
+		const char* level = &pattern[ps[i].from];
+		if(ps[i].len == 1 && level[0] == '#'){
+			return true;
+		}
+		if(i >= ncount){
+			return false;
+		}
+		if(ps[i].len == 1 && level[0] == '+'){
+			continue;
+		}
+		if(ps[i].len != ns[i].len || strncmp(level, &name[ns[i].from], ps[i].len) != 0){
+			return false;
+		}
+	}
+	return (pcount == ncount);
+}
+
+
 	
 //------------------------------------------------------------------------------------
 //------------------------------------------------------------------------------------
@@ -185,6 +482,7 @@ public:
     static int32_t start(uint8_t max_len_of_name, bool defdbg = false){
     	int32_t rc = SUCCESS;
     	_pub_count = 0;
+    	_conflate_clock.start();
     	_mutex.lock();
         // ajusto par�metros por defecto 
     	setLoggingLevel((defdbg)? ESP_LOG_DEBUG : ESP_LOG_INFO);
@@ -193,14 +491,22 @@ public:
         DEBUG_TRACE_I(_defdbg,"[MQLib].........", "Iniciando Broker...");
 		_tokenlist_internal = true;
 		_token_provider_count = WildcardCOUNT;
-		_token_provider = (const char**)Heap::memAlloc(DefaultMaxNumTokenEntries * sizeof(const char*));
-		if(!_token_provider){
+		_token_provider_size = (DefaultMaxNumTokenEntries < DefaultInitialTableSize)? DefaultMaxNumTokenEntries : DefaultInitialTableSize;
+		_token_provider = (const char**)Heap::memAlloc(_token_provider_size * sizeof(const char*));
+		_token_refs = (uint32_t*)Heap::memAlloc(_token_provider_size * sizeof(uint32_t));
+		if(!_token_provider || !_token_refs){
 			rc = NULL_POINTER; goto __start_exit;
 		}
+
+		// crea el diccionario hash de tokens
+		_token_dict = new HashMap<MQ::token_t>(_token_provider_size);
+		if(!_token_dict){
+			rc = OUT_OF_MEMORY; goto __start_exit;
+		}
         
         // creo lista de solicitudes pendientes
-        _pending_list = new List<PendingRequest_t>();
-        MBED_ASSERT(_pending_list);
+        _pending_list = new MpscQueue<PendingRequest_t>(DefaultMaxPendingRequests);
+        MBED_ASSERT(_pending_list && _pending_list->ready());
 
         // si hay un n�mero de tokens mayor que el tama�o que lo puede alojar, devuelve error:
         // ej: token_count = 500 con token_t = uint8_t, que s�lo puede codificar hasta 256 valores.
@@ -208,14 +514,19 @@ public:
             rc = OUT_OF_BOUNDS; goto __start_exit;
         }
         
-        // si no hay lista inicial, se crea...
-        if(!_topic_list){
+        // si no hay tabla inicial, se crea...
+        if(!_topic_table){
+
+            _topic_table = new TopicTable<MQ::topic_t, MQ::Subscriber>(DefaultMaxNumTopics);
+			if(!_topic_table){
+				rc = OUT_OF_MEMORY; goto __start_exit;
+			}
 
-            _topic_list = new List<MQ::Topic>();
-			if(!_topic_list){
+			// crea el indice en arbol de suscripciones
+			_topic_tree = new TopicTree<TopicRow, MQ::key_t>(MQ::MAX_TOKEN_LEVEL);
+			if(!_topic_tree){
 				rc = OUT_OF_MEMORY; goto __start_exit;
 			}
-			_topic_list->setLimit(DefaultMaxNumTopics);
 			rc = SUCCESS; goto __start_exit;
         }
 		rc = EXISTS; goto __start_exit;
@@ -235,7 +546,7 @@ __start_exit:
 	 *	@return True:listo, False:pendiente
      */
     static bool ready() {
-		return ((_topic_list)? true : false);
+		return ((_topic_table)? true : false);
 	}
 
     
@@ -244,11 +555,16 @@ __start_exit:
      *  @param name Nombre del topic
      *  @param subscriber Manejador de las actualizaciones del topic
      *  @param use_lock Flag para utilizar el bloqueo por mutex
-     *  @return Resultado
+     *  @param flags Opciones de suscripcion (MQ::SubscribeFlags)
+     *  @param interval Intervalo minimo entre entregas (ms) de cada topic, con MQ::SubscribeConflate
+     *  @return Resultado. DEFERRED si el broker esta ocupado y la operacion se aplaza
      */
-    static int32_t subscribeReq(const char* name, MQ::SubscribeCallback *subscriber, bool use_lock = true){
+    static int32_t subscribeReq(const char* name, MQ::SubscribeCallback *subscriber, bool use_lock = true, uint8_t flags = MQ::SubscribeReadOnly, uint32_t interval = 0){
         int32_t err;
-        if(!_topic_list){
+        uint32_t row = 0;
+        MQ::topic_t id;
+        MQ::Subscriber sbc = {subscriber, flags, interval};
+        if(!_topic_table){
             return DEINIT;
         }
         // si el nombre excede el tama�o m�ximo, no lo permite
@@ -260,22 +576,18 @@ __start_exit:
 
         // Inicia la b�squeda del topic para ver si ya existe
         if(use_lock){
-        	osStatus oss;
-			if((oss = _mutex.lock(DefaultMutexTimeout)) != osOK){
-				DEBUG_TRACE_E(true,"[MQLib].........", "ERR_SUBSCRIBE [%d] en topic %s", oss, name);
-				return LOCK_TIMEOUT;
-				//return addPendingRequest(ReqSubscribe, name, NULL, 0, NULL, subscriber);
+			if(!lockBroker(DefaultDeferTimeout)){
+				DEBUG_TRACE_W(_defdbg,"[MQLib].........", "Broker ocupado, se aplaza la suscripcion en topic %s", name);
+				return addPendingRequest(ReqSubscribe, name, NULL, 0, NULL, subscriber, flags, interval);
 			}
         }
 
-        MQ::Topic * topic = findTopicByName(name);		
 		// si lo encuentra...
-        if(topic){
+        if(findTopicByName(name, &row)){
 			// Chequea si el suscriptor ya existe...
-			MQ::SubscribeCallback *sbc = topic->subscriber_list->searchItem(subscriber);
-			// si no existe, lo a�ade
-			if(!sbc){
-				err = topic->subscriber_list->addItem(subscriber);
+			// si no existe, lo anade al final de los suscriptores del topic
+			if(findSubscriber(row, subscriber) < 0){
+				err = addSubscriber(row, &sbc);
 				goto _subscribe_exit;
 			}
 			// si existe, devuelve el error
@@ -291,40 +603,32 @@ __start_exit:
                 err = OUT_OF_MEMORY; goto _subscribe_exit;
             }
         }
-        // lo crea reservarvando espacio para el topic
-        topic = (MQ::Topic*)Heap::memAlloc(sizeof(MQ::Topic));
-        if(!topic){
-            err = OUT_OF_MEMORY; goto _subscribe_exit;
-        }
-        
-        // se fijan los par�metros del token (delimitadores, id, nombre)
 
-        //@14Feb2018.002: se reserva espacio para el nombre del topic
-        topic->name = (char*)Heap::memAlloc(strlen(name)+1);
-        if(!topic->name){
-        	err = OUT_OF_MEMORY; goto _subscribe_exit;
+        // se inserta en la tabla de topics y en el indice de suscripciones, con su primer suscriptor
+        if(!createTopicId(&id, name)){
+            err = OUT_OF_BOUNDS; goto _subscribe_exit;
         }
-        strcpy(topic->name, name);
-        createTopicId(&topic->id, name);
-
-        // se crea la lista de suscriptores
-        topic->subscriber_list = new List<MQ::SubscribeCallback>();
-        if(!topic->subscriber_list){
-            err = OUT_OF_MEMORY; goto _subscribe_exit;
+        if((err = addTopic(name, &id, &row)) != SUCCESS){
+            goto _subscribe_exit;
         }
-        
-        // y se a�ade el suscriptor
-        if(topic->subscriber_list->addItem(subscriber) != SUCCESS){
-            err = OUT_OF_MEMORY; goto _subscribe_exit;
+        if((err = addSubscriber(row, &sbc)) != SUCCESS){
+            removeTopic(row);
         }
-        
-        // se inserta en el �rbol de topics
-        err = _topic_list->addItem(topic);
 
 _subscribe_exit:
+		// invalida los handles de publicacion resueltos y la instantanea de suscripciones
+		if(err == SUCCESS){
+			_generation++;
+			if(_lock_free){
+				updateSnapshot();
+			}
+			// entrega al nuevo suscriptor los mensajes retenidos de los topics que encajan. Se utilizan copias
+			// del identificador y del suscriptor, ya que la entrega puede modificar la tabla.
+			id = *_topic_table->getId(row);
+			replayRetained(&id, &sbc);
+		}
 		if(use_lock){
-			_mutex.unlock();
-//			processPendingRequests();
+			unlockBroker();
 		}
         return err;
     }
@@ -335,11 +639,11 @@ _subscribe_exit:
      *  @param name Nombre del topic
      *  @param subscriber Suscriptor a eliminar de la lista de suscripci�n
      *  @param use_lock Flag para utilizar el bloqueo por mutex
-     *  @return Resultado
+     *  @return Resultado. DEFERRED si el broker esta ocupado y la operacion se aplaza
      */
     static int32_t unsubscribeReq (const char* name, MQ::SubscribeCallback *subscriber, bool use_lock = true){
 		int32_t err;
-		if(!_topic_list){
+		if(!_topic_table){
             return DEINIT;
         }
         // si el nombre excede el tama�o m�ximo, no lo permite
@@ -350,34 +654,34 @@ _subscribe_exit:
 
         // Inicia la b�squeda del topic para ver si ya existe
         if(use_lock){
-        	osStatus oss;
-			if((oss = _mutex.lock(DefaultMutexTimeout)) != osOK){
-				DEBUG_TRACE_E(true,"[MQLib].........", "ERR_UNSUBSCRIBE [%d] en topic %s", oss, name);
-				return LOCK_TIMEOUT;
-				//return addPendingRequest(ReqUnsubscribe, name, NULL, 0, NULL, subscriber);
+			if(!lockBroker(DefaultDeferTimeout)){
+				DEBUG_TRACE_W(_defdbg,"[MQLib].........", "Broker ocupado, se aplaza la cancelacion de suscripcion en topic %s", name);
+				return addPendingRequest(ReqUnsubscribe, name, NULL, 0, NULL, subscriber, 0);
 			}
         }
 
         // precargo posible error
         err = NOT_FOUND;
 
-        MQ::Topic * topic = findTopicByName(name);
-        if(topic){
-        	MQ::SubscribeCallback *sbc = topic->subscriber_list->searchItem(subscriber);
-			if(sbc){
-				err = topic->subscriber_list->removeItem(sbc);
-				//@14Feb2018.003: elimina un topic de la lista si se queda sin suscriptores.
-				if(topic->subscriber_list->getItemCount() == 0){
-					Heap::memFree(topic->name);
-					_topic_list->removeItem(topic);
-					Heap::memFree(topic);
-				}
+        uint32_t row;
+        int32_t pos;
+        if(findTopicByName(name, &row) && (pos = findSubscriber(row, subscriber)) >= 0){
+			// descarta los mensajes pendientes de entrega de los topics que encajan
+			if(_topic_table->getSubscribers(row)[pos].flags & MQ::SubscribeConflate){
+				MQ::topic_t id = *_topic_table->getId(row);
+				removeConflated(subscriber, &id);
+			}
+			//@14Feb2018.003: elimina un topic de la lista si se queda sin suscriptores.
+			removeSubscriber(row, pos);
+			_generation++;
+			if(_lock_free){
+				updateSnapshot();
 			}
+			err = SUCCESS;
         }
 
 		if(use_lock){
-			_mutex.unlock();
-//			processPendingRequests();
+			unlockBroker();
 		}
 		return err;
     }
@@ -390,11 +694,17 @@ _subscribe_exit:
      *  @param datasize Tama�o del mensaje
      *  @param publisher Callback de notificaci�n de la publicaci�n
      *  @param use_lock Flag para utilizar el bloqueo por mutex
-	 *	@return Resultado
+     *  @param flags Opciones de publicacion (MQ::PublishFlags). Con MQ::PublishRetain el mensaje se guarda
+     *         en el almacen de mensajes retenidos (ver setRetainedStore) antes de repartirlo, y si no puede
+     *         guardarse se reparte igualmente y se devuelve el error del almacen. Un mensaje retenido vacio
+     *         elimina el mensaje retenido del topic.
+     *  @param bridge_id Recibe el identificador del topic obtenido durante la publicacion (opcional), de forma que
+     *         el cliente pueda procesar sus bridges sin volver a tomar el broker. Queda sin modificar si la
+     *         publicacion no llega a obtenerlo (ej: si se aplaza).
+	 *	@return Resultado. DEFERRED si el broker esta ocupado y la publicacion se aplaza
      */
-    static int32_t publishReq (const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher, bool use_lock = true){
-        static int errors=0;
-    	if(!_topic_list){
+    static int32_t publishReq (const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher, bool use_lock = true, uint8_t flags = MQ::PublishDefault, MQ::topic_t* bridge_id = NULL){
+    	if(!_topic_table){
             return DEINIT;
         }
         // si el nombre excede el tama�o m�ximo, no lo permite
@@ -402,31 +712,79 @@ _subscribe_exit:
             return OUT_OF_BOUNDS;
         }
 
+        // en modo sin bloqueo, la publicacion se resuelve sobre la instantanea vigente, salvo si debe
+        // retenerse, ya que el almacen de mensajes retenidos requiere el mutex, o si hay operaciones
+        // aplazadas, que deben aplicarse antes
+        if((flags & MQ::PublishRetain) == 0 && _pending_list->isEmpty()){
+            uint32_t epoch;
+            Snapshot* snap = snapshotEnter(&epoch);
+            if(snap){
+                MQ::topic_t topic_id;
+                if(!createTopicId(&topic_id, name, snap->dict)){
+                    snapshotExit(epoch);
+                    return OUT_OF_BOUNDS;
+                }
+                if(bridge_id){
+                    *bridge_id = topic_id;
+                }
+                int32_t err = SUCCESS;
+                if(_dispatchers){
+                    err = publishAsync<SnapshotTopic>(snap->tree, name, &topic_id, data, datasize, publisher);
+                }
+                else{
+                    publishSnapshot(snap, name, &topic_id, data, datasize, publisher);
+                }
+                snapshotExit(epoch);
+                return err;
+            }
+            snapshotExit(epoch);
+        }
+
         // Inicia la b�squeda del topic para ver si ya existe
         if(use_lock){
-        	osStatus oss;
-			if((oss = _mutex.lock(DefaultMutexTimeout)) != osOK){
-                if(++errors > 3){
-				#if ESP_PLATFORM == 1
-				esp_restart();
-				#elif __MBED__ == 1
-				NVIC_SystemReset();
-				#endif
-                }
-				DEBUG_TRACE_E(true,"[MQLib].........", "ERR_PUBLISH id=[%d] err=[%d] en topic %s", _pub_count++, oss, name);
-				return LOCK_TIMEOUT;
-				//return addPendingRequest(ReqPublish, name, data, datasize, publisher, NULL);
+			if(!lockBroker(DefaultDeferTimeout)){
+				DEBUG_TRACE_W(_defdbg,"[MQLib].........", "Broker ocupado, se aplaza la publicacion en topic %s", name);
+				return addPendingRequest(ReqPublish, name, data, datasize, publisher, NULL, flags);
 			}
         }
 
+        // los tokens que falten aun no estan registrados, pero los de los bridges si lo estan (ver
+        // pinTopicIdReq), por lo que el identificador encaja con ellos igual que tras registrarlos
+        if(bridge_id && !createTopicId(bridge_id, name)){
+            bridge_id->tk[0] = WildcardNotUsed;
+        }
+
+        // guarda el mensaje retenido antes de repartirlo
+        int32_t retain_err = SUCCESS;
+        if(flags & MQ::PublishRetain){
+            retain_err = retainMessage(name, data, datasize);
+        }
+
+        // en el reparto en anchura, una publicacion realizada durante un reparto se encola
+        if(_nested_queued && _dispatch_depth > 0){
+            int32_t err = queueNested(name, data, datasize, publisher);
+            if(use_lock){
+                unlockBroker();
+            }
+            return (err != SUCCESS)? err : retain_err;
+        }
+
         DEBUG_TRACE_D(true, "[MQLib].........", "Publicacion [%d] en topic  '%s'", _pub_count++, name);
 
+        // si no puede encajar con ninguna suscripcion, se descarta sin registrar tokens ni reservar memoria
+        if(_prefilter_enabled && !prefilterMatch(name)){
+            publisher->call(name, NOT_FOUND);
+            if(use_lock){
+                unlockBroker();
+            }
+            return retain_err;
+        }
+
         // si la lista de tokens es automantenida, crea los ids de los tokens no existentes
         if(_tokenlist_internal){
             if(!generateTokens(name)){
                 if(use_lock){
-        			_mutex.unlock();
-//        			processPendingRequests();
+        			unlockBroker();
         		}
         		return OUT_OF_MEMORY;
             }
@@ -434,385 +792,2992 @@ _subscribe_exit:
 
 		// obtiene el identificador del topic a publicar
         MQ::topic_t topic_id;
-        createTopicId(&topic_id, name);
-        
-        // copia el mensaje a enviar por si sufre modificaciones, no alterar el origen
-        char* mem_data = (char*)Heap::memAlloc(datasize);
-        MBED_ASSERT(mem_data);
+        if(!createTopicId(&topic_id, name)){
+            if(use_lock){
+                unlockBroker();
+            }
+            return OUT_OF_BOUNDS;
+        }
+
+        // en modo asincrono, solo se encola el mensaje para los suscriptores que encajan
+        if(_dispatchers){
+            int32_t err = publishAsync<TopicRow>(_topic_tree, name, &topic_id, data, datasize, publisher);
+            if(use_lock){
+                unlockBroker();
+            }
+            return (err != SUCCESS)? err : retain_err;
+        }
+
+        // copia del mensaje a enviar, se reserva s�lo si alg�n suscriptor la necesita
+        char* mem_data = NULL;
         
-        DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Buscando topic '%s' en la lista", name);
-        MQ::Topic* topic = _topic_list->getFirstItem();
-        bool notify_subscriber = false;
-        while(topic){
-        	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Comparando topic '%s' con '%s'", name, topic->name);
-            // comprueba si el id coincide o si no se usa (=0)
-            if(matchIds(&topic->id, &topic_id)){
-            	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Topic '%s' encontrado. Buscando suscriptores...", name);
-                // si coinciden, se invoca a todos los suscriptores                
-                MQ::SubscribeCallback *sbc = topic->subscriber_list->getFirstItem();
-                while(sbc){
-                    // restaura el mensaje por si hubiera sufrido modificaciones en alg�n suscriptor
-                    memcpy(mem_data, data, datasize);
-                    DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Notificando topic update de '%s' al suscriptor %x", name, (uint32_t)sbc);
-                    notify_subscriber = true;
-                    sbc->call(name, mem_data, datasize);
-                    sbc = topic->subscriber_list->getNextItem();
-                }                    
-            }
-            topic = _topic_list->getNextItem();
-        }
-        publisher->call(name, (notify_subscriber)? SUCCESS : NOT_FOUND);
-        Heap::memFree(mem_data);
+        DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Buscando topic '%s' en el indice", name);
+        uint32_t level;
+        enterDispatch(&level);
+        // por cada topic que encaja con el publicado, se invoca a todos sus suscriptores
+        publisher->call(name, notifyTopics<TopicRow>(_topic_tree, name, &topic_id, data, datasize, &mem_data));
+        if(mem_data){
+        	Heap::memFree(mem_data);
+        }
+        exitDispatch(level);
         DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Fin de la publicaci�n del topic '%s'", name);
 
         if(use_lock){
-			_mutex.unlock();
-//			processPendingRequests();
+			unlockBroker();
 		}
-        errors = 0;
-		return SUCCESS;
+		return retain_err;
     }
 
     
-    /** @fn getTopicIdReq 
-     *  @brief Obtiene el identificador del topic dado su nombre
-     *  @param id Recibe el Identificador del topic or (0) si no existe
-     *  @param name Nombre del topic
-     */
-    static void getTopicIdReq(MQ::topic_t* id, const char* name){        
-        createTopicId(id, name);
-    }    
-
-    
-    /** @fn getTopicNameReq 
-     *  @brief Obtiene el nombre de un topic dado su id y su scope
-     *  @param name Recibe el nombre asociado al id
-     *  @param len Tama�o m�ximo aceptado para el nombre
-     *  @param id Identificador del topic
+    /** @fn resolveReq
+     *  @brief Resuelve el topic de un handle de publicacion: obtiene su identificador y la lista de
+     *         suscriptores que encajan con el, registrando los tokens no existentes.
+     *  @param handle Handle de publicacion con el nombre del topic ya asignado
+     *  @param use_lock Flag para utilizar el bloqueo por mutex
+     *  @return Resultado
      */
-    static void getTopicNameReq(char* name, uint8_t len, MQ::topic_t* id){
-        strcpy(name, "");
-
-        // recorre campo a campo verificando los tokens
-        for(int i=0;i<MQ::MAX_TOKEN_LEVEL;i++){
-            uint32_t idex;
-			// obtiene el token_id
-			idex = id->tk[i];
-			// si ha llegado al final del topic, termina
-			if(idex == WildcardNotUsed){
-				// una vez finalizado, debe borrar el �ltimo caracter '/' insertado
-				name[strlen(name)-1] = 0;
-				return;
-			}
-			// si son wildcards, los escribe
-			else if(idex == WildcardAny){
-				strcat(name, "+/");
-			}
-			else if(idex == WildcardAll){
-				strcat(name, "#/");
-			}
-			// en otro caso, escribe el token correspondiente
-			else{
-				strcat(name, _token_provider[idex]);
-				strcat(name, "/");
+    static int32_t resolveReq(MQ::PublishHandle* handle, bool use_lock = true){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(!handle || !handle->name){
+            return NULL_POINTER;
+        }
+        if(use_lock){
+			if(!lockBroker(DefaultMutexTimeout)){
+				DEBUG_TRACE_E(true,"[MQLib].........", "ERR_RESOLVE. Timeout en topic %s", handle->name);
+				return LOCK_TIMEOUT;
 			}
         }
-        // una vez finalizado, debe borrar el �ltimo caracter '/' insertado
-        name[strlen(name)-1] = 0;
-    }        
-
-    
-    /** @fn getMaxTopicLenReq 
-     *  @brief Obtiene el n�mero m�ximo de caracteres que puede tener un topic
-     *  @return N�mero de caracteres, incluyendo el '\0' final.
-     */
-    static uint8_t getMaxTopicLenReq(){
-        return _max_name_len;
+        int32_t err = refreshHandle(handle);
+        if(use_lock){
+			unlockBroker();
+		}
+        return err;
     }
 
 
-    /** @fn getInternalTokenListReq
-     *  @brief Obtiene la lista de tokens interna
-     *  @param tklist Lista de tokens
-     *  @param tkcount N�mero de tokens en la lista
+    /** @fn isCurrentHandle
+     *  @brief Chequea si los suscriptores de un handle corresponden al conjunto de suscripciones actual
+     *  @param handle Handle de publicacion
+     *  @return True si no es necesario actualizarlo
      */
-    static void getInternalTokenListReq(const char** &tklist, uint32_t &tkcount){
-        tklist = _token_provider;
-        tkcount = _token_provider_count - WildcardCOUNT;
+    static bool isCurrentHandle(const MQ::PublishHandle* handle){
+        return (handle->generation == _generation);
     }
 
 
-    /** @fn existsTopicReq
-     *  @brief Chequea si un topic existe
-     *  @param name Nombre del topic a chequear
+    /** @fn createTopicIdReq
+     *  @brief Obtiene el identificador de un topic con el diccionario de tokens del broker, sin reservar
+     *         memoria. En modo sin bloqueo se utiliza el diccionario de la instantanea vigente.
+     *  @param name Nombre del topic
+     *  @param id Recibe el identificador
+     *  @param generate Crea los tokens no existentes si la lista de tokens es automantenida
+     *  @return Resultado
      */
-    static bool existsTopicReq(const char* name){
-    	MQ::Topic* topic = _topic_list->getFirstItem();
-    	while(topic){
-    		if(strcmp(name, topic->name) == 0){
-    			return true;
-    		}
-    		topic = _topic_list->getNextItem();
-    	}
-    	return false;
+    static int32_t createTopicIdReq(const char* name, MQ::topic_t* id, bool generate = false){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(!name || !id){
+            return NULL_POINTER;
+        }
+        if(strlen(name) > _max_name_len){
+            return OUT_OF_BOUNDS;
+        }
+        if(!generate){
+            uint32_t epoch;
+            Snapshot* snap = snapshotEnter(&epoch);
+            if(snap){
+                int32_t err = (createTopicId(id, name, snap->dict))? SUCCESS : OUT_OF_BOUNDS;
+                snapshotExit(epoch);
+                return err;
+            }
+            snapshotExit(epoch);
+        }
+        if(!lockBroker(DefaultMutexTimeout)){
+            return LOCK_TIMEOUT;
+        }
+        int32_t err = SUCCESS;
+        if(generate && _tokenlist_internal && !generateTokens(name)){
+            err = OUT_OF_MEMORY;
+        }
+        else if(!createTopicId(id, name)){
+            err = OUT_OF_BOUNDS;
+        }
+        unlockBroker();
+        return err;
     }
 
-    /** M�ximo tiempo de espera en el mutex antes de crear solicitud pendiente */
-    static const uint32_t DefaultMutexTimeout = 3000;
-
-
-private:
-	
-    /** Contador de publicaciones */
-    static uint32_t _pub_count;
 
-    /** Identificador de wildcards */
-    enum Wildcards{
-        WildcardNotUsed = 0,
-        WildcardAny,
-        WildcardAll,
-		WildcardInvalid,
-        WildcardCOUNT,
-    };    
-    
-    /** Lista de operaciones pendientes
-     *
+    /** @fn pinTopicIdReq
+     *  @brief Obtiene el identificador de un topic registrando sus tokens y una referencia a ellos, de forma
+     *         que la recoleccion no los libere mientras no se llame a unpinTopicIdReq. La recoleccion si puede
+     *         reubicarlos, por lo que el identificador debe obtenerse de nuevo (createTopicIdReq) cuando cambia
+     *         la generacion de los tokens (ver getTokenGeneration).
+     *  @param name Nombre del topic
+     *  @param id Recibe el identificador
+     *  @return Resultado
      */
-    enum PendingRequestType {
-    	ReqPublish=0, 	//!< ReqPublish Solicitud de publicaci�n
-		ReqSubscribe,   //!< ReqSubscribe Solicitud de suscripci�n
-		ReqUnsubscribe, //!< ReqUnsubscribe Solicitud de unsuscripci�n
-    };
+    static int32_t pinTopicIdReq(const char* name, MQ::topic_t* id){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(!name || !id){
+            return NULL_POINTER;
+        }
+        if(strlen(name) > _max_name_len){
+            return OUT_OF_BOUNDS;
+        }
+        if(!lockBroker(DefaultMutexTimeout)){
+            return LOCK_TIMEOUT;
+        }
+        int32_t err = SUCCESS;
+        if(_tokenlist_internal && !generateTokens(name)){
+            err = OUT_OF_MEMORY;
+        }
+        else if(!createTopicId(id, name)){
+            err = OUT_OF_BOUNDS;
+        }
+        else{
+            refTokens(id, 1);
+        }
+        unlockBroker();
+        return err;
+    }
 
-    /** M�ximo n�mero de tokens permitidos en topic provider auto-gestionado */
-    static const uint16_t DefaultMaxNumTokenEntries = (256 - WildcardCOUNT);    
 
-    /** M�ximo n�mero de topics permitidos */
-    static const uint16_t DefaultMaxNumTopics = 256;
+    /** @fn unpinTopicIdReq
+     *  @brief Libera la referencia a los tokens registrada por pinTopicIdReq
+     *  @param id Identificador del topic, obtenido en la generacion de tokens vigente
+     */
+    static void unpinTopicIdReq(const MQ::topic_t* id){
+        if(!_topic_table || !id){
+            return;
+        }
+        lockBroker();
+        refTokens(id, -1);
+        unlockBroker();
+    }
 
-    /** Lista de topics registrados */
-    static List<MQ::Topic> * _topic_list;
+
+    /** @fn publishReq
+     *  @brief Recibe una solicitud de publicacion a traves de un handle pre-resuelto. Si el conjunto
+     *         de suscripciones ha cambiado desde su resolucion, el handle se actualiza antes de publicar.
+     *  @param handle Handle de publicacion
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion de la publicacion
+     *  @param use_lock Flag para utilizar el bloqueo por mutex
+	 *	@return Resultado
+     */
+    static int32_t publishReq (MQ::PublishHandle* handle, void *data, uint32_t datasize, MQ::PublishCallback *publisher, bool use_lock = true){
+    	if(!_topic_table){
+            return DEINIT;
+        }
+        if(!handle || !handle->name){
+            return NULL_POINTER;
+        }
+
+        // en modo sin bloqueo, se utiliza el identificador del handle sobre la instantanea vigente, salvo si
+        // la recoleccion de tokens ha cambiado los identificadores desde que se resolvio o si hay operaciones
+        // aplazadas, que deben aplicarse antes
+        if(handle->generation != 0 && _pending_list->isEmpty()){
+            uint32_t epoch;
+            Snapshot* snap = snapshotEnter(&epoch);
+            if(snap && (int32_t)(handle->generation - snap->token_generation) >= 0){
+                int32_t err = SUCCESS;
+                if(_dispatchers){
+                    err = publishAsync<SnapshotTopic>(snap->tree, handle->name, &handle->id, data, datasize, publisher);
+                }
+                else{
+                    publishSnapshot(snap, handle->name, &handle->id, data, datasize, publisher);
+                }
+                snapshotExit(epoch);
+                return err;
+            }
+            snapshotExit(epoch);
+        }
+
+        if(use_lock){
+			if(!lockBroker(DefaultDeferTimeout)){
+				// el handle puede no seguir siendo valido al aplicar la solicitud, por lo que se aplaza por nombre
+				DEBUG_TRACE_W(_defdbg,"[MQLib].........", "Broker ocupado, se aplaza la publicacion en topic %s", handle->name);
+				return addPendingRequest(ReqPublish, handle->name, data, datasize, publisher, NULL, 0);
+			}
+        }
+
+        // en el reparto en anchura, una publicacion realizada durante un reparto se encola
+        if(_nested_queued && _dispatch_depth > 0){
+            int32_t err = queueNested(handle->name, data, datasize, publisher);
+            if(use_lock){
+                unlockBroker();
+            }
+            return err;
+        }
+
+        DEBUG_TRACE_D(_defdbg, "[MQLib].........", "Publicacion [%d] por handle en topic  '%s'", _pub_count++, handle->name);
+
+        // si ha cambiado el conjunto de suscripciones, actualiza el handle
+        if(handle->generation != _generation){
+        	int32_t err = refreshHandle(handle);
+        	if(err != SUCCESS){
+        		if(use_lock){
+        			unlockBroker();
+        		}
+        		return err;
+        	}
+        }
+
+        // en modo asincrono, encola el mensaje para los suscriptores del handle
+        if(_dispatchers){
+            uint32_t count = 0;
+            for(uint16_t i = 0; i < handle->topic_count; i++){
+                count += getSubscriberCount(rowRef(handle->topics[i]));
+            }
+            DispatchJob* job = (count)? createJob(handle->name, data, datasize, count) : NULL;
+            if(job){
+                for(uint16_t i = 0; i < handle->topic_count; i++){
+                    addJobSubscribers(job, rowRef(handle->topics[i]));
+                }
+            }
+            int32_t err = dispatchJob(job, (job)? job->subscriber_count : count, handle->name, publisher);
+            if(use_lock){
+                unlockBroker();
+            }
+            return err;
+        }
+
+        // copia del mensaje a enviar, se reserva solo si algun suscriptor la necesita
+        char* mem_data = NULL;
+
+        // el array del handle se relee en cada iteracion, por si un suscriptor lo actualiza. Los suscriptores
+        // de cada topic se recorren como en la publicacion por nombre, incluidos los insertados durante el reparto.
+        uint32_t level;
+        enterDispatch(&level);
+        bool notify_subscriber = false;
+        for(uint16_t i = 0; i < handle->topic_count; i++){
+            notify_subscriber |= notifyTopic(rowRef(handle->topics[i]), handle->name, data, datasize, &mem_data);
+        }
+        publisher->call(handle->name, (notify_subscriber)? SUCCESS : NOT_FOUND);
+        if(mem_data){
+        	Heap::memFree(mem_data);
+        }
+        exitDispatch(level);
+
+        if(use_lock){
+			unlockBroker();
+		}
+		return SUCCESS;
+    }
+
+
+    /** @fn publishBatchReq
+     *  @brief Recibe una solicitud de publicacion por lotes. Toma el broker una unica vez, resuelve los
+     *         identificadores de todos los topics en una primera pasada y entrega despues cada entrada,
+     *         reutilizando un unico buffer de copia dimensionado para el mayor de los mensajes.
+     *         El resultado de cada entrada es SUCCESS si se ha entregado a algun suscriptor (o se ha encolado,
+     *         en el despacho asincrono o si el broker esta ocupado), NOT_FOUND si no hay suscriptores, o el
+     *         error correspondiente.
+     *  @param entries Entradas a publicar
+     *  @param count Numero de entradas
+     *  @param results Recibe el resultado de cada entrada
+     *  @param use_lock Flag para utilizar el bloqueo por mutex
+	 *	@return Resultado
+     */
+    static int32_t publishBatchReq(const MQ::PublishEntry* entries, uint16_t count, int32_t* results, bool use_lock = true){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(!entries || !results){
+            return NULL_POINTER;
+        }
+
+        // en modo sin bloqueo, todas las entradas se resuelven sobre la misma instantanea
+        uint32_t epoch;
+        Snapshot* snap = snapshotEnter(&epoch);
+        if(snap){
+            char* mem_data = NULL;
+            uint32_t max_size = (_dispatchers)? 0 : getBatchMaxSize(entries, count);
+            if(max_size && (mem_data = (char*)Heap::memAlloc(max_size)) == NULL){
+                snapshotExit(epoch);
+                return OUT_OF_MEMORY;
+            }
+            for(uint16_t i = 0; i < count; i++){
+                if((results[i] = checkEntry(&entries[i])) != SUCCESS){
+                    continue;
+                }
+                MQ::topic_t topic_id;
+                if(!createTopicId(&topic_id, entries[i].name, snap->dict)){
+                    results[i] = OUT_OF_BOUNDS;
+                    continue;
+                }
+                results[i] = (_dispatchers)? publishAsync<SnapshotTopic>(snap->tree, entries[i].name, &topic_id, entries[i].data, entries[i].datasize, &_null_publisher) :
+                                             notifyTopics<SnapshotTopic>(snap->tree, entries[i].name, &topic_id, entries[i].data, entries[i].datasize, &mem_data);
+            }
+            snapshotExit(epoch);
+            if(mem_data){
+                Heap::memFree(mem_data);
+            }
+            return SUCCESS;
+        }
+        snapshotExit(epoch);
+
+        // si el broker esta ocupado, o en pleno reparto en anchura, las entradas se aplazan
+        bool deferred = (use_lock && !lockBroker(DefaultDeferTimeout));
+        if(deferred || (_nested_queued && _dispatch_depth > 0)){
+            for(uint16_t i = 0; i < count; i++){
+                if((results[i] = checkEntry(&entries[i])) == SUCCESS){
+                    results[i] = (deferred)? addPendingRequest(ReqPublish, entries[i].name, entries[i].data, entries[i].datasize, &_null_publisher, NULL, 0) :
+                                             queueNested(entries[i].name, entries[i].data, entries[i].datasize, &_null_publisher);
+                }
+            }
+            if(!deferred && use_lock){
+                unlockBroker();
+            }
+            return SUCCESS;
+        }
+
+        // resuelve los identificadores de todos los topics
+        int32_t err = SUCCESS;
+        uint32_t max_size = 0;
+        char* mem_data = NULL;
+        MQ::topic_t* ids = (MQ::topic_t*)Heap::memAlloc((count)? (count * sizeof(MQ::topic_t)) : 1);
+        if(!ids){
+            err = OUT_OF_MEMORY; goto _batch_exit;
+        }
+        // la recoleccion de tokens no puede cambiar los identificadores ya resueltos del lote
+        reclaimTokens();
+        for(uint16_t i = 0; i < count; i++){
+            if((results[i] = checkEntry(&entries[i])) != SUCCESS){
+                continue;
+            }
+            if(_prefilter_enabled && !prefilterMatch(entries[i].name)){
+                results[i] = NOT_FOUND;
+                continue;
+            }
+            if(_tokenlist_internal && !generateTokens(entries[i].name, false)){
+                results[i] = OUT_OF_MEMORY;
+                continue;
+            }
+            if(!createTopicId(&ids[i], entries[i].name)){
+                results[i] = OUT_OF_BOUNDS;
+            }
+        }
+
+        // buffer de copia compartido por todas las entradas
+        max_size = (_dispatchers)? 0 : getBatchMaxSize(entries, count);
+        if(max_size){
+            if((mem_data = (char*)Heap::memAlloc(max_size)) == NULL){
+                err = OUT_OF_MEMORY; goto _batch_exit;
+            }
+        }
+        for(uint16_t i = 0; i < count; i++){
+            if(results[i] != SUCCESS){
+                continue;
+            }
+            _pub_count++;
+            if(_dispatchers){
+                results[i] = publishAsync<TopicRow>(_topic_tree, entries[i].name, &ids[i], entries[i].data, entries[i].datasize, &_null_publisher);
+                continue;
+            }
+            uint32_t level;
+            enterDispatch(&level);
+            results[i] = notifyTopics<TopicRow>(_topic_tree, entries[i].name, &ids[i], entries[i].data, entries[i].datasize, &mem_data);
+            exitDispatch(level);
+        }
+
+_batch_exit:
+        if(mem_data){
+            Heap::memFree(mem_data);
+        }
+        if(ids){
+            Heap::memFree(ids);
+        }
+        if(use_lock){
+            unlockBroker();
+        }
+        return err;
+    }
+
+
+    /** @fn getNullPublisher
+     *  @brief Obtiene una callback de publicacion que no realiza ninguna accion, para las publicaciones
+     *         que no requieren notificacion
+     *  @return Callback de publicacion
+     */
+    static MQ::PublishCallback* getNullPublisher(){
+        return &_null_publisher;
+    }
+
+
+    /** @fn setZeroCopy
+     *  @brief Activa o desactiva la entrega sin copia. Con la entrega sin copia, los suscriptores
+     *         reciben directamente el buffer del publicador (de solo lectura), salvo aquellos que se
+     *         suscribieron con el flag MQ::SubscribeMutable, que reciben una copia privada.
+     *         Por defecto todos los suscriptores reciben una copia del mensaje.
+     *  @param enable True para activar la entrega sin copia
+     */
+    static void setZeroCopy(bool enable){
+        _zero_copy = enable;
+    }
+
+
+    /** @fn setLockFreePublish
+     *  @brief Activa o desactiva la publicacion sin bloqueo. En este modo, cada cambio en las suscripciones
+     *         genera una instantanea inmutable (indice de topics, diccionario de tokens y copia de los
+     *         suscriptores) que se sustituye de forma atomica. Las publicaciones recorren la instantanea
+     *         vigente sin tomar el mutex del broker, de forma que varios publicadores pueden buscar y notificar
+     *         en paralelo. Las instantaneas sustituidas se liberan cuando no queda ningun publicador en la
+     *         epoca en la que se retiraron.
+     *         En este modo las publicaciones no registran tokens nuevos (no pueden encajar con ninguna
+     *         suscripcion existente salvo por wildcards), y un suscriptor que cancela su suscripcion aun puede
+     *         recibir las publicaciones que estuvieran en curso en ese momento.
+     *  @param enable True para activar el modo
+     *  @return Resultado
+     */
+    static int32_t setLockFreePublish(bool enable){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        lockBroker();
+        _lock_free = enable;
+        int32_t err = updateSnapshot();
+        unlockBroker();
+        return err;
+    }
+
+
+    /** @fn setAsyncDispatch
+     *  @brief Activa o desactiva el despacho asincrono. En este modo, la publicacion solo busca los suscriptores
+     *         que encajan con el topic y encola una copia del mensaje, y un pool de threads de despacho invoca
+     *         a los suscriptores fuera del contexto del publicador y sin el mutex del broker. Cada topic se
+     *         asigna siempre al mismo thread (segun el hash de su nombre), de forma que los mensajes de un
+     *         mismo topic se entregan en el orden en que se publicaron.
+     *         La PublishCallback se invoca al encolar el mensaje o, tras entregarlo a todos sus suscriptores,
+     *         desde el thread de despacho, por lo que en ese caso debe permanecer valida hasta entonces. Al igual
+     *         que en la publicacion sin bloqueo, un suscriptor que cancela su suscripcion aun puede recibir los
+     *         mensajes que ya estuvieran encolados.
+     *         Al desactivar el modo (o reconfigurarlo) se entregan los mensajes pendientes antes de finalizar
+     *         los threads. Debe configurarse sin publicaciones en curso.
+     *  @param workers Numero de threads de despacho (0 para volver al despacho sincrono)
+     *  @param notify Momento en el que se invoca la PublishCallback (MQ::DispatchNotify)
+     *  @param max_queue Maximo numero de mensajes pendientes en cada thread de despacho
+     *  @return Resultado
+     */
+    static int32_t setAsyncDispatch(uint8_t workers, MQ::DispatchNotify notify = MQ::NotifyOnDelivered, uint16_t max_queue = DefaultMaxDispatchJobs){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        // finaliza el pool actual, entregando los mensajes pendientes
+        stopDispatchers();
+        if(!workers){
+            return SUCCESS;
+        }
+        Dispatcher* dispatchers = new Dispatcher[workers];
+        if(!dispatchers){
+            return OUT_OF_MEMORY;
+        }
+        for(uint8_t i = 0; i < workers; i++){
+            dispatchers[i].jobs.setLimit(max_queue);
+            dispatchers[i].thread.start(callback(&dispatchers[i], &Dispatcher::run));
+        }
+        lockBroker();
+        _dispatch_notify = notify;
+        _dispatcher_count = workers;
+        _dispatchers = dispatchers;
+        unlockBroker();
+        return SUCCESS;
+    }
+
+
+    /** @fn startIsrQueue
+     *  @brief Crea la cola de publicaciones desde interrupcion: un anillo preasignado de solicitudes en el que
+     *         varios productores pueden escribir sin bloqueo y sin reservar memoria. Opcionalmente arranca una
+     *         tarea del broker que vacia la cola y publica las solicitudes por lotes. Si no se arranca la tarea,
+     *         la cola debe vaciarse periodicamente mediante processIsrRequests.
+     *         Debe configurarse sin publicaciones en curso. Con slots = 0 se detiene la tarea y se libera la cola,
+     *         publicando antes las solicitudes pendientes.
+     *  @param slots Numero de solicitudes que admite la cola (se redondea a potencia de 2)
+     *  @param drain_task Flag para arrancar la tarea de vaciado
+     *  @return Resultado
+     */
+    static int32_t startIsrQueue(uint16_t slots = DefaultIsrQueueSlots, bool drain_task = true){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        // detiene la tarea de vaciado y publica las solicitudes pendientes
+        if(_isr_thread){
+            _isr_stop = true;
+            _isr_pending.release();
+            _isr_thread->join();
+            delete(_isr_thread);
+            _isr_thread = NULL;
+            _isr_stop = false;
+        }
+        processIsrRequests();
+        if(_isr_queue){
+            delete(_isr_queue);
+            _isr_queue = NULL;
+        }
+        if(!slots){
+            return SUCCESS;
+        }
+        _isr_queue = new MpscQueue<IsrRequest>(slots);
+        if(!_isr_queue || !_isr_queue->ready()){
+            delete(_isr_queue);
+            _isr_queue = NULL;
+            return OUT_OF_MEMORY;
+        }
+        if(drain_task){
+            _isr_thread = new Thread();
+            if(!_isr_thread){
+                return OUT_OF_MEMORY;
+            }
+            _isr_thread->start(callback(&runIsrQueue));
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn publishFromISR
+     *  @brief Encola una solicitud de publicacion desde una interrupcion o un productor de alta prioridad.
+     *         No toma el mutex del broker ni reserva memoria: copia el nombre del topic (o la referencia al
+     *         handle) y el mensaje en una entrada libre del anillo preasignado. La publicacion se realiza al
+     *         vaciar la cola, en el contexto de la tarea del broker, por lo que la PublishCallback (opcional)
+     *         se invoca desde dicha tarea. No se ejecutan los bridges.
+     *  @param name Nombre del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje (maximo DefaultMaxIsrPayload)
+     *  @param publisher Callback de notificacion de la publicacion (opcional)
+     *  @return Resultado (OUT_OF_MEMORY si la cola esta llena)
+     */
+    static int32_t publishFromISR(const char* name, const void* data, uint16_t datasize, MQ::PublishCallback *publisher = NULL){
+        if(!name){
+            return NULL_POINTER;
+        }
+        uint32_t len = strlen(name);
+        if(len > _max_name_len || len >= DefaultMaxTopicNameLength){
+            return OUT_OF_BOUNDS;
+        }
+        return enqueueIsrRequest(name, len, NULL, data, datasize, publisher);
+    }
+
+
+    /** @fn publishFromISR
+     *  @brief Igual que la anterior, pero a traves de un handle de publicacion, que debe permanecer valido
+     *         hasta que se vacie la cola.
+     *  @param handle Handle de publicacion
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje (maximo DefaultMaxIsrPayload)
+     *  @param publisher Callback de notificacion de la publicacion (opcional)
+     *  @return Resultado (OUT_OF_MEMORY si la cola esta llena)
+     */
+    static int32_t publishFromISR(MQ::PublishHandle* handle, const void* data, uint16_t datasize, MQ::PublishCallback *publisher = NULL){
+        if(!handle || !handle->name){
+            return NULL_POINTER;
+        }
+        return enqueueIsrRequest(NULL, 0, handle, data, datasize, publisher);
+    }
+
+
+    /** @fn processIsrRequests
+     *  @brief Vacia la cola de publicaciones desde interrupcion, publicando las solicitudes por lotes de
+     *         DefaultIsrBatchSize con una unica toma del mutex del broker por lote.
+     *  @return Numero de solicitudes publicadas
+     */
+    static uint32_t processIsrRequests(){
+        if(!_isr_queue){
+            return 0;
+        }
+        uint32_t count = 0;
+        _isr_signaled.store(false);
+        for(;;){
+            uint32_t batch = 0;
+            lockBroker();
+            for(; batch < DefaultIsrBatchSize; batch++){
+                IsrRequest* req = _isr_queue->front();
+                if(!req){
+                    break;
+                }
+                // el mensaje se publica directamente desde la entrada, que se libera despues
+                MQ::PublishCallback* publisher = (req->publisher)? req->publisher : &_null_publisher;
+                if(req->handle){
+                    publishReq(req->handle, req->data, req->datasize, publisher, false);
+                }
+                else{
+                    publishReq(req->name, req->data, req->datasize, publisher, false);
+                }
+                _isr_queue->pop();
+            }
+            unlockBroker();
+            count += batch;
+            if(batch < DefaultIsrBatchSize){
+                return count;
+            }
+        }
+    }
+
+
+    /** @fn getIsrDropCount
+     *  @brief Obtiene el numero de publicaciones desde interrupcion descartadas por cola llena
+     *  @return Numero de publicaciones descartadas
+     */
+    static uint32_t getIsrDropCount(){
+        return (_isr_queue)? _isr_queue->getDropCount() : 0;
+    }
+
+
+    /** @fn setNestedDispatch
+     *  @brief Selecciona como se procesan las publicaciones realizadas desde un suscriptor durante un reparto.
+     *         Por defecto se procesan de forma recursiva, en la pila del suscriptor. En el reparto en anchura se
+     *         encolan (con una copia del mensaje) y se procesan de forma iterativa al finalizar el reparto actual,
+     *         de forma que una cadena de republicaciones no crece en la pila. Se descartan (OUT_OF_BOUNDS) las
+     *         publicaciones que superan el nivel de anidamiento maximo o no caben en la cola.
+     *         Solo se aplica a las publicaciones con bloqueo; en la publicacion sin bloqueo y en el despacho
+     *         asincrono las publicaciones anidadas se procesan segun su propio modo.
+     *  @param queued True para el reparto en anchura, False para el reparto recursivo
+     *  @param max_depth Maximo nivel de anidamiento de una cadena de publicaciones
+     *  @param max_queue Maximo numero de publicaciones anidadas pendientes
+     *  @return Resultado
+     */
+    static int32_t setNestedDispatch(bool queued, uint8_t max_depth = DefaultMaxNestedDepth, uint16_t max_queue = DefaultMaxNestedQueue){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        int32_t err = SUCCESS;
+        lockBroker();
+        if(!_nested_list){
+            _nested_list = new List<DispatchJob>();
+        }
+        if(_nested_list){
+            _nested_list->setLimit(max_queue);
+            _nested_queued = queued;
+            _nested_max_depth = max_depth;
+        }
+        else{
+            err = OUT_OF_MEMORY;
+        }
+        unlockBroker();
+        return err;
+    }
+
+
+    /** @fn getNestedDispatchStats
+     *  @brief Obtiene las estadisticas de las publicaciones anidadas: maximo numero de publicaciones encoladas,
+     *         maximo nivel de anidamiento alcanzado, maximo uso de pila (aproximado) desde la publicacion raiz
+     *         hasta la invocacion de un suscriptor, y publicaciones descartadas.
+     *  @param stats Recibe las estadisticas
+     */
+    static void getNestedDispatchStats(MQ::NestedDispatchStats* stats){
+        lockBroker();
+        *stats = _nested_stats;
+        unlockBroker();
+    }
+
+
+    /** @fn resetNestedDispatchStats
+     *  @brief Reinicia las estadisticas de las publicaciones anidadas
+     */
+    static void resetNestedDispatchStats(){
+        lockBroker();
+        memset(&_nested_stats, 0, sizeof(MQ::NestedDispatchStats));
+        unlockBroker();
+    }
+
+
+    /** @fn setRetainedStore
+     *  @brief Configura el almacen de mensajes retenidos. Guarda el ultimo mensaje publicado con MQ::PublishRetain
+     *         en cada topic exacto, y lo entrega a cada nuevo suscriptor cuyo topic (con o sin wildcards) encaje
+     *         con el, en el contexto de la suscripcion. Cada mensaje ocupa una unica reserva junto con el nombre
+     *         de su topic, y el conjunto no supera el presupuesto de memoria indicado. Si al reducir el presupuesto
+     *         los mensajes actuales no caben, se descartan los actualizados hace mas tiempo.
+     *  @param max_bytes Presupuesto de memoria del almacen (0 para eliminarlo, descartando los mensajes)
+     *  @param eviction Politica cuando un mensaje nuevo no cabe en el presupuesto (MQ::RetainEviction)
+     *  @return Resultado
+     */
+    static int32_t setRetainedStore(uint32_t max_bytes, MQ::RetainEviction eviction = MQ::RetainEvictOldest){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        int32_t err = SUCCESS;
+        lockBroker();
+        if(max_bytes && !_retained_list){
+            _retained_list = new List<Retained>();
+            _retained_index = new HashMap<Retained*>();
+            if(!_retained_list || !_retained_index){
+                err = OUT_OF_MEMORY; max_bytes = 0;
+            }
+        }
+        _retained_budget = max_bytes;
+        _retained_eviction = eviction;
+        if(_retained_list){
+            evictRetained(0);
+        }
+        if(!max_bytes){
+            delete(_retained_list);
+            delete(_retained_index);
+            _retained_list = NULL;
+            _retained_index = NULL;
+        }
+        unlockBroker();
+        return err;
+    }
+
+
+    /** @fn getRetainedUsage
+     *  @brief Obtiene la ocupacion del almacen de mensajes retenidos
+     *  @param bytes Recibe la memoria ocupada (puede ser NULL)
+     *  @param count Recibe el numero de mensajes retenidos (puede ser NULL)
+     */
+    static void getRetainedUsage(uint32_t* bytes, uint32_t* count){
+        lockBroker();
+        if(bytes){
+            *bytes = _retained_bytes;
+        }
+        if(count){
+            *count = (_retained_list)? _retained_list->getItemCount() : 0;
+        }
+        unlockBroker();
+    }
+
+
+    /** @fn startConflateFlush
+     *  @brief Arranca una tarea del broker que entrega periodicamente el ultimo mensaje pendiente de las
+     *         suscripciones MQ::SubscribeConflate cuyo intervalo minimo haya vencido. Sin esta tarea, los
+     *         mensajes pendientes solo se entregan mediante flushConflatedReq (o MQClient::pull).
+     *  @param period Periodo de revision (ms), 0 para detener la tarea
+     *  @return Resultado
+     */
+    static int32_t startConflateFlush(uint32_t period = DefaultConflateFlushPeriod){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(_flush_thread){
+            _flush_stop = true;
+            _flush_wakeup.release();
+            _flush_thread->join();
+            delete(_flush_thread);
+            _flush_thread = NULL;
+            _flush_stop = false;
+        }
+        if(!period){
+            return SUCCESS;
+        }
+        _flush_period = period;
+        _flush_thread = new Thread();
+        if(!_flush_thread){
+            return OUT_OF_MEMORY;
+        }
+        _flush_thread->start(callback(&runConflateFlush));
+        return SUCCESS;
+    }
+
+
+    /** @fn flushConflatedReq
+     *  @brief Entrega el ultimo mensaje pendiente de las suscripciones MQ::SubscribeConflate. Los topics
+     *         sin mensaje pendiente cuyo intervalo ha vencido se descartan, ya que su siguiente publicacion
+     *         se entregara directamente.
+     *  @param subscriber Suscriptor cuyos mensajes se entregan (NULL para todos)
+     *  @param force True para entregarlos aunque no haya vencido su intervalo minimo
+     *  @return Resultado
+     */
+    static int32_t flushConflatedReq(MQ::SubscribeCallback* subscriber = NULL, bool force = false){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        lockBroker();
+        uint32_t level;
+        enterDispatch(&level);
+        uint32_t pass = ++_conflate_pass;
+        for(;;){
+            // extrae el siguiente mensaje a entregar, ya que el suscriptor puede modificar los topics pendientes
+            ConflateValue* value = NULL;
+            MQ::SubscribeCallback* cb = NULL;
+            _conflate_mutex.lock();
+            if(_conflate_list){
+                uint32_t now = conflateClock();
+                for(ConflateSlot* slot : *_conflate_list){
+                    if(slot->pass == pass || (subscriber && slot->cb != subscriber) || (!force && (now - slot->last) < slot->interval)){
+                        continue;
+                    }
+                    slot->pass = pass;
+                    if(!slot->value){
+                        if(!force){
+                            removeConflateSlot(slot);
+                        }
+                        continue;
+                    }
+                    value = slot->value;
+                    cb = slot->cb;
+                    slot->value = NULL;
+                    slot->last = now;
+                    break;
+                }
+            }
+            _conflate_mutex.unlock();
+            if(!value){
+                break;
+            }
+            cb->call(conflateValueName(value), conflateValueData(value), value->datasize);
+            Heap::memFree(value);
+        }
+        exitDispatch(level);
+        unlockBroker();
+        return SUCCESS;
+    }
+
+
+    /** @fn setPublishPrefilter
+     *  @brief Activa o desactiva el prefiltro de publicaciones (activo por defecto). El prefiltro mantiene, por
+     *         cada nivel, un mapa de bits con el hash de los tokens de las suscripciones y los niveles con '+' o
+     *         '#', de forma que una publicacion por nombre que no puede encajar con ninguna suscripcion se
+     *         descarta (notificando NOT_FOUND) sin registrar sus tokens, sin reservar memoria y sin recorrer el
+     *         indice. Solo descarta publicaciones que no encajan: un falso positivo sigue el camino normal.
+     *  @param enable True para activar el prefiltro
+     */
+    static void setPublishPrefilter(bool enable){
+        _prefilter_enabled = enable;
+    }
+
+
+    /** @fn setTokenCollectBudget
+     *  @brief Establece la duracion maxima de las pasadas automaticas de recoleccion de tokens. Los tokens solo
+     *         se mantienen mientras los utiliza algun topic suscrito o algun mensaje retenido, de forma que los
+     *         registrados por topics transitorios (identificadores de peticion, secuencias...) se liberan. Cuando
+     *         el diccionario esta a punto de llenarse, el registro de tokens nuevos lanza una pasada (ver
+     *         collectTokensReq) con este presupuesto. Por defecto DefaultTokenCollectBudget.
+     *  @param budget_us Duracion maxima de cada pasada (us), 0 para desactivar las pasadas automaticas
+     */
+    static void setTokenCollectBudget(uint32_t budget_us){
+        _token_collect_budget = budget_us;
+    }
+
+
+    /** @fn collectTokensReq
+     *  @brief Realiza una pasada incremental de recoleccion de tokens: libera los tokens sin referencias y
+     *         compacta el diccionario trasladando los ultimos tokens a los huecos liberados, reescribiendo los
+     *         identificadores de los topics, del indice y de los mensajes retenidos. Los traslados se aplican
+     *         en pasos de hasta DefaultTokenCollectBatch tokens y la pasada finaliza al agotar el presupuesto,
+     *         de forma que la recoleccion puede completarse en varias pasadas. Los handles de publicacion y los
+     *         bridges se actualizan en su siguiente uso. No puede realizarse durante un reparto.
+     *  @param budget_us Duracion maxima de la pasada (us). Siempre se completa al menos un paso.
+     *  @param use_lock Flag para utilizar el bloqueo por mutex
+     *  @return Resultado
+     */
+    static int32_t collectTokensReq(uint32_t budget_us, bool use_lock = true){
+        if(!_topic_table){
+            return DEINIT;
+        }
+        if(use_lock){
+            if(!lockBroker(DefaultMutexTimeout)){
+                return LOCK_TIMEOUT;
+            }
+        }
+        int32_t err = (_dispatch_depth > 0)? LOCK_TIMEOUT : SUCCESS;
+        if(err == SUCCESS){
+            collectTokens(budget_us);
+        }
+        if(use_lock){
+            unlockBroker();
+        }
+        return err;
+    }
+
+
+    /** @fn getTokenCollectStats
+     *  @brief Obtiene las estadisticas de la recoleccion de tokens
+     *  @param stats Recibe las estadisticas
+     */
+    static void getTokenCollectStats(MQ::TokenCollectStats* stats){
+        *stats = _token_collect_stats;
+        stats->unreferenced = _token_unreferenced;
+    }
+
+
+    /** @fn getTokenGeneration
+     *  @brief Obtiene la generacion de los identificadores de los tokens. Cambia cada vez que la recoleccion
+     *         libera o reubica tokens, invalidando los identificadores de topic obtenidos hasta entonces.
+     *  @return Generacion
+     */
+    static uint32_t getTokenGeneration(){
+        return _token_generation;
+    }
+
+
+    /** @fn getGeneration
+     *  @brief Obtiene la generacion actual del conjunto de suscripciones. Se incrementa en cada
+     *         suscripcion o cancelacion de suscripcion.
+     *  @return Generacion
+     */
+    static uint32_t getGeneration(){
+        return _generation;
+    }
+
+
+    /** @fn getTopicIdReq 
+     *  @brief Obtiene el identificador del topic dado su nombre
+     *  @param id Recibe el Identificador del topic or (0) si no existe
+     *  @param name Nombre del topic
+     */
+    static void getTopicIdReq(MQ::topic_t* id, const char* name){        
+        createTopicId(id, name);
+    }    
+
+    
+    /** @fn getTopicNameReq 
+     *  @brief Obtiene el nombre de un topic dado su id y su scope
+     *  @param name Recibe el nombre asociado al id
+     *  @param len Tama�o m�ximo aceptado para el nombre
+     *  @param id Identificador del topic
+     */
+    static void getTopicNameReq(char* name, uint8_t len, MQ::topic_t* id){
+        strcpy(name, "");
+        uint8_t num = 0;
+
+        // recorre campo a campo verificando los tokens
+        for(int i=0;i<MQ::MAX_TOKEN_LEVEL;i++){
+            uint32_t idex;
+			// obtiene el token_id
+			idex = id->tk[i];
+			// si ha llegado al final del topic, termina
+			if(idex == WildcardNotUsed){
+				// una vez finalizado, debe borrar el �ltimo caracter '/' insertado
+				name[strlen(name)-1] = 0;
+				return;
+			}
+			// si son wildcards, los escribe
+			else if(idex == WildcardAny){
+				strcat(name, "+/");
+			}
+			else if(idex == WildcardAll){
+				strcat(name, "#/");
+			}
+			// los niveles numericos, escribe su valor
+			else if(idex == WildcardNumeric){
+				sprintf(&name[strlen(name)], "%u/", (unsigned)id->num[num++]);
+			}
+			// en otro caso, escribe el token correspondiente
+			else{
+				strcat(name, _token_provider[idex - WildcardCOUNT]);
+				strcat(name, "/");
+			}
+        }
+        // una vez finalizado, debe borrar el �ltimo caracter '/' insertado
+        name[strlen(name)-1] = 0;
+    }        
+
+    
+    /** @fn getMaxTopicLenReq 
+     *  @brief Obtiene el n�mero m�ximo de caracteres que puede tener un topic
+     *  @return N�mero de caracteres, incluyendo el '\0' final.
+     */
+    static uint8_t getMaxTopicLenReq(){
+        return _max_name_len;
+    }
+
+
+    /** @fn getInternalTokenListReq
+     *  @brief Obtiene la lista de tokens interna
+     *  @param tklist Lista de tokens
+     *  @param tkcount N�mero de tokens en la lista
+     */
+    static void getInternalTokenListReq(const char** &tklist, uint32_t &tkcount){
+        tklist = _token_provider;
+        tkcount = _token_provider_count - WildcardCOUNT;
+    }
+
+
+    /** @fn existsTopicReq
+     *  @brief Chequea si un topic existe
+     *  @param name Nombre del topic a chequear
+     */
+    static bool existsTopicReq(const char* name){
+    	uint32_t row;
+    	return findTopicByName(name, &row);
+    }
+
+    /** @fn matchIds
+     *  @brief Compara dos identificadores. El de b�squeda con el encontrado. Si el encontrado
+     *         contiene wildcards, habr� que tenerlos en cuenta.
+     *  @param found_id Identificador encontrado
+     *  @param search_id Identificador de b�squeda
+     *  @return True si encajan, False si no encajan 
+     */
+    static bool matchIds(MQ::topic_t* found_id, MQ::topic_t* search_id){
+        // posicion del siguiente valor numerico de cada identificador
+        uint8_t found_num = 0, search_num = 0;
+        for(int i=0;i<MQ::MAX_TOKEN_LEVEL;i++){
+			// si ha encontrado un wildcard All, es que coincide
+			if(found_id->tk[i] == WildcardAll){
+				return true;
+			}
+
+			// si ha llegado al final de la cadena de b�squeda sin errores, es que coincide...
+			if(search_id->tk[i] == WildcardNotUsed){
+				if(found_id->tk[i] != WildcardNotUsed)
+					return false;
+				return true;
+			}
+
+			// si no coinciden ni hay wildcards '+' involucrados, no hay coincidencia
+			if(found_id->tk[i] != WildcardAny && found_id->tk[i] != search_id->tk[i]){
+				return false;
+			}
+
+			// en los niveles numericos, compara ademas sus valores
+			if(search_id->tk[i] == WildcardNumeric){
+				if(found_id->tk[i] == WildcardNumeric && found_id->num[found_num++] != search_id->num[search_num]){
+					return false;
+				}
+				search_num++;
+			}
+
+            // en otro caso, es que coinciden y por lo tanto sigue analizando siguientes elementos
+        }        
+        // si llega a este punto es que coinciden todos los niveles
+        return true;
+    }
+
+
+    /** @fn isResolvedId
+     *  @brief Chequea si todos los niveles de un identificador tienen token, es decir, si no contiene
+     *         niveles ausentes del diccionario de tokens
+     *  @param id Identificador
+     *  @return True si todos los niveles tienen token
+     */
+    static bool isResolvedId(const MQ::topic_t* id){
+        for(int i = 0; i < MQ::MAX_TOKEN_LEVEL; i++){
+            if(id->tk[i] == WildcardInvalid){
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    /** M�ximo tiempo de espera en el mutex antes de crear solicitud pendiente */
+    static const uint32_t DefaultMutexTimeout = 3000;
+
+    /** Maximo tiempo de espera en el mutex de publicaciones y suscripciones antes de aplazarlas */
+    static const uint32_t DefaultDeferTimeout = 2;
+
+
+private:
+	
+    /** Contador de publicaciones */
+    static uint32_t _pub_count;
+
+    /** Generacion del conjunto de suscripciones, para invalidar los handles de publicacion */
+    static uint32_t _generation;
+
+    /** Palabras del mapa de bits de cada nivel del prefiltro */
+    static const uint16_t PrefilterWords = MQ_PREFILTER_BITS / 32;
+
+    /** Prefiltro de publicaciones (ver setPublishPrefilter). Las altas de topics se incorporan al momento y las
+     *  bajas lo marcan como obsoleto, reconstruyendose en la siguiente publicacion que lo consulta */
+    struct Prefilter{
+        uint32_t bits[MQ::MAX_TOKEN_LEVEL][PrefilterWords];  /// Hash de los tokens de cada nivel
+        uint64_t any;                       /// Niveles con '+' (o con un token no resuelto)
+        uint64_t all;                       /// Niveles con '#'
+        uint64_t depth;                     /// Profundidades de las suscripciones sin '#' (bit n-1)
+        bool dirty;                         /// Flag de reconstruccion pendiente
+    };
+    static Prefilter _prefilter;
+    static bool _prefilter_enabled;
+
+    /** Flag de entrega sin copia */
+    static bool _zero_copy;
+
+    /** Topic de una instantanea de suscripciones */
+    struct SnapshotTopic{
+        MQ::Subscriber* subscribers;        /// Copia de los suscriptores del topic
+        uint16_t subscriber_count;          /// Numero de suscriptores
+    };
+
+    /** Instantanea inmutable del conjunto de suscripciones, para la publicacion sin bloqueo */
+    struct Snapshot{
+        const TopicTree<SnapshotTopic, MQ::key_t>* tree;   /// Indice de topics
+        HashMap<MQ::token_t>* dict;         /// Copia del diccionario de tokens
+        SnapshotTopic* topics;              /// Topics
+        MQ::Subscriber* subscribers;        /// Suscriptores de todos los topics
+        uint32_t token_generation;          /// Generacion de los identificadores de los tokens
+        uint8_t drained;                    /// Paridades de epoca vistas sin publicadores desde que se retiro
+        Snapshot* next;                     /// Siguiente instantanea retirada
+    };
+
+    /** Flag de publicacion sin bloqueo */
+    static bool _lock_free;
+
+    /** Instantanea vigente (NULL si el modo sin bloqueo no esta activo) */
+    static std::atomic<Snapshot*> _snapshot;
+
+    /** Instantaneas retiradas pendientes de liberar */
+    static Snapshot* _retired;
+
+    /** Epoca actual y numero de publicadores en curso por paridad de epoca */
+    static std::atomic<uint32_t> _rcu_epoch;
+    static std::atomic<uint32_t> _rcu_readers[2];
+
+    /** Mensaje encolado para su despacho asincrono. Se reserva en un unico bloque junto con la copia de
+     *  los suscriptores, del mensaje y del nombre del topic */
+    struct DispatchJob{
+        char* name;                         /// Copia del nombre del topic
+        void* data;                         /// Copia del mensaje
+        uint32_t datasize;                  /// Tamano del mensaje
+        MQ::Subscriber* subscribers;        /// Copia de los suscriptores que encajan con el topic
+        uint32_t subscriber_count;          /// Numero de suscriptores
+        uint32_t subscriber_size;           /// Capacidad del array de suscriptores
+        MQ::PublishCallback* publisher;     /// Callback a invocar tras la entrega (NULL si ya se invoco)
+        uint32_t level;                     /// Nivel de anidamiento (publicaciones anidadas encoladas)
+        ListNode<DispatchJob> node;         /// Nodo de la cola del thread de despacho o de publicaciones anidadas
+    };
+
+    /** Thread de despacho con su cola de mensajes */
+    struct Dispatcher{
+        Thread thread;                      /// Thread de despacho
+        Mutex mutex;                        /// Mutex de la cola
+        Semaphore pending;                  /// Numero de mensajes encolados (mas uno para finalizar)
+        List<DispatchJob> jobs;             /// Cola de mensajes
+        bool stop;                          /// Flag de finalizacion tras vaciar la cola
+
+        Dispatcher() : stop(false) {}
+        void run(){ MQBroker::runDispatcher(this); }
+    };
+
+    /** Maximo numero de mensajes pendientes por thread de despacho */
+    static const uint16_t DefaultMaxDispatchJobs = 64;
+
+    /** Pool de threads de despacho (NULL en modo sincrono) */
+    static Dispatcher* _dispatchers;
+    static uint8_t _dispatcher_count;
+
+    /** Momento en el que se invoca la PublishCallback en modo asincrono */
+    static MQ::DispatchNotify _dispatch_notify;
+
+    /** Numero de solicitudes por defecto de la cola de publicaciones desde interrupcion */
+    static const uint16_t DefaultIsrQueueSlots = 64;
+
+    /** Periodo maximo (ms) entre revisiones de la cola por la tarea de vaciado */
+    static const uint32_t DefaultIsrDrainPeriod = 10;
+
+    /** Maximo tamano del mensaje de una publicacion desde interrupcion */
+    static const uint16_t DefaultMaxIsrPayload = 32;
+
+    /** Numero de solicitudes publicadas por cada toma del mutex al vaciar la cola */
+    static const uint16_t DefaultIsrBatchSize = 16;
+
+    /** Solicitud de publicacion desde interrupcion */
+    struct IsrRequest{
+        MQ::PublishHandle* handle;                  /// Handle de publicacion (NULL si se publica por nombre)
+        MQ::PublishCallback* publisher;             /// Callback de notificacion (NULL si no se requiere)
+        uint16_t datasize;                          /// Tamano del mensaje
+        char name[MQ::DefaultMaxTopicNameLength];   /// Copia del nombre del topic
+        uint8_t data[DefaultMaxIsrPayload];         /// Copia del mensaje
+    };
+
+    /** Cola de publicaciones desde interrupcion */
+    static MpscQueue<IsrRequest>* _isr_queue;
+
+    /** Tarea de vaciado de la cola, aviso de solicitudes pendientes y flag de finalizacion */
+    static Thread* _isr_thread;
+    static Semaphore _isr_pending;
+    static std::atomic<bool> _isr_signaled;
+    static std::atomic<bool> _isr_stop;
+
+    /** Callback de notificacion para las publicaciones sin PublishCallback */
+    static MQ::PublishCallback _null_publisher;
+
+    /** Maximo nivel de anidamiento y numero de publicaciones anidadas pendientes por defecto */
+    static const uint8_t DefaultMaxNestedDepth = 16;
+    static const uint16_t DefaultMaxNestedQueue = 32;
+
+    /** Reparto en anchura de las publicaciones anidadas y sus limites */
+    static bool _nested_queued;
+    static uint8_t _nested_max_depth;
+
+    /** Cola de publicaciones anidadas pendientes */
+    static List<DispatchJob>* _nested_list;
+
+    /** Repartos en curso en la pila del thread que posee el broker, nivel de anidamiento del mensaje
+     *  en reparto, flag de procesado de la cola y direccion de pila de la publicacion raiz */
+    static uint32_t _dispatch_depth;
+    static uint32_t _dispatch_level;
+    static bool _dispatch_draining;
+    static uintptr_t _dispatch_stack;
+
+    /** Estadisticas de las publicaciones anidadas */
+    static MQ::NestedDispatchStats _nested_stats;
+
+    /** Mensaje retenido de un topic. Se reserva en un unico bloque seguido del mensaje y del nombre del topic */
+    struct Retained{
+        MQ::topic_t id;                     /// Identificador del topic
+        uint32_t datasize;                  /// Tamano del mensaje
+        uint32_t size;                      /// Memoria ocupada por el bloque
+        ListNode<Retained> node;            /// Nodo de la lista de mensajes retenidos, por orden de actualizacion
+    };
+
+    /** Almacen de mensajes retenidos (NULL si no esta configurado) y su indice por nombre de topic */
+    static List<Retained>* _retained_list;
+    static HashMap<Retained*>* _retained_index;
+
+    /** Presupuesto de memoria del almacen, memoria ocupada y politica de descarte */
+    static uint32_t _retained_budget;
+    static uint32_t _retained_bytes;
+    static MQ::RetainEviction _retained_eviction;
+
+    /** Ultimo mensaje pendiente de un topic en una suscripcion MQ::SubscribeConflate. Se reserva en un unico
+     *  bloque seguido del mensaje (con capacidad para reutilizarlo) y de la copia del nombre del topic */
+    struct ConflateValue{
+        uint32_t datasize;                  /// Tamano del mensaje
+        uint32_t capacity;                  /// Capacidad reservada para el mensaje
+    };
+
+    /** Estado de un topic en una suscripcion MQ::SubscribeConflate. Se reserva en un unico bloque seguido
+     *  del nombre del topic */
+    struct ConflateSlot{
+        MQ::SubscribeCallback* cb;          /// Suscriptor
+        uint32_t interval;                  /// Intervalo minimo entre entregas (ms)
+        uint32_t last;                      /// Instante de la ultima entrega (ms)
+        uint32_t pass;                      /// Ultima pasada de entrega en la que se reviso
+        ConflateValue* value;               /// Ultimo mensaje pendiente (NULL si no hay)
+        ConflateSlot* next;                 /// Siguiente suscriptor del mismo topic
+        ListNode<ConflateSlot> node;        /// Nodo de la lista de topics pendientes
+    };
+
+    /** Periodo por defecto de la tarea de entrega de mensajes pendientes (ms) */
+    static const uint32_t DefaultConflateFlushPeriod = 10;
+
+    /** Topics de las suscripciones MQ::SubscribeConflate, su indice por nombre (primer suscriptor de cada
+     *  topic) y mutex que los protege, ya que se actualizan desde publicaciones sin el mutex del broker */
+    static List<ConflateSlot>* _conflate_list;
+    static HashMap<ConflateSlot*>* _conflate_index;
+    static Mutex _conflate_mutex;
+
+    /** Reloj de los intervalos de entrega y numero de pasadas de entrega */
+    static Timer _conflate_clock;
+    static uint32_t _conflate_pass;
+
+    /** Tarea de entrega de mensajes pendientes, aviso de finalizacion y periodo */
+    static Thread* _flush_thread;
+    static Semaphore _flush_wakeup;
+    static std::atomic<bool> _flush_stop;
+    static uint32_t _flush_period;
+
+    /** Identificador de wildcards */
+    enum Wildcards{
+        WildcardNotUsed = 0,
+        WildcardAny,
+        WildcardAll,
+		WildcardInvalid,
+		WildcardNumeric,
+        WildcardCOUNT,
+    };    
+    
+    /** Lista de operaciones pendientes
+     *
+     */
+    enum PendingRequestType {
+    	ReqPublish=0, 	//!< ReqPublish Solicitud de publicaci�n
+		ReqSubscribe,   //!< ReqSubscribe Solicitud de suscripci�n
+		ReqUnsubscribe, //!< ReqUnsubscribe Solicitud de unsuscripci�n
+    };
+
+    /** M�ximo n�mero de tokens permitidos en topic provider auto-gestionado */
+    static const uint32_t DefaultMaxNumTokenEntries = ((1UL << MQ_TOKEN_BITS) - WildcardCOUNT);
+
+    /** M�ximo n�mero de topics permitidos */
+    static const uint32_t DefaultMaxNumTopics = MQ_MAX_TOPICS;
+
+    /** Capacidad inicial de la lista de tokens y de los indices hash, que crecen bajo demanda hasta los maximos */
+    static const uint32_t DefaultInitialTableSize = 256;
+
+    /** Tabla de topics registrados: identificadores, nombres y suscriptores, con su indice hash por nombre */
+    static TopicTable<MQ::topic_t, MQ::Subscriber> * _topic_table;
+
+    /** Referencia opaca a una fila de la tabla de topics, utilizada como hoja del indice en arbol */
+    struct TopicRow;
+
+    /** Indice en arbol de los topics registrados, por token en cada nivel */
+    static TopicTree<TopicRow, MQ::key_t> * _topic_tree;
+
+    /** Suscriptores cancelados durante un reparto, pendientes de eliminar de la tabla */
+    static uint32_t _cancelled;
 
     /** Puntero a la lista de topics proporcionados */
     static const char** _token_provider;
     static uint32_t _token_provider_count;
+    static uint32_t _token_provider_size;
+
+    /** Diccionario hash de tokens: nombre del token -> identificador */
+    static HashMap<MQ::token_t> * _token_dict;
     static uint8_t _token_bits;
     static bool _tokenlist_internal;
 
-	/** Mutex */
-    static Mutex _mutex;
+    /** Duracion maxima por defecto de las pasadas automaticas de recoleccion de tokens (us) */
+    static const uint32_t DefaultTokenCollectBudget = 500;
+
+    /** Maximo numero de tokens reubicados en cada paso de la recoleccion */
+    static const uint8_t DefaultTokenCollectBatch = 8;
+
+    /** Referencias de cada token (topics suscritos y mensajes retenidos), en paralelo a la lista de tokens */
+    static uint32_t* _token_refs;
+
+    /** Tokens sin referencias y posicion por debajo de la cual todos los tokens tienen referencias */
+    static uint32_t _token_unreferenced;
+    static uint32_t _token_low;
+
+    /** Generacion (ver _generation) en la que la recoleccion cambio por ultima vez los identificadores */
+    static uint32_t _token_generation;
+
+    /** Presupuesto de las pasadas automaticas y estadisticas de la recoleccion */
+    static uint32_t _token_collect_budget;
+    static MQ::TokenCollectStats _token_collect_stats;
+
+	/** Mutex */
+    static Mutex _mutex;
+
+    /** L�mite de tama�o en nombres de topcis */
+    static uint8_t _max_name_len;
+ 
+    /** Flag de depuraci�n */
+    static bool _defdbg;
+
+    /** Estructura de datos de una solicitud pendiente
+     *
+     */
+    struct PendingRequest_t{
+    	PendingRequestType type;
+    	char* topic;
+    	void *msg;
+    	uint32_t msg_len;
+    	SubscribeCallback *sub_cb;
+    	PublishCallback *pub_cb;
+    	uint8_t flags;
+    	uint32_t interval;
+    };
+
+    /** Maximo numero de operaciones pendientes por mutex bloqueado */
+    static const uint16_t DefaultMaxPendingRequests = 32;
+
+    /** Cola de acciones pendientes por mutex bloqueado. Los threads que no obtienen el mutex encolan la
+     *  operacion sin bloqueo, y el siguiente thread que libera el broker la aplica */
+    static MpscQueue<PendingRequest_t> *_pending_list;
+
+    /** Profundidad de bloqueo del mutex (recursivo) por el thread que lo posee */
+    static uint32_t _lock_depth;
+
+
+    /** @fn findTopicByName 
+     *  @brief Busca un topic por medio de su nombre en el indice hash de nombres
+     *  @param name nombre
+     *  @param row Recibe la fila del topic en la tabla
+     *  @return True si existe, False si no existe
+     */
+    static bool findTopicByName(const char* name, uint32_t* row){
+        return (_topic_table && _topic_table->findTopic(name, row));
+    }
+
+
+    /** @fn rowRef
+     *  @brief Convierte una fila de la tabla de topics en la hoja del indice en arbol, y viceversa. La hoja
+     *         codifica la fila + 1, ya que el arbol reserva el puntero nulo para las hojas liberadas.
+     */
+    static TopicRow* rowRef(uint32_t row){
+        return (TopicRow*)(uintptr_t)(row + 1);
+    }
+    static uint32_t refRow(TopicRow* ref){
+        return (uint32_t)((uintptr_t)ref - 1);
+    }
+
+
+    /** @fn addTopic
+     *  @brief Inserta un topic sin suscriptores en la tabla y en el indice en arbol
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic
+     *  @param row Recibe la fila del topic
+     *  @return Resultado
+     */
+    static int32_t addTopic(const char* name, const MQ::topic_t* id, uint32_t* row){
+        int32_t rc = _topic_table->addTopic(name, id, row);
+        if(rc != TopicTable<MQ::topic_t, MQ::Subscriber>::SUCCESS){
+            return (rc == TopicTable<MQ::topic_t, MQ::Subscriber>::LIMIT_EXCEEDED)? OUT_OF_BOUNDS : OUT_OF_MEMORY;
+        }
+        MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+        if(_topic_tree->addItem(getKeys(id, keys), rowRef(*row)) != TopicTree<TopicRow, MQ::key_t>::SUCCESS){
+            uint32_t moved;
+            _topic_table->removeTopic(*row, &moved);
+            return OUT_OF_MEMORY;
+        }
+        refTokens(id, 1);
+        prefilterAdd(name, id);
+        return SUCCESS;
+    }
+
+
+    /** @fn removeTopic
+     *  @brief Elimina un topic de la tabla y del indice en arbol. La ultima fila de la tabla ocupa su
+     *         posicion, por lo que su hoja del indice se actualiza. No debe utilizarse durante un reparto.
+     *  @param row Fila del topic
+     */
+    static void removeTopic(uint32_t row){
+        MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+        uint32_t moved;
+        refTokens(_topic_table->getId(row), -1);
+        _topic_tree->removeItem(getKeys(_topic_table->getId(row), keys), rowRef(row));
+        _topic_table->removeTopic(row, &moved);
+        if(moved != row){
+            _topic_tree->removeItem(getKeys(_topic_table->getId(row), keys), rowRef(moved));
+            _topic_tree->addItem(keys, rowRef(row));
+        }
+        _prefilter.dirty = true;
+    }
+
+
+    /** @fn prefilterAdd
+     *  @brief Incorpora al prefiltro de publicaciones los niveles de un topic suscrito. Los niveles que siguen
+     *         a un '#' no se registran, ya que el prefiltro deja pasar cualquier publicacion desde ese nivel.
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic
+     */
+    static void prefilterAdd(const char* name, const MQ::topic_t* id){
+        MQ::TopicSpan spans[MQ::MAX_TOKEN_LEVEL];
+        uint8_t count = MQ::splitTopic(name, spans, MQ::MAX_TOKEN_LEVEL);
+        if(count > MQ::MAX_TOKEN_LEVEL){
+            count = MQ::MAX_TOKEN_LEVEL;
+        }
+        for(uint8_t i = 0; i < count; i++){
+            const char* token = &name[spans[i].from];
+            uint16_t len = spans[i].len;
+            if(len == 1 && token[0] == '#'){
+                _prefilter.all |= ((uint64_t)1 << i);
+                return;
+            }
+            // un token no resuelto encaja en el indice con cualquier otro no resuelto, por lo que se trata como '+'
+            if((len == 1 && token[0] == '+') || id->tk[i] == WildcardInvalid){
+                _prefilter.any |= ((uint64_t)1 << i);
+                continue;
+            }
+            uint32_t h = HashMap<MQ::token_t>::hash(token, len) & (MQ_PREFILTER_BITS - 1);
+            _prefilter.bits[i][h >> 5] |= ((uint32_t)1 << (h & 31));
+        }
+        if(count){
+            _prefilter.depth |= ((uint64_t)1 << (count - 1));
+        }
+    }
+
+
+    /** @fn prefilterMatch
+     *  @brief Chequea en el prefiltro si una publicacion puede encajar con alguna suscripcion, reconstruyendolo
+     *         antes si se han eliminado topics. Una suscripcion que encaja tiene '+' o el mismo token en cada
+     *         nivel anterior a su '#' (un '#' tambien encaja con el nivel padre), o en todos los niveles y la
+     *         misma profundidad si no tiene '#'.
+     *  @param name Nombre del topic publicado
+     *  @return False si no encaja con ninguna suscripcion, True si puede encajar
+     */
+    static bool prefilterMatch(const char* name){
+        if(_prefilter.dirty){
+            memset(&_prefilter, 0, sizeof(Prefilter));
+            for(uint32_t row = 0; row < _topic_table->getTopicCount(); row++){
+                prefilterAdd(_topic_table->getName(row), _topic_table->getId(row));
+            }
+        }
+        MQ::TopicSpan spans[MQ::MAX_TOKEN_LEVEL];
+        uint8_t count = MQ::splitTopic(name, spans, MQ::MAX_TOKEN_LEVEL);
+        if(count == 0 || count > MQ::MAX_TOKEN_LEVEL){
+            return true;
+        }
+        // niveles iniciales que encajan con algun token o '+' de su nivel
+        uint8_t prefix = 0;
+        for(; prefix < count; prefix++){
+            if(_prefilter.any & ((uint64_t)1 << prefix)){
+                continue;
+            }
+            uint32_t h = HashMap<MQ::token_t>::hash(&name[spans[prefix].from], spans[prefix].len) & (MQ_PREFILTER_BITS - 1);
+            if((_prefilter.bits[prefix][h >> 5] & ((uint32_t)1 << (h & 31))) == 0){
+                break;
+            }
+        }
+        if(prefix == count && (_prefilter.depth & ((uint64_t)1 << (count - 1)))){
+            return true;
+        }
+        // algun '#' en los niveles 0..prefix
+        return (_prefilter.all & ((prefix >= 63)? ~(uint64_t)0 : (((uint64_t)2 << prefix) - 1))) != 0;
+    }
+
+
+    /** @fn findSubscriber
+     *  @brief Busca la posicion de un suscriptor en los suscriptores de un topic
+     *  @param row Fila del topic
+     *  @param subscriber Manejador de las actualizaciones del topic
+     *  @return Posicion o -1 si no existe
+     */
+    static int32_t findSubscriber(uint32_t row, MQ::SubscribeCallback *subscriber){
+        MQ::Subscriber* sbc = _topic_table->getSubscribers(row);
+        for(uint16_t i = 0; i < _topic_table->getSubscriberCount(row); i++){
+            if(sbc[i].cb == subscriber){
+                return i;
+            }
+        }
+        return -1;
+    }
+
+
+    /** @fn addSubscriber
+     *  @brief Inserta un suscriptor al final de los suscriptores de un topic
+     *  @param row Fila del topic
+     *  @param sbc Suscriptor
+     *  @return Resultado
+     */
+    static int32_t addSubscriber(uint32_t row, const MQ::Subscriber* sbc){
+        int32_t rc = _topic_table->addSubscriber(row, *sbc);
+        if(rc != TopicTable<MQ::topic_t, MQ::Subscriber>::SUCCESS){
+            return (rc == TopicTable<MQ::topic_t, MQ::Subscriber>::LIMIT_EXCEEDED)? OUT_OF_BOUNDS : OUT_OF_MEMORY;
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn removeSubscriber
+     *  @brief Elimina un suscriptor de un topic, y el topic si se queda sin suscriptores. Durante un reparto
+     *         las filas y posiciones de la tabla no pueden cambiar, por lo que el suscriptor solo se marca como
+     *         cancelado y se elimina al finalizar el reparto raiz (ver purgeCancelled).
+     *  @param row Fila del topic
+     *  @param pos Posicion del suscriptor
+     */
+    static void removeSubscriber(uint32_t row, uint16_t pos){
+        if(_dispatch_depth > 0){
+            _topic_table->getSubscribers(row)[pos].cb = NULL;
+            _cancelled++;
+            return;
+        }
+        _topic_table->removeSubscriber(row, pos);
+        if(_topic_table->getSubscriberCount(row) == 0){
+            removeTopic(row);
+        }
+    }
+
+
+    /** @fn purgeCancelled
+     *  @brief Elimina los suscriptores cancelados durante un reparto, y los topics que se quedan vacios
+     */
+    static void purgeCancelled(){
+        _cancelled = 0;
+        // se recorre en orden inverso, ya que al eliminar un topic la ultima fila ocupa su posicion
+        for(uint32_t row = _topic_table->getTopicCount(); row-- > 0;){
+            MQ::Subscriber* sbc = _topic_table->getSubscribers(row);
+            for(uint16_t pos = _topic_table->getSubscriberCount(row); pos-- > 0;){
+                if(!sbc[pos].cb){
+                    _topic_table->removeSubscriber(row, pos);
+                }
+            }
+            if(_topic_table->getSubscriberCount(row) == 0){
+                removeTopic(row);
+            }
+        }
+        // los handles resueltos durante el reparto hacen referencia a posiciones que han cambiado
+        _generation++;
+    }
+
+
+    /** @fn deliver
+     *  @brief Entrega un mensaje a un suscriptor. Si la entrega sin copia no esta activa o el suscriptor
+     *         modifica el mensaje, se le entrega una copia restaurada desde el original, reservando el
+     *         buffer de copia la primera vez que se necesita.
+     *  @param name Nombre del topic
+     *  @param sbc Suscriptor
+     *  @param data Mensaje original
+     *  @param datasize Tamano del mensaje
+     *  @param mem_data Buffer de copia (NULL si aun no se ha reservado)
+     */
+    static void deliver(const char* name, MQ::Subscriber* sbc, void* data, uint32_t datasize, char** mem_data){
+        if((sbc->flags & MQ::SubscribeConflate) && !conflate(name, sbc, data, datasize)){
+            return;
+        }
+        if(_zero_copy && (sbc->flags & MQ::SubscribeMutable) == 0){
+            sbc->cb->call(name, data, datasize);
+            return;
+        }
+        if(!*mem_data){
+            *mem_data = (char*)Heap::memAlloc(datasize);
+            MBED_ASSERT(*mem_data);
+        }
+        // restaura el mensaje por si hubiera sufrido modificaciones en algun suscriptor
+        if(datasize){
+            memcpy(*mem_data, data, datasize);
+        }
+        sbc->cb->call(name, *mem_data, datasize);
+    }
+
+
+    /** @fn snapshotEnter
+     *  @brief Inicia una lectura de la instantanea vigente. El publicador se registra en la epoca actual
+     *         antes de leer la instantanea, de forma que una instantanea retirada no puede liberarse
+     *         mientras quede algun publicador que pudiera haberla leido (ver updateSnapshot). La epoca
+     *         puede haber cambiado entre su lectura y el registro, por lo que solo indica el contador
+     *         en el que se registra, no la instantanea leida.
+     *  @param epoch Recibe la epoca a indicar en snapshotExit
+     *  @return Instantanea vigente o NULL si el modo sin bloqueo no esta activo
+     */
+    static Snapshot* snapshotEnter(uint32_t* epoch){
+        *epoch = _rcu_epoch.load();
+        _rcu_readers[*epoch & 1].fetch_add(1);
+        return _snapshot.load();
+    }
+
+
+    /** @fn snapshotExit
+     *  @brief Finaliza una lectura de la instantanea
+     *  @param epoch Epoca obtenida en snapshotEnter
+     */
+    static void snapshotExit(uint32_t epoch){
+        _rcu_readers[epoch & 1].fetch_sub(1);
+    }
+
+
+    /** @fn publishSnapshot
+     *  @brief Notifica una publicacion a los suscriptores de la instantanea que encajan con ella
+     *  @param snap Instantanea
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion de la publicacion
+     */
+    static void publishSnapshot(Snapshot* snap, const char* name, const MQ::topic_t* id, void* data, uint32_t datasize, MQ::PublishCallback* publisher){
+        char* mem_data = NULL;
+        publisher->call(name, notifyTopics<SnapshotTopic>(snap->tree, name, id, data, datasize, &mem_data));
+        if(mem_data){
+            Heap::memFree(mem_data);
+        }
+    }
+
+
+    /** @fn notifyTopics
+     *  @brief Entrega una publicacion a los suscriptores de los topics del indice que encajan con ella
+     *  @param tree Indice de topics (del broker o de una instantanea)
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param mem_data Buffer de copia (NULL si aun no se ha reservado)
+     *  @return SUCCESS si se ha entregado a algun suscriptor, NOT_FOUND en otro caso
+     */
+    template<typename T, typename Tree>
+    static int32_t notifyTopics(Tree* tree, const char* name, const MQ::topic_t* id, void* data, uint32_t datasize, char** mem_data){
+        bool notify_subscriber = false;
+        auto notify = [&](T* topic){
+            if(notifyTopic(topic, name, data, datasize, mem_data)){
+                notify_subscriber = true;
+            }
+        };
+        MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+        tree->match(getKeys(id, keys), notify);
+        return (notify_subscriber)? SUCCESS : NOT_FOUND;
+    }
+
+
+    /** @fn notifyTopic
+     *  @brief Entrega una publicacion a los suscriptores de un topic del broker o de una instantanea
+     *  @return True si el topic tiene algun suscriptor
+     */
+    static bool notifyTopic(TopicRow* topic, const char* name, void* data, uint32_t datasize, char** mem_data){
+        bool notify_subscriber = false;
+        uint32_t row = refRow(topic);
+        DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Topic '%s' encontrado en '%s'. Buscando suscriptores...", name, _topic_table->getName(row));
+        // el tramo se relee en cada iteracion, ya que un suscriptor puede insertar otros y reubicarlo
+        for(uint16_t i = 0; i < _topic_table->getSubscriberCount(row); i++){
+            MQ::Subscriber *sbc = &_topic_table->getSubscribers(row)[i];
+            if(!sbc->cb){
+                continue;
+            }
+            DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Notificando topic update de '%s' al suscriptor %x", name, (uint32_t)sbc->cb);
+            notify_subscriber = true;
+            sampleStack();
+            deliver(name, sbc, data, datasize, mem_data);
+        }
+        return notify_subscriber;
+    }
+    static bool notifyTopic(SnapshotTopic* topic, const char* name, void* data, uint32_t datasize, char** mem_data){
+        for(uint16_t i = 0; i < topic->subscriber_count; i++){
+            deliver(name, &topic->subscribers[i], data, datasize, mem_data);
+        }
+        return (topic->subscriber_count > 0);
+    }
+
+
+    /** @fn publishAsync
+     *  @brief Encola una publicacion para los suscriptores de los topics del indice que encajan con ella.
+     *         El indice se recorre dos veces: una para dimensionar el mensaje encolado y otra para copiar
+     *         los suscriptores.
+     *  @param tree Indice de topics (del broker o de una instantanea)
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion de la publicacion
+     *  @return Resultado
+     */
+    template<typename T, typename Tree>
+    static int32_t publishAsync(Tree* tree, const char* name, const MQ::topic_t* id, void* data, uint32_t datasize, MQ::PublishCallback* publisher){
+        uint32_t count = 0;
+        auto counter = [&](T* topic){
+            count += getSubscriberCount(topic);
+        };
+        MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+        getKeys(id, keys);
+        tree->match(keys, counter);
+        DispatchJob* job = (count)? createJob(name, data, datasize, count) : NULL;
+        if(job){
+            auto copy = [&](T* topic){
+                addJobSubscribers(job, topic);
+            };
+            tree->match(keys, copy);
+        }
+        return dispatchJob(job, (job)? job->subscriber_count : count, name, publisher);
+    }
+
+
+    /** @fn getSubscriberCount
+     *  @brief Obtiene el numero de suscriptores de un topic del broker o de una instantanea, sin contar los
+     *         cancelados durante un reparto (que no se copian en el mensaje encolado)
+     */
+    static uint32_t getSubscriberCount(TopicRow* topic){
+        MQ::Subscriber* sbc = _topic_table->getSubscribers(refRow(topic));
+        uint32_t count = 0;
+        for(uint16_t i = 0; i < _topic_table->getSubscriberCount(refRow(topic)); i++){
+            if(sbc[i].cb){
+                count++;
+            }
+        }
+        return count;
+    }
+    static uint32_t getSubscriberCount(SnapshotTopic* topic){
+        return topic->subscriber_count;
+    }
+
+
+    /** @fn addJobSubscribers
+     *  @brief Copia los suscriptores de un topic del broker o de una instantanea en un mensaje encolado
+     */
+    static void addJobSubscribers(DispatchJob* job, TopicRow* topic){
+        MQ::Subscriber* sbc = _topic_table->getSubscribers(refRow(topic));
+        for(uint16_t i = 0; i < _topic_table->getSubscriberCount(refRow(topic)); i++){
+            if(sbc[i].cb){
+                addJobSubscriber(job, &sbc[i]);
+            }
+        }
+    }
+    static void addJobSubscribers(DispatchJob* job, SnapshotTopic* topic){
+        for(uint16_t i = 0; i < topic->subscriber_count; i++){
+            addJobSubscriber(job, &topic->subscribers[i]);
+        }
+    }
+
+
+    /** @fn addJobSubscriber
+     *  @brief Copia un suscriptor en un mensaje encolado, si cabe en el espacio reservado
+     *  @param job Mensaje
+     *  @param sbc Suscriptor
+     */
+    static void addJobSubscriber(DispatchJob* job, const MQ::Subscriber* sbc){
+        if(job->subscriber_count < job->subscriber_size){
+            MQ::Subscriber* s = &job->subscribers[job->subscriber_count++];
+            s->cb = sbc->cb;
+            s->flags = sbc->flags;
+            s->interval = sbc->interval;
+        }
+    }
+
+
+    /** @fn createJob
+     *  @brief Reserva un mensaje para su despacho asincrono, copiando el nombre del topic y el mensaje
+     *  @param name Nombre del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param subscriber_size Numero de suscriptores a los que se entregara
+     *  @return Mensaje o NULL si no hay memoria
+     */
+    static DispatchJob* createJob(const char* name, void* data, uint32_t datasize, uint32_t subscriber_size){
+        uint32_t name_len = strlen(name) + 1;
+        DispatchJob* job = (DispatchJob*)Heap::memAlloc(sizeof(DispatchJob) + (subscriber_size * sizeof(MQ::Subscriber)) + datasize + name_len);
+        if(!job){
+            return NULL;
+        }
+        memset(job, 0, sizeof(DispatchJob));
+        job->subscribers = (MQ::Subscriber*)(job + 1);
+        job->subscriber_size = subscriber_size;
+        job->data = (void*)(job->subscribers + subscriber_size);
+        job->datasize = datasize;
+        memcpy(job->data, data, datasize);
+        job->name = (char*)job->data + datasize;
+        memcpy(job->name, name, name_len);
+        return job;
+    }
+
+
+    /** @fn dispatchJob
+     *  @brief Encola un mensaje en el thread de despacho asignado a su topic e invoca la PublishCallback
+     *         si no hay suscriptores, si falla el encolado o si se notifica al encolar.
+     *  @param job Mensaje (NULL si no hay suscriptores o no hay memoria)
+     *  @param count Numero de suscriptores copiados en el mensaje, o que encajan con el topic si no hay mensaje
+     *  @param name Nombre del topic
+     *  @param publisher Callback de notificacion de la publicacion
+     *  @return Resultado
+     */
+    static int32_t dispatchJob(DispatchJob* job, uint32_t count, const char* name, MQ::PublishCallback* publisher){
+        if(!count){
+            if(job){
+                Heap::memFree(job);
+            }
+            publisher->call(name, NOT_FOUND);
+            return SUCCESS;
+        }
+        if(!job){
+            DEBUG_TRACE_E(true,"[MQLib].........", "ERR_DISPATCH. Sin memoria para encolar el topic %s", name);
+            publisher->call(name, OUT_OF_MEMORY);
+            return OUT_OF_MEMORY;
+        }
+        bool on_enqueue = (_dispatch_notify == MQ::NotifyOnEnqueued);
+        job->publisher = (on_enqueue)? NULL : publisher;
+
+        // los mensajes de un mismo topic se asignan siempre al mismo thread para conservar su orden
+        Dispatcher* d = &_dispatchers[HashMap<MQ::token_t>::hash(name, strlen(name)) % _dispatcher_count];
+        int32_t err = SUCCESS;
+        d->mutex.lock();
+        if(d->jobs.addItem(job, &job->node) != List<DispatchJob>::SUCCESS){
+            err = OUT_OF_MEMORY;
+        }
+        d->mutex.unlock();
+        if(err != SUCCESS){
+            DEBUG_TRACE_E(true,"[MQLib].........", "ERR_DISPATCH. Cola llena al encolar el topic %s", name);
+            Heap::memFree(job);
+            publisher->call(name, err);
+            return err;
+        }
+        d->pending.release();
+        if(on_enqueue){
+            publisher->call(name, SUCCESS);
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn runDispatcher
+     *  @brief Bucle de un thread de despacho: extrae los mensajes de su cola en orden, los entrega a sus
+     *         suscriptores y finaliza al vaciar la cola si se ha solicitado.
+     *  @param d Thread de despacho
+     */
+    static void runDispatcher(Dispatcher* d){
+        for(;;){
+            d->pending.wait();
+            d->mutex.lock();
+            DispatchJob* job = d->jobs.getFirstItem();
+            if(job){
+                d->jobs.removeNode(&job->node);
+            }
+            bool stop = d->stop;
+            d->mutex.unlock();
+            if(!job){
+                if(stop){
+                    return;
+                }
+                continue;
+            }
+            // la copia del mensaje pertenece al broker, por lo que admite la entrega sin copia
+            char* mem_data = NULL;
+            for(uint32_t i = 0; i < job->subscriber_count; i++){
+                deliver(job->name, &job->subscribers[i], job->data, job->datasize, &mem_data);
+            }
+            if(job->publisher){
+                job->publisher->call(job->name, SUCCESS);
+            }
+            if(mem_data){
+                Heap::memFree(mem_data);
+            }
+            Heap::memFree(job);
+        }
+    }
+
+
+    /** @fn checkEntry
+     *  @brief Verifica una entrada de una publicacion por lotes
+     *  @param entry Entrada
+     *  @return Resultado
+     */
+    static int32_t checkEntry(const MQ::PublishEntry* entry){
+        if(!entry->name || (entry->datasize && !entry->data)){
+            return NULL_POINTER;
+        }
+        if(strlen(entry->name) > _max_name_len){
+            return OUT_OF_BOUNDS;
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn getBatchMaxSize
+     *  @brief Obtiene el tamano del mayor mensaje de una publicacion por lotes
+     *  @param entries Entradas
+     *  @param count Numero de entradas
+     *  @return Tamano maximo
+     */
+    static uint32_t getBatchMaxSize(const MQ::PublishEntry* entries, uint16_t count){
+        uint32_t max_size = 0;
+        for(uint16_t i = 0; i < count; i++){
+            max_size = (entries[i].datasize > max_size)? entries[i].datasize : max_size;
+        }
+        return max_size;
+    }
+
+
+    /** @fn enterDispatch
+     *  @brief Inicia el reparto de una publicacion con bloqueo. En la publicacion raiz toma como referencia de
+     *         pila la direccion del nivel guardado; en un reparto recursivo incrementa el nivel de anidamiento.
+     *  @param level Recibe el nivel a restaurar en exitDispatch (debe ser una variable local del publicador)
+     */
+    static void enterDispatch(uint32_t* level){
+        *level = _dispatch_level;
+        if(_dispatch_depth == 0){
+            // al procesar la cola, el nivel lo fija la publicacion encolada
+            if(!_dispatch_draining){
+                _dispatch_level = 0;
+                _dispatch_stack = (uintptr_t)level;
+            }
+        }
+        else{
+            _dispatch_level++;
+        }
+        _dispatch_depth++;
+        if(_dispatch_level > _nested_stats.peak_level){
+            _nested_stats.peak_level = _dispatch_level;
+        }
+    }
+
+
+    /** @fn exitDispatch
+     *  @brief Finaliza el reparto de una publicacion con bloqueo. Al finalizar la publicacion raiz, procesa
+     *         las publicaciones anidadas encoladas, en orden de llegada.
+     *  @param level Nivel obtenido en enterDispatch
+     */
+    static void exitDispatch(uint32_t level){
+        _dispatch_depth--;
+        _dispatch_level = level;
+        if(_dispatch_depth == 0 && _cancelled){
+            purgeCancelled();
+        }
+        if(_dispatch_depth > 0 || _dispatch_draining || !_nested_list){
+            return;
+        }
+        _dispatch_draining = true;
+        DispatchJob* job;
+        while((job = _nested_list->getFirstItem()) != NULL){
+            _nested_list->removeNode(&job->node);
+            _dispatch_level = job->level;
+            publishReq(job->name, job->data, job->datasize, job->publisher, false);
+            Heap::memFree(job);
+        }
+        _dispatch_level = 0;
+        _dispatch_draining = false;
+    }
+
+
+    /** @fn retainedData
+     *  @brief Obtiene el mensaje y el nombre del topic de un mensaje retenido, ubicados tras la cabecera
+     */
+    static uint8_t* retainedData(Retained* ret){
+        return (uint8_t*)(ret + 1);
+    }
+    static char* retainedName(Retained* ret){
+        return (char*)(retainedData(ret) + ret->datasize);
+    }
+
+
+    /** @fn retainMessage
+     *  @brief Guarda el ultimo mensaje retenido de un topic, sustituyendo al anterior. El mensaje nuevo se
+     *         construye antes de eliminar el anterior, que se conserva si no puede guardarse. Un mensaje
+     *         vacio solo elimina el anterior.
+     *  @param name Nombre del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @return Resultado
+     */
+    static int32_t retainMessage(const char* name, void* data, uint32_t datasize){
+        if(!_retained_list){
+            return DEINIT;
+        }
+        Retained* old = NULL;
+        _retained_index->getItem(name, &old);
+        uint32_t size = (sizeof(Retained) + datasize + strlen(name) + 1 + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+        if(datasize){
+            if(size > _retained_budget){
+                return OUT_OF_BOUNDS;
+            }
+            if(_retained_eviction == MQ::RetainRejectNew && (_retained_bytes - ((old)? old->size : 0) + size) > _retained_budget){
+                return OUT_OF_MEMORY;
+            }
+        }
+        if(!datasize){
+            if(old){
+                removeRetained(old);
+            }
+            return SUCCESS;
+        }
+        if(_tokenlist_internal && !generateTokens(name)){
+            return OUT_OF_MEMORY;
+        }
+        Retained* ret = (Retained*)Heap::memAlloc(size);
+        if(!ret){
+            return OUT_OF_MEMORY;
+        }
+        if(!createTopicId(&ret->id, name)){
+            Heap::memFree(ret);
+            return OUT_OF_BOUNDS;
+        }
+        ret->datasize = datasize;
+        ret->size = size;
+        memcpy(retainedData(ret), data, datasize);
+        strcpy(retainedName(ret), name);
+        // sustituye al anterior y hace sitio descartando los mensajes actualizados hace mas tiempo. Al
+        // eliminar antes el anterior, el indice no necesita crecer para insertar el nuevo
+        if(old){
+            removeRetained(old);
+        }
+        evictRetained(size);
+        if(_retained_index->addItem(retainedName(ret), ret) != HashMap<Retained*>::SUCCESS){
+            Heap::memFree(ret);
+            return OUT_OF_MEMORY;
+        }
+        _retained_list->addItem(ret, &ret->node);
+        _retained_bytes += size;
+        refTokens(&ret->id, 1);
+        return SUCCESS;
+    }
+
+
+    /** @fn removeRetained
+     *  @brief Elimina un mensaje retenido del almacen
+     *  @param ret Mensaje retenido
+     */
+    static void removeRetained(Retained* ret){
+        refTokens(&ret->id, -1);
+        _retained_index->removeItem(retainedName(ret));
+        _retained_list->removeNode(&ret->node);
+        _retained_bytes -= ret->size;
+        Heap::memFree(ret);
+    }
+
+
+    /** @fn evictRetained
+     *  @brief Descarta los mensajes retenidos actualizados hace mas tiempo hasta que quepa un mensaje nuevo
+     *         en el presupuesto
+     *  @param size Memoria que requiere el mensaje nuevo
+     */
+    static void evictRetained(uint32_t size){
+        Retained* ret;
+        while((_retained_bytes + size) > _retained_budget && (ret = _retained_list->getFirstItem()) != NULL){
+            DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Descartando mensaje retenido en topic %s", retainedName(ret));
+            removeRetained(ret);
+        }
+    }
+
+
+    /** @fn replayRetained
+     *  @brief Entrega a un nuevo suscriptor los mensajes retenidos de los topics que encajan con su suscripcion,
+     *         con las mismas opciones de entrega que una publicacion (agregacion y entrega sin copia). Los
+     *         mensajes se copian antes de entregarlos, ya que el suscriptor puede publicar nuevos mensajes
+     *         retenidos durante la entrega.
+     *  @param id Identificador del topic de la suscripcion
+     *  @param sbc Suscriptor
+     */
+    static void replayRetained(MQ::topic_t* id, MQ::Subscriber* sbc){
+        if(!_retained_list){
+            return;
+        }
+        uint32_t size = 0;
+        for(Retained* ret : *_retained_list){
+            if(matchIds(id, &ret->id)){
+                size += ret->size;
+            }
+        }
+        if(!size){
+            return;
+        }
+        uint8_t* copy = (uint8_t*)Heap::memAlloc(size);
+        if(!copy){
+            DEBUG_TRACE_E(true,"[MQLib].........", "ERR_RETAIN. Sin memoria para entregar los mensajes retenidos");
+            return;
+        }
+        uint32_t offset = 0;
+        for(Retained* ret : *_retained_list){
+            if(matchIds(id, &ret->id)){
+                memcpy(&copy[offset], ret, ret->size);
+                offset += ret->size;
+            }
+        }
+        uint32_t level;
+        enterDispatch(&level);
+        for(offset = 0; offset < size; offset += ((Retained*)&copy[offset])->size){
+            Retained* ret = (Retained*)&copy[offset];
+            char* mem_data = NULL;
+            deliver(retainedName(ret), sbc, retainedData(ret), ret->datasize, &mem_data);
+            if(mem_data){
+                Heap::memFree(mem_data);
+            }
+        }
+        exitDispatch(level);
+        Heap::memFree(copy);
+    }
+
+
+    /** @fn conflateClock
+     *  @brief Obtiene el instante actual (ms) para los intervalos de entrega
+     */
+    static uint32_t conflateClock(){
+        return (uint32_t)(_conflate_clock.read_high_resolution_us() / 1000);
+    }
+
+
+    /** @fn conflateName
+     *  @brief Obtienen el nombre del topic de un slot, y el mensaje y nombre del topic de un mensaje pendiente,
+     *         ubicados tras su cabecera
+     */
+    static char* conflateName(ConflateSlot* slot){
+        return (char*)(slot + 1);
+    }
+    static uint8_t* conflateValueData(ConflateValue* value){
+        return (uint8_t*)(value + 1);
+    }
+    static char* conflateValueName(ConflateValue* value){
+        return (char*)(conflateValueData(value) + value->capacity);
+    }
+
+
+    /** @fn conflate
+     *  @brief Aplica una publicacion a una suscripcion MQ::SubscribeConflate. Si el topic no tiene un mensaje
+     *         pendiente y ha vencido su intervalo minimo, el mensaje se entrega directamente; en otro caso
+     *         sustituye al mensaje pendiente, que se entregara al vencer el intervalo.
+     *  @param name Nombre del topic
+     *  @param sbc Suscriptor
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @return True si el mensaje debe entregarse directamente
+     */
+    static bool conflate(const char* name, MQ::Subscriber* sbc, void* data, uint32_t datasize){
+        bool deliver_now = true;
+        _conflate_mutex.lock();
+        uint32_t now = conflateClock();
+        ConflateSlot* slot = findConflateSlot(name, sbc->cb);
+        if(!slot){
+            // primera publicacion del topic, se entrega y abre el intervalo
+            createConflateSlot(name, sbc, now);
+        }
+        else if(!slot->value && (now - slot->last) >= slot->interval){
+            slot->last = now;
+        }
+        else{
+            ConflateValue* value = slot->value;
+            if(!value || value->capacity < datasize){
+                uint32_t name_len = strlen(name) + 1;
+                value = (ConflateValue*)Heap::memAlloc(sizeof(ConflateValue) + datasize + name_len);
+                if(value){
+                    value->capacity = datasize;
+                    memcpy(conflateValueName(value), name, name_len);
+                    if(slot->value){
+                        Heap::memFree(slot->value);
+                    }
+                    slot->value = value;
+                }
+            }
+            // sin memoria para el mensaje pendiente, se entrega directamente para no perderlo
+            if(value){
+                value->datasize = datasize;
+                memcpy(conflateValueData(value), data, datasize);
+                deliver_now = false;
+            }
+        }
+        _conflate_mutex.unlock();
+        return deliver_now;
+    }
+
+
+    /** @fn findConflateSlot
+     *  @brief Busca el slot de un topic en una suscripcion MQ::SubscribeConflate
+     *  @param name Nombre del topic
+     *  @param cb Suscriptor
+     *  @return Slot o NULL si no existe
+     */
+    static ConflateSlot* findConflateSlot(const char* name, MQ::SubscribeCallback* cb){
+        ConflateSlot* slot = NULL;
+        if(_conflate_index && _conflate_index->getItem(name, &slot)){
+            while(slot && slot->cb != cb){
+                slot = slot->next;
+            }
+        }
+        return slot;
+    }
+
+
+    /** @fn createConflateSlot
+     *  @brief Crea el slot de un topic en una suscripcion MQ::SubscribeConflate
+     *  @param name Nombre del topic
+     *  @param sbc Suscriptor
+     *  @param now Instante de la entrega que abre el intervalo
+     */
+    static void createConflateSlot(const char* name, MQ::Subscriber* sbc, uint32_t now){
+        if(!_conflate_list){
+            _conflate_list = new List<ConflateSlot>();
+            _conflate_index = new HashMap<ConflateSlot*>();
+            MBED_ASSERT(_conflate_list && _conflate_index);
+        }
+        ConflateSlot* slot = (ConflateSlot*)Heap::memAlloc(sizeof(ConflateSlot) + strlen(name) + 1);
+        if(!slot){
+            return;
+        }
+        slot->cb = sbc->cb;
+        slot->interval = sbc->interval;
+        slot->last = now;
+        slot->pass = 0;
+        slot->value = NULL;
+        slot->next = NULL;
+        strcpy(conflateName(slot), name);
+        ConflateSlot* head = NULL;
+        if(_conflate_index->getItem(name, &head)){
+            slot->next = head->next;
+            head->next = slot;
+        }
+        else if(_conflate_index->addItem(conflateName(slot), slot) != HashMap<ConflateSlot*>::SUCCESS){
+            Heap::memFree(slot);
+            return;
+        }
+        _conflate_list->addItem(slot, &slot->node);
+    }
+
+
+    /** @fn removeConflateSlot
+     *  @brief Elimina el slot de un topic en una suscripcion MQ::SubscribeConflate, descartando su mensaje
+     *         pendiente
+     *  @param slot Slot
+     */
+    static void removeConflateSlot(ConflateSlot* slot){
+        ConflateSlot* head = NULL;
+        _conflate_index->getItem(conflateName(slot), &head);
+        if(head == slot){
+            _conflate_index->removeItem(conflateName(slot));
+            if(slot->next){
+                _conflate_index->addItem(conflateName(slot->next), slot->next);
+            }
+        }
+        else{
+            while(head && head->next != slot){
+                head = head->next;
+            }
+            if(head){
+                head->next = slot->next;
+            }
+        }
+        _conflate_list->removeNode(&slot->node);
+        if(slot->value){
+            Heap::memFree(slot->value);
+        }
+        Heap::memFree(slot);
+    }
+
+
+    /** @fn removeConflated
+     *  @brief Elimina los slots de un suscriptor en los topics que encajan con una suscripcion cancelada
+     *  @param cb Suscriptor
+     *  @param id Identificador del topic de la suscripcion
+     */
+    static void removeConflated(MQ::SubscribeCallback* cb, MQ::topic_t* id){
+        _conflate_mutex.lock();
+        if(_conflate_list){
+            for(ConflateSlot* slot : *_conflate_list){
+                MQ::topic_t slot_id;
+                if(slot->cb == cb){
+                    createTopicId(&slot_id, conflateName(slot));
+                    if(matchIds(id, &slot_id)){
+                        removeConflateSlot(slot);
+                    }
+                }
+            }
+        }
+        _conflate_mutex.unlock();
+    }
+
+
+    /** @fn runConflateFlush
+     *  @brief Tarea del broker que entrega periodicamente los mensajes pendientes cuyo intervalo ha vencido
+     */
+    static void runConflateFlush(){
+        while(!_flush_stop){
+            _flush_wakeup.wait(_flush_period);
+            flushConflatedReq();
+        }
+    }
+
+
+    /** @fn queueNested
+     *  @brief Encola una publicacion realizada durante un reparto, con una copia del mensaje
+     *  @param name Nombre del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion, que se invoca al procesarla o al descartarla
+     *  @return Resultado
+     */
+    static int32_t queueNested(const char* name, void* data, uint32_t datasize, MQ::PublishCallback* publisher){
+        int32_t err = SUCCESS;
+        DispatchJob* job = NULL;
+        if(_dispatch_level >= _nested_max_depth){
+            err = OUT_OF_BOUNDS;
+        }
+        else if((job = createJob(name, data, datasize, 0)) == NULL){
+            err = OUT_OF_MEMORY;
+        }
+        else{
+            job->publisher = publisher;
+            job->level = _dispatch_level + 1;
+            if(_nested_list->addItem(job, &job->node) != List<DispatchJob>::SUCCESS){
+                Heap::memFree(job);
+                err = OUT_OF_BOUNDS;
+            }
+        }
+        if(err != SUCCESS){
+            DEBUG_TRACE_W(_defdbg,"[MQLib].........", "Publicacion anidada descartada en topic %s, nivel %d", name, _dispatch_level + 1);
+            _nested_stats.rejected++;
+            publisher->call(name, err);
+            return err;
+        }
+        if(_nested_list->getItemCount() > _nested_stats.peak_queue){
+            _nested_stats.peak_queue = _nested_list->getItemCount();
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn sampleStack
+     *  @brief Registra el uso de pila desde la publicacion raiz hasta este punto (la pila crece hacia abajo)
+     */
+    static void sampleStack(){
+        uint8_t mark;
+        uintptr_t sp = (uintptr_t)&mark;
+        if(_dispatch_stack > sp && (_dispatch_stack - sp) > _nested_stats.peak_stack){
+            _nested_stats.peak_stack = _dispatch_stack - sp;
+        }
+    }
+
+
+    /** @fn enqueueIsrRequest
+     *  @brief Copia una solicitud en una entrada libre de la cola de publicaciones desde interrupcion. La
+     *         cola solo utiliza operaciones atomicas, por lo que admite llamadas desde interrupcion y desde
+     *         varios productores a la vez.
+     *  @param name Nombre del topic (NULL si se publica por handle)
+     *  @param len Longitud del nombre
+     *  @param handle Handle de publicacion (NULL si se publica por nombre)
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion (opcional)
+     *  @return Resultado
+     */
+    static int32_t enqueueIsrRequest(const char* name, uint32_t len, MQ::PublishHandle* handle, const void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+        if(!_isr_queue){
+            return DEINIT;
+        }
+        if(datasize > DefaultMaxIsrPayload || (datasize && !data)){
+            return OUT_OF_BOUNDS;
+        }
+        IsrRequest* req = _isr_queue->reserve();
+        if(!req){
+            return OUT_OF_MEMORY;
+        }
+        req->handle = handle;
+        req->publisher = publisher;
+        req->datasize = datasize;
+        if(name){
+            memcpy(req->name, name, len + 1);
+        }
+        if(datasize){
+            memcpy(req->data, data, datasize);
+        }
+        _isr_queue->commit(req);
+        // despierta a la tarea de vaciado solo si no tiene ya un aviso pendiente
+        if(_isr_thread && !_isr_signaled.exchange(true)){
+            _isr_pending.release();
+        }
+        return SUCCESS;
+    }
+
+
+    /** @fn runIsrQueue
+     *  @brief Tarea del broker que vacia la cola de publicaciones desde interrupcion. Ademas del aviso de
+     *         los productores, revisa la cola periodicamente por si algun aviso se hubiera perdido.
+     */
+    static void runIsrQueue(){
+        while(!_isr_stop){
+            _isr_pending.wait(DefaultIsrDrainPeriod);
+            processIsrRequests();
+        }
+    }
+
+
+    /** @fn nullPublishedCb
+     *  @brief Callback de notificacion para las publicaciones sin PublishCallback
+     */
+    static void nullPublishedCb(const char*, int32_t){
+    }
+
+
+    /** @fn stopDispatchers
+     *  @brief Vuelve al despacho sincrono y finaliza el pool de threads de despacho, esperando a que
+     *         entreguen los mensajes pendientes. No retiene el mutex del broker mientras espera, ya que
+     *         los suscriptores pueden publicar desde los threads de despacho.
+     */
+    static void stopDispatchers(){
+        lockBroker();
+        Dispatcher* dispatchers = _dispatchers;
+        uint8_t count = _dispatcher_count;
+        _dispatchers = NULL;
+        _dispatcher_count = 0;
+        unlockBroker();
+        if(!dispatchers){
+            return;
+        }
+        for(uint8_t i = 0; i < count; i++){
+            dispatchers[i].mutex.lock();
+            dispatchers[i].stop = true;
+            dispatchers[i].mutex.unlock();
+            dispatchers[i].pending.release();
+        }
+        for(uint8_t i = 0; i < count; i++){
+            dispatchers[i].thread.join();
+        }
+        delete[] dispatchers;
+    }
+
+
+    /** @fn createSnapshot
+     *  @brief Crea una instantanea del conjunto de suscripciones actual. Requiere el mutex del broker.
+     *  @return Instantanea o NULL si no hay memoria
+     */
+    static Snapshot* createSnapshot(){
+        Snapshot* snap = (Snapshot*)Heap::memAlloc(sizeof(Snapshot));
+        if(!snap){
+            return NULL;
+        }
+        memset(snap, 0, sizeof(Snapshot));
+        snap->token_generation = _token_generation;
+        uint32_t topic_count = _topic_table->getTopicCount();
+        uint32_t subscriber_count = _topic_table->getSubscriberTotal();
+        TopicTree<SnapshotTopic, MQ::key_t>* tree = new TopicTree<SnapshotTopic, MQ::key_t>(MQ::MAX_TOKEN_LEVEL);
+        snap->tree = tree;
+        snap->dict = new HashMap<MQ::token_t>(_token_provider_count);
+        if(topic_count){
+            snap->topics = (SnapshotTopic*)Heap::memAlloc(topic_count * sizeof(SnapshotTopic));
+        }
+        if(subscriber_count){
+            snap->subscribers = (MQ::Subscriber*)Heap::memAlloc(subscriber_count * sizeof(MQ::Subscriber));
+        }
+        if(!tree || !snap->dict || (topic_count && !snap->topics) || (subscriber_count && !snap->subscribers)){
+            destroySnapshot(snap);
+            return NULL;
+        }
+
+        // copia el diccionario de tokens
+        for(uint32_t i = 0; i < (_token_provider_count - WildcardCOUNT); i++){
+            if(snap->dict->addItem(_token_provider[i], (MQ::token_t)(i + WildcardCOUNT)) != HashMap<MQ::token_t>::SUCCESS){
+                destroySnapshot(snap);
+                return NULL;
+            }
+        }
+
+        // copia los topics y sus suscriptores
+        SnapshotTopic* st = snap->topics;
+        MQ::Subscriber* sbc = snap->subscribers;
+        for(uint32_t row = 0; row < topic_count; row++){
+            st->subscribers = sbc;
+            st->subscriber_count = 0;
+            MQ::Subscriber* s = _topic_table->getSubscribers(row);
+            for(uint16_t i = 0; i < _topic_table->getSubscriberCount(row); i++, s++){
+                if(!s->cb){
+                    continue;
+                }
+                sbc->cb = s->cb;
+                sbc->flags = s->flags;
+                sbc->interval = s->interval;
+                sbc++;
+                st->subscriber_count++;
+            }
+            MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+            if(tree->addItem(getKeys(_topic_table->getId(row), keys), st) != TopicTree<SnapshotTopic, MQ::key_t>::SUCCESS){
+                destroySnapshot(snap);
+                return NULL;
+            }
+            st++;
+        }
+        return snap;
+    }
+
+
+    /** @fn destroySnapshot
+     *  @brief Libera una instantanea
+     *  @param snap Instantanea
+     */
+    static void destroySnapshot(Snapshot* snap){
+        delete(snap->tree);
+        delete(snap->dict);
+        if(snap->topics){
+            Heap::memFree(snap->topics);
+        }
+        if(snap->subscribers){
+            Heap::memFree(snap->subscribers);
+        }
+        Heap::memFree(snap);
+    }
+
+
+    /** @fn updateSnapshot
+     *  @brief Sustituye la instantanea vigente por una nueva (o por ninguna si el modo sin bloqueo no esta
+     *         activo), retira la anterior y libera las retiradas que ya no estan en uso. Si no hay memoria
+     *         para la nueva instantanea, desactiva el modo sin bloqueo para no publicar sobre una instantanea
+     *         obsoleta. Requiere el mutex del broker.
+     *  @return Resultado
+     */
+    static int32_t updateSnapshot(){
+        int32_t err = SUCCESS;
+        Snapshot* snap = NULL;
+        if(_lock_free){
+            if((snap = createSnapshot()) == NULL){
+                DEBUG_TRACE_E(true,"[MQLib].........", "ERR_SNAPSHOT. Sin memoria, se desactiva la publicacion sin bloqueo");
+                _lock_free = false;
+                err = OUT_OF_MEMORY;
+            }
+        }
+        Snapshot* old = _snapshot.exchange(snap);
+        if(old){
+            // cambia de epoca, de forma que los publicadores que entren a partir de ahora se registran en el
+            // otro contador y el de la epoca anterior puede vaciarse
+            _rcu_epoch.fetch_add(1);
+            old->drained = 0;
+            old->next = _retired;
+            _retired = old;
+        }
+        // una instantanea retirada se libera tras un periodo de gracia completo, cuando ambos contadores se
+        // han visto vacios despues de retirarla. Un publicador que la haya leido se registro antes de leerla,
+        // aunque sea en el contador de una epoca anterior, por lo que mantiene uno de los dos sin vaciar.
+        uint8_t drained = ((_rcu_readers[0].load() == 0)? 1 : 0) | ((_rcu_readers[1].load() == 0)? 2 : 0);
+        Snapshot** prev = &_retired;
+        while(*prev){
+            Snapshot* retired = *prev;
+            retired->drained |= drained;
+            if(retired->drained == 3){
+                *prev = retired->next;
+                destroySnapshot(retired);
+            }
+            else{
+                prev = &retired->next;
+            }
+        }
+        return err;
+    }
+
+
+    /** @fn refreshHandle
+     *  @brief Actualiza el identificador y la lista de suscriptores de un handle de publicacion
+     *  @param handle Handle de publicacion
+     *  @return Resultado
+     */
+    static int32_t refreshHandle(MQ::PublishHandle* handle){
+        // si el nombre excede el tamano maximo, no lo permite
+        if(strlen(handle->name) > _max_name_len){
+            return OUT_OF_BOUNDS;
+        }
+        // si no puede encajar con ninguna suscripcion, queda sin suscriptores y sin registrar tokens. El handle
+        // no se marca como vigente, por lo que se vuelve a comprobar en cada publicacion y no usa la instantanea
+        if(_prefilter_enabled && !prefilterMatch(handle->name)){
+            if(!createTopicId(&handle->id, handle->name)){
+                return OUT_OF_BOUNDS;
+            }
+            handle->topic_count = 0;
+            handle->generation = 0;
+            return SUCCESS;
+        }
+        // si la lista de tokens es automantenida, crea los ids de los tokens no existentes
+        if(_tokenlist_internal){
+            if(!generateTokens(handle->name)){
+                return OUT_OF_MEMORY;
+            }
+        }
+        if(!createTopicId(&handle->id, handle->name)){
+            return OUT_OF_BOUNDS;
+        }
+
+        // recopila las filas de todos los topics que encajan
+        int32_t err = SUCCESS;
+        handle->topic_count = 0;
+        auto collect = [&](TopicRow* topic){
+            if(!MQ::appendItem(handle->topics, handle->topic_count, handle->topic_size, refRow(topic))){
+                err = OUT_OF_MEMORY;
+            }
+        };
+        MQ::key_t keys[MQ::MAX_TOKEN_LEVEL+1];
+        _topic_tree->match(getKeys(&handle->id, keys), collect);
+        DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Handle '%s' resuelto con %d topics", handle->name, handle->topic_count);
+        handle->generation = (err == SUCCESS)? _generation : 0;
+        return err;
+    }
+
+
+    /** @fn growTokenProvider
+     *  @brief Duplica la capacidad de la lista de tokens auto-gestionada, sin superar el maximo configurado
+     *  @return True si se ha ampliado, False si esta en el maximo o no hay memoria
+     */
+    static bool growTokenProvider(){
+        if(_token_provider_size >= DefaultMaxNumTokenEntries){
+            return false;
+        }
+        uint32_t size = ((_token_provider_size << 1) < DefaultMaxNumTokenEntries)? (_token_provider_size << 1) : DefaultMaxNumTokenEntries;
+        const char** provider = (const char**)Heap::memAlloc(size * sizeof(const char*));
+        uint32_t* refs = (uint32_t*)Heap::memAlloc(size * sizeof(uint32_t));
+        if(!provider || !refs){
+            if(provider){
+                Heap::memFree(provider);
+            }
+            if(refs){
+                Heap::memFree(refs);
+            }
+            return false;
+        }
+        memcpy(provider, _token_provider, _token_provider_size * sizeof(const char*));
+        memcpy(refs, _token_refs, _token_provider_size * sizeof(uint32_t));
+        Heap::memFree(_token_provider);
+        Heap::memFree(_token_refs);
+        _token_provider = provider;
+        _token_refs = refs;
+        _token_provider_size = size;
+        return true;
+    }
+
+
+    /** @fn generateTokens 
+     *  @brief Genera los tokens no existentes en la lista auto-gestionada. Los tokens nuevos no tienen
+     *         referencias hasta que los utiliza un topic suscrito o un mensaje retenido.
+     *  @param name nombre del topic a procesar
+     *  @param collect Flag para permitir una pasada de recoleccion si el diccionario esta casi lleno. Debe
+     *         ser false mientras se conserven identificadores obtenidos previamente.
+     *  @return True Topic insertado, False error en el topic
+     */
+    static bool generateTokens(const char* name, bool collect = true){
+        if(collect){
+            reclaimTokens();
+        }
+        MQ::TopicSpan spans[MQ::MAX_TOKEN_LEVEL];
+        uint8_t count = MQ::splitTopic(name, spans, MQ::MAX_TOKEN_LEVEL);
+        // los niveles que exceden la profundidad maxima se descartan al crear el identificador
+        if(count > MQ::MAX_TOKEN_LEVEL){
+            count = MQ::MAX_TOKEN_LEVEL;
+        }
+        uint8_t num = 0;
+        for(uint8_t i = 0; i < count; i++){
+            const char* token = &name[spans[i].from];
+            uint16_t len = spans[i].len;
+            // los niveles numericos se codifican por su valor, sin registrar un token
+            if(num < MQ::MAX_NUMERIC_LEVELS && isNumeric(token, len, NULL)){
+                num++;
+            }
+            // si el token ya existe o es un wildcard, pasa al siguiente
+            else if(isWildcard(token, len) || _token_dict->getItem(token, len, NULL)){
+            	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "El token ya existe");
+            }
+            // si no existe lo a�ade, siempre que quede espacio en el diccionario
+            else{
+                if((_token_provider_count - WildcardCOUNT) >= DefaultMaxNumTokenEntries){
+                    DEBUG_TRACE_E(true,"[MQLib].........", "ERR_TOKEN. Diccionario de tokens lleno en topic %s", name);
+                    return false;
+                }
+                // si la lista de tokens esta completa, duplica su capacidad
+                if((_token_provider_count - WildcardCOUNT) >= _token_provider_size && !growTokenProvider()){
+                    return false;
+                }
+                char* new_token = (char*)Heap::memAlloc(len + 1);
+                if(!new_token){
+                    return false;
+                }
+                strncpy(new_token, token, len); new_token[len] = 0;
+                if(_token_dict->addItem(new_token, (MQ::token_t)_token_provider_count) != HashMap<MQ::token_t>::SUCCESS){
+                    Heap::memFree(new_token);
+                    return false;
+                }
+                _token_provider[_token_provider_count-WildcardCOUNT] = new_token;
+                _token_refs[_token_provider_count-WildcardCOUNT] = 0;
+                _token_provider_count++;
+                _token_unreferenced++;
+                DEBUG_TRACE_D(_defdbg,"[MQLib].........", "A�adido token %s", new_token);
+            }
+        }
+        return true;
+    }
 
-    /** L�mite de tama�o en nombres de topcis */
-    static uint8_t _max_name_len;
  
-    /** Flag de depuraci�n */
-    static bool _defdbg;
 
-    /** Estructura de datos de una solicitud pendiente
-     *
+    /** @fn refTokens
+     *  @brief Actualiza las referencias de los tokens de un identificador
+     *  @param id Identificador del topic
+     *  @param delta Referencias a sumar (1) o restar (-1)
      */
-    struct PendingRequest_t{
-    	PendingRequestType type;
-    	char* topic;
-    	void *msg;
-    	uint32_t msg_len;
-    	SubscribeCallback *sub_cb;
-    	PublishCallback *pub_cb;
-    };
+    static void refTokens(const MQ::topic_t* id, int32_t delta){
+        for(uint8_t i = 0; i < MQ::MAX_TOKEN_LEVEL && id->tk[i] != WildcardNotUsed; i++){
+            if(id->tk[i] < WildcardCOUNT){
+                continue;
+            }
+            uint32_t idx = id->tk[i] - WildcardCOUNT;
+            if(delta > 0 && _token_refs[idx]++ == 0){
+                _token_unreferenced--;
+            }
+            else if(delta < 0 && --_token_refs[idx] == 0){
+                _token_unreferenced++;
+                if(idx < _token_low){
+                    _token_low = idx;
+                }
+            }
+        }
+    }
+
+
+    /** @fn reclaimTokens
+     *  @brief Lanza una pasada automatica de recoleccion si el diccionario no tiene hueco para los tokens de un
+     *         topic y hay tokens sin referencias. Durante un reparto no se realiza, ya que el indice esta en uso.
+     */
+    static void reclaimTokens(){
+        if(_token_collect_budget && _token_unreferenced && _dispatch_depth == 0 &&
+           (_token_provider_count - WildcardCOUNT + MQ::MAX_TOKEN_LEVEL) > DefaultMaxNumTokenEntries){
+            collectTokens(_token_collect_budget);
+        }
+    }
+
+
+    /** @fn releaseToken
+     *  @brief Libera un token sin referencias, eliminandolo del diccionario
+     *  @param idx Posicion del token en la lista
+     */
+    static void releaseToken(uint32_t idx){
+        _token_dict->removeItem(_token_provider[idx]);
+        Heap::memFree((void*)_token_provider[idx]);
+        _token_provider[idx] = NULL;
+        _token_unreferenced--;
+        _token_collect_stats.freed++;
+    }
+
+
+    /** @fn collectTokens
+     *  @brief Pasada incremental de recoleccion de tokens (ver collectTokensReq). Cada paso libera los tokens
+     *         sin referencias del final de la lista y traslada los ultimos tokens a los huecos inferiores, de
+     *         forma que la lista permanece compacta entre pasos.
+     *  @param budget_us Duracion maxima de la pasada (us)
+     */
+    static void collectTokens(uint32_t budget_us){
+        if(!_tokenlist_internal || !_token_unreferenced){
+            return;
+        }
+        Timer tm;
+        tm.start();
+        uint32_t used = _token_provider_count - WildcardCOUNT;
+        do{
+            MQ::key_t from[DefaultTokenCollectBatch], to[DefaultTokenCollectBatch];
+            uint8_t moves = 0;
+            for(;;){
+                while(used > 0 && _token_refs[used - 1] == 0){
+                    releaseToken(--used);
+                }
+                while(_token_low < used && _token_refs[_token_low] != 0){
+                    _token_low++;
+                }
+                if(_token_low >= used || moves >= DefaultTokenCollectBatch){
+                    break;
+                }
+                // el ultimo token tiene referencias: ocupa el hueco del primero que no las tiene
+                releaseToken(_token_low);
+                used--;
+                _token_provider[_token_low] = _token_provider[used];
+                _token_refs[_token_low] = _token_refs[used];
+                _token_provider[used] = NULL;
+                _token_dict->setItem(_token_provider[_token_low], (MQ::token_t)(_token_low + WildcardCOUNT));
+                from[moves] = used + WildcardCOUNT;
+                to[moves] = _token_low + WildcardCOUNT;
+                moves++;
+                _token_low++;
+            }
+            _token_provider_count = used + WildcardCOUNT;
+            if(_token_low > used){
+                _token_low = used;
+            }
+            if(moves){
+                rewriteTokens(from, to, moves);
+                _token_collect_stats.moved += moves;
+            }
+        }while(_token_unreferenced && (uint32_t)tm.read_us() < budget_us);
+
+        // los identificadores obtenidos antes de la pasada dejan de ser validos
+        _generation++;
+        _token_generation = _generation;
+        if(_lock_free){
+            updateSnapshot();
+        }
+        uint32_t pause = tm.read_us();
+        _token_collect_stats.passes++;
+        if(pause > _token_collect_stats.peak_pause){
+            _token_collect_stats.peak_pause = pause;
+        }
+        DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Recoleccion de tokens en %dus, quedan %d tokens", pause, used);
+    }
+
 
-    /** Lista de acciones pendientes por mutex bloqueado */
-    static List<PendingRequest_t> *_pending_list;
+    /** @fn rewriteTokens
+     *  @brief Sustituye los tokens trasladados en los identificadores de los topics, del indice y de los
+     *         mensajes retenidos
+     *  @param from Identificadores anteriores
+     *  @param to Identificadores nuevos
+     *  @param count Numero de tokens trasladados
+     */
+    static void rewriteTokens(const MQ::key_t* from, const MQ::key_t* to, uint8_t count){
+        auto rewrite = [&](MQ::topic_t* id){
+            bool changed = false;
+            for(uint8_t i = 0; i < MQ::MAX_TOKEN_LEVEL && id->tk[i] != WildcardNotUsed; i++){
+                for(uint8_t k = 0; k < count; k++){
+                    if(id->tk[i] == from[k]){
+                        id->tk[i] = (MQ::token_t)to[k];
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+            return changed;
+        };
+        for(uint32_t row = 0; row < _topic_table->getTopicCount(); row++){
+            MQ::topic_t id = *_topic_table->getId(row);
+            if(rewrite(&id)){
+                _topic_table->setId(row, &id);
+            }
+        }
+        _topic_tree->renameKeys(from, to, count);
+        if(_retained_list){
+            for(Retained* ret : *_retained_list){
+                rewrite(&ret->id);
+            }
+        }
+    }
 
 
-    /** @fn findTopicByName 
-     *  @brief Busca un topic por medio de su nombre, descendiendo por la jerarqu�a hasta
-     *         llegar a un topic final.
-     *  @param name nombre
-     *  @return Pointer to the topic or NULL if not found
+    /** @fn isWildcard
+     *  @brief Chequea si un token es exactamente un wildcard '+' o '#'
+     *  @param token Inicio del token
+     *  @param len Longitud del token
+     *  @return True si es un wildcard
      */
-    static MQ::Topic * findTopicByName(const char* name){
-        MQ::Topic* topic = _topic_list->getFirstItem();
-        while(topic){
-            if(strcmp(name, topic->name)==0){
-                return topic;
-            }
-            topic = _topic_list->getNextItem();
-        }
-        return NULL;
+    static inline bool isWildcard(const char* token, uint16_t len){
+        return (len == 1 && (token[0] == '+' || token[0] == '#'));
     }
- 
 
-    /** @fn generateTokens 
-     *  @brief Genera los tokens no existentes en la lista auto-gestionada
-     *  @param name nombre del topic a procesar
-     *  @return True Topic insertado, False error en el topic
+
+    /** @fn isNumeric
+     *  @brief Chequea si un token es un nivel numerico: un valor decimal de hasta 9 digitos sin ceros a la
+     *         izquierda, de forma que el nombre del topic pueda reconstruirse a partir de su valor
+     *  @param token Inicio del token
+     *  @param len Longitud del token
+     *  @param value Recibe el valor (puede ser NULL)
+     *  @return True si es un nivel numerico
      */
-    static bool generateTokens(const char* name){
-        char* token = (char*)Heap::memAlloc(strlen(name));
-        if(!token){
+    static inline bool isNumeric(const char* token, uint16_t len, uint32_t* value){
+        if(len == 0 || len > 9 || (len > 1 && token[0] == '0')){
             return false;
         }
-        uint8_t to=0, from=0;
-        bool is_final = false;
-        getNextDelimiter(name, &from, &to, &is_final);
-        while(from < to){
-            bool exists = false;
-            for(int i = 0;i <_token_provider_count-WildcardCOUNT;i++){
-                // si el token ya existe o es un wildcard, pasa al siguiente
-                if(name[from] == '#' || name[from] == '+' || strncmp(_token_provider[i], &name[from], to-from)==0){
-                	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "El token ya existe");
-                    exists = true;
-                    break;
-                }
-            }
-            // tras recorrer todo el �rbol, si no existe lo a�ade
-            if(!exists){
-                char* new_token = (char*)Heap::memAlloc(1+to-from);
-                if(!new_token){
-                    Heap::memFree(token);
-                    return false;
-                }
-                strncpy(new_token, &name[from], (to-from)); new_token[to-from] = 0;
-                _token_provider[_token_provider_count-WildcardCOUNT] = new_token;
-                _token_provider_count++;
-                DEBUG_TRACE_D(_defdbg,"[MQLib].........", "A�adido token %s", new_token);
+        uint32_t v = 0;
+        for(uint8_t i = 0; i < len; i++){
+            if(token[i] < '0' || token[i] > '9'){
+                return false;
             }
-            from = to+1;
-            getNextDelimiter(name, &from, &to, &is_final);
+            v = (v * 10) + (token[i] - '0');
+        }
+        if(value){
+            *value = v;
         }
-        Heap::memFree(token);
         return true;
     }
 
- 
+
+    /** @fn getKeys
+     *  @brief Obtiene las claves de nivel de un identificador para el indice de suscripciones
+     *  @param id Identificador del topic
+     *  @param keys Recibe las claves (MQ::MAX_TOKEN_LEVEL+1)
+     *  @return Claves
+     */
+    static const MQ::key_t* getKeys(const MQ::topic_t* id, MQ::key_t* keys){
+        uint8_t num = 0;
+        for(int i = 0; i < MQ::MAX_TOKEN_LEVEL; i++){
+            keys[i] = (id->tk[i] == WildcardNumeric)? (MQ::NumericKey | id->num[num++]) : id->tk[i];
+        }
+        keys[MQ::MAX_TOKEN_LEVEL] = WildcardNotUsed;
+        return keys;
+    }
+
 
     /** @fn createTopicId 
-     *  @brief Crea el identificador del topic. Los wildcards se sustituyen por el valor 0
+     *  @brief Crea el identificador del topic. Los wildcards se sustituyen por sus valores reservados.
+     *         Los niveles se obtienen en una unica pasada (ver MQ::splitTopic).
      *  @param id Recibe el Identificador 
      *  @param name Nombre completo del topic
+     *  @param dict Diccionario de tokens a utilizar (por defecto, el del broker)
+     *  @return True si el topic no excede la profundidad maxima. Si la excede, el identificador solo
+     *          contiene los primeros MQ::MAX_TOKEN_LEVEL niveles.
      */
-    static void createTopicId(MQ::topic_t* id, const char* name){
-        uint8_t from = 0, to = 0;
-        bool is_final = false;
+    static bool createTopicId(MQ::topic_t* id, const char* name, HashMap<MQ::token_t>* dict = _token_dict){
         DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Generando ID para el topic [%s]", name);
-        int pos = 0; 
+        MQ::TopicSpan spans[MQ::MAX_TOKEN_LEVEL];
+        uint8_t count = MQ::splitTopic(name, spans, MQ::MAX_TOKEN_LEVEL);
+        bool valid = (count <= MQ::MAX_TOKEN_LEVEL);
+        if(!valid){
+            DEBUG_TRACE_W(_defdbg,"[MQLib].........", "El topic [%s] excede la profundidad maxima", name);
+            count = MQ::MAX_TOKEN_LEVEL;
+        }
+        uint8_t num = 0;
         // Inicializo el contenido del identificador para marcar como no usado
         for(int i=0;i<MQ::MAX_TOKEN_LEVEL;i++){
             id->tk[i] = WildcardNotUsed;
         }
-        
-        // obtiene los delimitadores para buscar tokens
-        getNextDelimiter(name, &from, &to, &is_final);
-        while(from < to){
-        	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Procesando topic [%s], delimitadores (%d,%d)", name, from, to);
-            uint32_t token = WildcardInvalid;
-			// @05Mar2018.001 Verifico que sea un wildcard...
+        for(int i=0;i<MQ::MAX_NUMERIC_LEVELS;i++){
+            id->num[i] = 0;
+        }
+        for(uint8_t i = 0; i < count; i++){
+            const char* token = &name[spans[i].from];
+            uint16_t len = spans[i].len;
+            uint32_t tk = WildcardInvalid;
+            uint32_t value;
 			// chequea si es un wildcard
-			if(strncmp(&name[from], "+", to-from)==0){
-				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Detectado wildcard (+) en delimitadores (%d,%d)", from, to);
-				token = WildcardAny;
+			if(len == 1 && token[0] == '+'){
+				tk = WildcardAny;
+			}
+			else if(len == 1 && token[0] == '#'){
+				tk = WildcardAll;
 			}
-			else if(strncmp(&name[from], "#", to-from)==0){
-				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Detectado wildcard (#) en delimitadores (%d,%d)", from, to);
-				token = WildcardAll;
+			// los niveles numericos se codifican por su valor
+			else if(num < MQ::MAX_NUMERIC_LEVELS && isNumeric(token, len, &value)){
+				tk = WildcardNumeric;
+				id->num[num++] = value;
 			}
 			else{
-				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Analizando tokenX. Buscando token para delimitadores (%d,%d)", from, to);
-				for(int i=0;i<(_token_provider_count - WildcardCOUNT);i++){
-					// si encuentra el token... actualiza el id
-					if(strncmp(_token_provider[i], &name[from], to-from)==0){
-						DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Analizando tokenX. Encontrado token [%s]", _token_provider[i]);
-						token  = i + WildcardCOUNT;
-						break;
-					}
+				// si encuentra el token... actualiza el id
+				MQ::token_t found;
+				if(dict->getItem(token, len, &found)){
+					tk = found;
 				}
 			}
-			id->tk[pos] = (MQ::token_t)(token);
-
-            // pasa al siguiente campo
-            from = to+1;
-            getNextDelimiter(name, &from, &to, &is_final);            
-            pos ++;                        
+			id->tk[i] = (MQ::token_t)(tk);
         }
+        return valid;
     }    
        
     
-    /** @fn getNextDelimiter
-     *  @brief Extrae delimitadores del nombre, token a token, desde la posici�n "from"
-     *  @param name Nombre del topic a evaluar
-     *  @param from Recibe el delimitador inicial y se usa como punto inicial de b�squeda
-     *  @param to Recibe el delimitador final
-     *  @param is_final Recibe el flag si es el subtopic final
-     */
-    static void getNextDelimiter(const char* name, uint8_t* from, uint8_t* to, bool* is_final){
-        // se obtiene el tama�o total del nombre
-        int len = strlen(name);
-        // si el rango es incorrecto, no hace nada
-        if(*from >= len){
-            *from = len;
-            *to = len;
-            *is_final = true;
-            return;
-        }
-        // se inicia la b�squeda, si parte de un espaciador, lo descarta
-        if(name[*from] == '/'){
-            (*from)++;
-        }
-        *to = *from;
-        for(int i = *from; i <= len; i++){
-            // si encuentra fin de trama, marca como final
-            if(name[i] == 0){
-                *to = i;
-                break;
-            }
-            // si encuentra espaciador de tokens, marca como final
-            else if(name[i] == '/'){
-                *to = i;
-                break;
-            }
-        }
-        // si el punto final coincide con el tama�o de trama, marca como punto final
-        if(*to >= len){
-            *is_final = true;            
-        }
-    }      
-       
-    
-    /** @fn matchIds
-     *  @brief Compara dos identificadores. El de b�squeda con el encontrado. Si el encontrado
-     *         contiene wildcards, habr� que tenerlos en cuenta.
-     *  @param found_id Identificador encontrado
-     *  @param search_id Identificador de b�squeda
-     *  @return True si encajan, False si no encajan 
-     */
-    static bool matchIds(MQ::topic_t* found_id, MQ::topic_t* search_id){
-        for(int i=0;i<MQ::MAX_TOKEN_LEVEL;i++){
-        	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Comparando %d vs %d", found_id->tk[i], search_id->tk[i]);
-			// si ha encontrado un wildcard All, es que coincide
-			if(found_id->tk[i] == WildcardAll){
-				return true;
-			}
-
-			// si ha llegado al final de la cadena de b�squeda sin errores, es que coincide...
-			if(search_id->tk[i] == WildcardNotUsed){
-				if(found_id->tk[i] != WildcardNotUsed)
-					return false;
-				return true;
-			}
-
-			// si no coinciden ni hay wildcards '+' involucrados, no hay coincidencia
-			if(found_id->tk[i] != WildcardAny && found_id->tk[i] != search_id->tk[i]){
-				return false;
-			}
-
-            // en otro caso, es que coinciden y por lo tanto sigue analizando siguientes elementos
-        }        
-        // si llega a este punto es que coinciden todos los niveles
-        return true;
-    }         
-
-
-    /** A�ade una operaci�n a la lista de operaciones pendientes
+    /** Inserta una operacion en la cola de operaciones pendientes, copiando el nombre del topic y el
+     *  mensaje en un unico bloque. Tras encolarla intenta aplicarla, por si el broker ya se hubiera liberado.
      *
      *  @param type Tipo de operaci�n
      *  @param topic Nombre del topic
@@ -820,63 +3785,125 @@ private:
      *  @param datasize Tama�o de los datos del mensaje (s�lo para publicaciones)
      *  @param pub_cb Callback de publicaci�n
      *  @param sub_cb Callback de suscripci�n
-     *  @return C�digo de error
+     *  @param flags Opciones de suscripcion o de publicacion
+     *  @param interval Intervalo minimo entre entregas (solo para suscripciones)
+     *  @return DEFERRED si se ha encolado, o el error que impide encolarla
      */
-    static int32_t addPendingRequest(PendingRequestType type, const char* topic, void* data, uint32_t datasize, PublishCallback *pub_cb, SubscribeCallback *sub_cb){
-    	PendingRequest_t* req = (PendingRequest_t*)Heap::memAlloc(sizeof(PendingRequest_t));
-    	MBED_ASSERT(req);
-    	req->topic = (char*)Heap::memAlloc(strlen(topic)+1);
-    	MBED_ASSERT(req->topic);
-    	strcpy(req->topic, topic);
-    	req->msg = data;
+    static int32_t addPendingRequest(PendingRequestType type, const char* topic, void* data, uint32_t datasize, PublishCallback *pub_cb, SubscribeCallback *sub_cb, uint8_t flags, uint32_t interval = 0){
+    	uint32_t topic_len = strlen(topic) + 1;
+    	char* mem = (char*)Heap::memAlloc(topic_len + datasize);
+    	if(!mem){
+    		return OUT_OF_MEMORY;
+    	}
+    	PendingRequest_t* req = _pending_list->reserve();
+    	if(!req){
+    		DEBUG_TRACE_E(true,"[MQLib].........", "ERR_PENDING. Cola de operaciones pendientes llena en topic %s", topic);
+    		Heap::memFree(mem);
+    		return OUT_OF_MEMORY;
+    	}
+    	req->topic = mem;
+    	memcpy(req->topic, topic, topic_len);
+    	req->msg = NULL;
     	req->msg_len = datasize;
     	if(datasize){
-    		req->msg = (void*)Heap::memAlloc(datasize);
-    		MBED_ASSERT(req->msg);
+    		req->msg = (void*)(mem + topic_len);
     		memcpy(req->msg, data, datasize);
-    		req->msg_len = datasize;
     	}
     	req->pub_cb = pub_cb;
     	req->sub_cb = sub_cb;
+    	req->flags = flags;
+    	req->interval = interval;
     	req->type = type;
     	DEBUG_TRACE_D(_defdbg,"[MQLib].........", "A�adiendo solicitud pendiente tipo %d en topic %s", (int)req->type, req->topic);
-    	return _pending_list->addItem(req);
+    	_pending_list->commit(req);
+    	processPendingRequests();
+    	return DEFERRED;
     }
 
 
-    /** Procesa todas las operaciones pendientes, liberando los recursos asociados
+    /** Procesa todas las operaciones pendientes, liberando los recursos asociados. Solo las aplica si obtiene
+     *  el mutex sin esperar y no esta anidado en otra operacion del broker; en otro caso las aplicara el
+     *  thread que lo posee al liberarlo, o el siguiente que lo tome.
      *
      */
     static void processPendingRequests(){
-    	PendingRequest_t* req = _pending_list->getFirstItem();
-    	while(req){
+    	// ordena la liberacion del mutex (o la insercion de la operacion) antes de comprobar la cola, para que
+    	// entre el thread que libera el broker y el que encola siempre haya uno que vea la operacion pendiente
+    	std::atomic_thread_fence(std::memory_order_seq_cst);
+    	while(_pending_list && !_pending_list->isEmpty()){
+    		if(!_mutex.trylock()){
+    			return;
+    		}
+    		if(_lock_depth > 0){
+    			_mutex.unlock();
+    			return;
+    		}
+    		_lock_depth++;
+    		applyPendingRequests();
+    		_lock_depth--;
+    		_mutex.unlock();
+    		std::atomic_thread_fence(std::memory_order_seq_cst);
+    	}
+    }
+
+
+    /** Aplica en orden las operaciones pendientes. Requiere el mutex del broker.
+     *
+     */
+    static void applyPendingRequests(){
+    	PendingRequest_t* req;
+    	while((req = _pending_list->front()) != NULL){
     		switch((int)req->type){
     			case ReqSubscribe:{
     				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Procesando solicitud pendiente tipo Subscribe (%d) en topic %s", (int)req->type, req->topic);
-    				subscribeReq(req->topic, req->sub_cb, false);
+    				int32_t err = subscribeReq(req->topic, req->sub_cb, false, req->flags, req->interval);
+    				DEBUG_TRACE_E(err != SUCCESS,"[MQLib].........", "ERR_PENDING. Suscripcion aplazada en topic %s fallida (%d)", req->topic, err);
     				break;
     			}
     			case ReqUnsubscribe:{
     				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Procesando solicitud pendiente tipo Unsubscribe (%d) en topic %s", (int)req->type, req->topic);
-    				unsubscribeReq(req->topic, req->sub_cb, false);
+    				int32_t err = unsubscribeReq(req->topic, req->sub_cb, false);
+    				DEBUG_TRACE_E(err != SUCCESS,"[MQLib].........", "ERR_PENDING. Cancelacion de suscripcion aplazada en topic %s fallida (%d)", req->topic, err);
     				break;
     			}
     			case ReqPublish:{
     				DEBUG_TRACE_D(_defdbg,"[MQLib].........", "Procesando solicitud pendiente tipo Publish (%d) en topic %s", (int)req->type, req->topic);
-					publishReq(req->topic, req->msg, req->msg_len, req->pub_cb, false);
+    				publishReq(req->topic, req->msg, req->msg_len, req->pub_cb, false, req->flags);
     				break;
     			}
     		}
     		// libera los recursos
-    		if(req->msg && req->msg_len > 0){
-    			Heap::memFree(req->msg);
-    		}
     		Heap::memFree(req->topic);
-    		_pending_list->removeItem(req);
-    		Heap::memFree(req);
-    		// Coge el siguiente elemento que volver� a ser el primero
-    		req = _pending_list->getFirstItem();
+    		_pending_list->pop();
+    	}
+    }
+
+
+    /** Toma el mutex del broker, llevando la cuenta de la profundidad de bloqueo. Al tomarlo sin anidar, aplica
+     *  antes las operaciones pendientes, de forma que la operacion del llamante no adelanta a las que aplazo.
+     *
+     *  @param timeout Tiempo maximo de espera (ms)
+     *  @return True si se ha obtenido el mutex
+     */
+    static bool lockBroker(uint32_t timeout = osWaitForever){
+    	if(_mutex.lock(timeout) != osOK){
+    		return false;
     	}
+    	_lock_depth++;
+    	if(_lock_depth == 1 && _pending_list){
+    		applyPendingRequests();
+    	}
+    	return true;
+    }
+
+
+    /** Libera el mutex del broker y aplica las operaciones que otros threads hayan aplazado mientras tanto
+     *
+     */
+    static void unlockBroker(){
+    	_lock_depth--;
+    	_mutex.unlock();
+    	processPendingRequests();
     }
 };
 
@@ -900,10 +3927,26 @@ public:
      *  @brief Se suscribe a un tipo de topic, realizando una petici�n al broker
      *  @param name Nombre del topic
      *  @param subscriber Manejador de las actualizaciones del topic
+     *  @param flags Opciones de suscripcion (MQ::SubscribeFlags). Los suscriptores que modifican el
+     *         mensaje recibido deben indicar MQ::SubscribeMutable.
+     *  @param interval Con MQ::SubscribeConflate, intervalo minimo (ms) entre entregas de cada topic. Entre
+     *         entregas solo se guarda el ultimo mensaje, que se entrega al vencer el intervalo (ver
+     *         MQBroker::startConflateFlush) o al solicitarlo el suscriptor mediante pull.
+     *  @return Resultado
+     */
+    static int32_t subscribe(const char* name, MQ::SubscribeCallback *subscriber, uint8_t flags = MQ::SubscribeReadOnly, uint32_t interval = 0){
+		return MQBroker::subscribeReq(name, subscriber, true, flags, interval);
+    }
+
+
+    /** @fn pull
+     *  @brief Entrega al suscriptor el ultimo mensaje pendiente de cada topic de sus suscripciones
+     *         MQ::SubscribeConflate, sin esperar a que venza su intervalo minimo
+     *  @param subscriber Suscriptor
      *  @return Resultado
      */
-    static int32_t subscribe(const char* name, MQ::SubscribeCallback *subscriber){
-		return MQBroker::subscribeReq(name, subscriber);
+    static int32_t pull(MQ::SubscribeCallback *subscriber){
+		return MQBroker::flushConflatedReq(subscriber, true);
     }
 
 	
@@ -925,15 +3968,200 @@ public:
      *  @param datasize Tama�o del mensaje
      *  @param publisher Callback de notificaci�n de la publicaci�n
      *  @param is_bridge Flag que indica si la publicaci�n proviene de un bridge
+     *  @param flags Opciones de publicacion (MQ::PublishFlags)
 	 *	@return Resultado
      */
-    static int32_t publish (const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher){
-        int32_t err = MQBroker::publishReq(name, data, datasize, publisher);
-        executeBridge(name, data, datasize, publisher);
+    static int32_t publish (const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher, uint8_t flags = MQ::PublishDefault){
+        // si la cache esta activa, publica a traves del handle del topic en la cache
+        CacheEntry* entry = (flags == MQ::PublishDefault && _cache)? acquireCacheEntry(name) : NULL;
+        if(entry){
+            int32_t err = publish(&entry->handle, data, datasize, publisher);
+            releaseCacheEntry(entry);
+            return err;
+        }
+        if(_bridge_count == 0){
+            return MQBroker::publishReq(name, data, datasize, publisher, true, flags);
+        }
+        // el broker obtiene el identificador del topic para los bridges en su propia seccion critica. Si no
+        // llega a obtenerlo, o la recoleccion de tokens lo invalida, los bridges se comparan por nombre
+        MQ::topic_t id;
+        id.tk[0] = 0;
+        uint32_t tokens = MQBroker::getTokenGeneration();
+        int32_t err = MQBroker::publishReq(name, data, datasize, publisher, true, flags, &id);
+        bool resolved = (id.tk[0] != 0 && MQBroker::getTokenGeneration() == tokens);
+        executeBridge(name, data, datasize, publisher, (resolved)? &id : NULL);
         return err;
     }  
 
 
+    /** @fn resolve
+     *  @brief Resuelve un topic en un handle de publicacion, de forma que las publicaciones repetidas
+     *         sobre ese topic no tengan que procesar de nuevo el nombre, ni buscar suscriptores y bridges.
+     *         El handle se actualiza automaticamente si cambian las suscripciones o los bridges, y debe
+     *         liberarse mediante 'release' cuando deje de utilizarse.
+     *  @param name Nombre del topic
+     *  @param handle Recibe el handle resuelto
+     *  @return Resultado
+     */
+    static int32_t resolve(const char* name, MQ::PublishHandle* handle){
+    	if(!name || !handle){
+    		return NULL_POINTER;
+    	}
+    	release(handle);
+    	handle->name = (char*)Heap::memAlloc(strlen(name)+1);
+    	if(!handle->name){
+    		return OUT_OF_MEMORY;
+    	}
+    	strcpy(handle->name, name);
+    	int32_t err = MQBroker::resolveReq(handle);
+    	if(err == SUCCESS){
+    		err = resolveBridges(handle);
+    	}
+    	return err;
+    }
+
+
+    /** @fn publish
+     *  @brief Publica una actualizacion de un topic a traves de un handle pre-resuelto
+     *  @param handle Handle de publicacion obtenido mediante 'resolve'
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion de la publicacion
+	 *	@return Resultado
+     */
+    static int32_t publish (MQ::PublishHandle* handle, void *data, uint32_t datasize, MQ::PublishCallback *publisher){
+    	if(!handle || !handle->name){
+    		return NULL_POINTER;
+    	}
+        int32_t err = MQBroker::publishReq(handle, data, datasize, publisher);
+        // si ha cambiado el conjunto de bridges, actualiza el handle
+        if(handle->bridge_generation != _bridge_generation){
+        	resolveBridges(handle);
+        }
+        for(uint16_t i = 0; i < handle->bridge_count; i++){
+        	handle->bridges[i]->call(handle->name, data, datasize, publisher);
+        }
+        return err;
+    }
+
+
+    /** @fn publishBatch
+     *  @brief Publica un lote de topics con una unica solicitud al broker (ver MQBroker::publishBatchReq), y
+     *         ejecuta despues los bridges de cada entrada publicada.
+     *  @param entries Entradas a publicar
+     *  @param count Numero de entradas
+     *  @param results Recibe el resultado de cada entrada
+     *  @param done Callback de finalizacion del lote (opcional)
+     *  @return Resultado
+     */
+    static int32_t publishBatch(const MQ::PublishEntry* entries, uint16_t count, int32_t* results, MQ::BatchCallback* done = NULL){
+        int32_t err = MQBroker::publishBatchReq(entries, count, results);
+        if(err == SUCCESS){
+            for(uint16_t i = 0; i < count; i++){
+                if(entries[i].name){
+                    executeBridge(entries[i].name, entries[i].data, entries[i].datasize, MQBroker::getNullPublisher());
+                }
+            }
+        }
+        if(done){
+            done->call(entries, results, count);
+        }
+        return err;
+    }
+
+
+    /** @fn publishFromISR
+     *  @brief Encola una publicacion desde una interrupcion, sin bloqueo ni reservas de memoria. Se publica
+     *         al vaciar la cola del broker (ver MQBroker::startIsrQueue) y no se ejecutan los bridges.
+     *  @param name Nombre del topic
+     *  @param data Mensaje
+     *  @param datasize Tamano del mensaje
+     *  @param publisher Callback de notificacion de la publicacion (opcional)
+     *  @return Resultado
+     */
+    static int32_t publishFromISR(const char* name, const void *data, uint16_t datasize, MQ::PublishCallback *publisher = NULL){
+        return MQBroker::publishFromISR(name, data, datasize, publisher);
+    }
+    static int32_t publishFromISR(MQ::PublishHandle* handle, const void *data, uint16_t datasize, MQ::PublishCallback *publisher = NULL){
+        return MQBroker::publishFromISR(handle, data, datasize, publisher);
+    }
+
+
+    /** @fn release
+     *  @brief Libera los recursos asociados a un handle de publicacion
+     *  @param handle Handle de publicacion
+     */
+    static void release(MQ::PublishHandle* handle){
+    	if(!handle){
+    		return;
+    	}
+    	if(handle->name){
+    		Heap::memFree(handle->name);
+    	}
+    	if(handle->topics){
+    		Heap::memFree(handle->topics);
+    	}
+    	if(handle->bridges){
+    		Heap::memFree(handle->bridges);
+    	}
+    	*handle = MQ::PublishHandle();
+    }
+
+
+    /** @fn setPublishCache
+     *  @brief Configura la cache de publicaciones por nombre. Cada entrada es un handle de publicacion (ver
+     *         'resolve') asociado al nombre de un topic, de forma que las publicaciones repetidas sobre el mismo
+     *         topic no procesan de nuevo el nombre ni buscan suscriptores y bridges. Las entradas se invalidan
+     *         al cambiar las suscripciones o los bridges, y se reemplazan con el algoritmo CLOCK. Las
+     *         publicaciones con opciones (ej: MQ::PublishRetain) no utilizan la cache. No debe invocarse desde
+     *         un suscriptor o un bridge.
+     *  @param size Numero maximo de topics en la cache (0 la desactiva)
+     *  @return Resultado
+     */
+    static int32_t setPublishCache(uint16_t size){
+    	_cache_mutex.lock();
+    	destroyCache();
+    	int32_t err = SUCCESS;
+    	if(size){
+    		_cache = (CacheEntry*)Heap::memAlloc(size * sizeof(CacheEntry));
+    		_cache_index = new HashMap<uint16_t>(size);
+    		if(!_cache || !_cache_index){
+    			destroyCache();
+    			err = OUT_OF_MEMORY;
+    		}
+    		else{
+    			for(uint16_t i = 0; i < size; i++){
+    				new (&_cache[i]) CacheEntry();
+    			}
+    			_cache_size = size;
+    		}
+    	}
+    	_cache_mutex.unlock();
+    	return err;
+    }
+
+
+    /** @fn getPublishCacheStats
+     *  @brief Obtiene las estadisticas de la cache de publicaciones, para dimensionarla
+     *  @param stats Recibe las estadisticas
+     */
+    static void getPublishCacheStats(MQ::PublishCacheStats* stats){
+    	_cache_mutex.lock();
+    	*stats = _cache_stats;
+    	_cache_mutex.unlock();
+    }
+
+
+    /** @fn resetPublishCacheStats
+     *  @brief Reinicia las estadisticas de la cache de publicaciones
+     */
+    static void resetPublishCacheStats(){
+    	_cache_mutex.lock();
+    	memset(&_cache_stats, 0, sizeof(MQ::PublishCacheStats));
+    	_cache_mutex.unlock();
+    }
+
+
     /** @fn republish
      *  @brief Publica un bridge
      *  @param name Nombre del topic
@@ -1019,27 +4247,40 @@ public:
     }
 
     /**
-     * A�ade un bridge a un topic dado
+     * Anade un bridge a un topic dado. El topic se compila en un identificador con el diccionario de tokens
+     * del broker, de forma que las publicaciones se comparan con el sin procesar de nuevo su nombre.
      * @param topic Topic origen
      * @param cb Callback para procesar el bridging
      */
     static int32_t addBridge(const char* topic, MQ::BridgeCallback* cb){
-    	std::map<std::string, std::list<MQ::BridgeCallback*>*>::iterator it = _bridges.find(topic);
-    	if(it!=_bridges.end()){
-    		for(auto i = it->second->begin(); i != it->second->end(); ++i){
-    			MQ::BridgeCallback* bc = (*i);
-    			if(cb == bc){
-    				return -2;
-    			}
-    		}
-    		it->second->push_back(cb);
-    		return 0;
+    	if(!topic || !cb){
+    		return NULL_POINTER;
+    	}
+    	if(findBridge(topic, cb) >= 0){
+    		return -2;
+    	}
+    	// los tokens del bridge se mantienen mientras exista, aunque ningun topic suscrito los utilice
+    	compileBridges();
+    	Bridge br;
+    	int32_t err = MQBroker::pinTopicIdReq(topic, &br.id);
+    	if(err != SUCCESS){
+    		return err;
+    	}
+    	br.topic = (char*)Heap::memAlloc(strlen(topic)+1);
+    	if(!br.topic){
+    		MQBroker::unpinTopicIdReq(&br.id);
+    		return OUT_OF_MEMORY;
     	}
-    	// si no hay ning�n elemento en el mapa, con ese topic, lo crea
-    	std::list<MQ::BridgeCallback*>* bclist = new std::list<MQ::BridgeCallback*>();
-    	MBED_ASSERT(bclist);
-    	bclist->push_back(cb);
-    	_bridges.insert(std::pair<std::string, std::list<MQ::BridgeCallback*>*>(topic, bclist));
+    	strcpy(br.topic, topic);
+    	br.cb = cb;
+    	// si algun nivel no tiene token, las coincidencias se confirman comparando los nombres
+    	br.exact = MQBroker::isResolvedId(&br.id);
+    	if(!MQ::appendItem(_bridges, _bridge_count, _bridge_size, br)){
+    		MQBroker::unpinTopicIdReq(&br.id);
+    		Heap::memFree(br.topic);
+    		return OUT_OF_MEMORY;
+    	}
+    	_bridge_generation++;
     	return 0;
     }
 
@@ -1049,22 +4290,18 @@ public:
      * @param cb Callback a eliminar
      */
     static int32_t removeBridge(const char* topic, MQ::BridgeCallback* cb){
-    	std::map<std::string, std::list<MQ::BridgeCallback*>*>::iterator it = _bridges.find(topic);
-    	if(it!=_bridges.end()){
-    		for(auto i = it->second->begin(); i != it->second->end(); ++i){
-    			MQ::BridgeCallback* bc = (*i);
-    			if(cb == bc){
-    				it->second->remove(bc);
-    				// si se han eliminado todos los elementos, se elimina del mapa
-    				if(it->second->size() == 0){
-    					delete(it->second);
-    					_bridges.erase(it);
-    				}
-    				return 0;
-    			}
-    		}
+    	int32_t pos = (topic)? findBridge(topic, cb) : -1;
+    	if(pos < 0){
+    		return -1;
     	}
-    	return -1;
+    	// conserva el orden de ejecucion de los bridges restantes
+    	compileBridges();
+    	MQBroker::unpinTopicIdReq(&_bridges[pos].id);
+    	Heap::memFree(_bridges[pos].topic);
+    	_bridge_count--;
+    	memmove(&_bridges[pos], &_bridges[pos+1], (_bridge_count - pos) * sizeof(Bridge));
+    	_bridge_generation++;
+    	return 0;
     }
 
     /**
@@ -1073,56 +4310,253 @@ public:
      *  @param data Mensaje
      *  @param datasize Tama�o del mensaje
      *  @param publisher Callback de notificaci�n de la publicaci�n
+     *  @param id Identificador del topic obtenido por el broker, o NULL para comparar los bridges por nombre
      */
-    static void executeBridge(const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher){
-    	std::string topic(name);
-        std::string delimiter = "/";
-        std::vector<std::string> topicSplit;
-
-        int pos = 0;
-        std::string token;
-        while ((pos = topic.find(delimiter)) != std::string::npos) {
-            token = topic.substr(0, pos);
-            topicSplit.push_back(token);
-            topic.erase(0, pos + delimiter.length());
-            if((pos = topic.find(delimiter)) == std::string::npos)
-                topicSplit.push_back(topic);
-        }
-
-        std::map<std::string, std::list<MQ::BridgeCallback*>*>::iterator it;
-        for ( it = _bridges.begin(); it != _bridges.end(); it++ )
-        {
-            std::string topicB(it->first);
-            std::string token;
-            int topicPos = 0;
-            bool proccess = true;
-            bool defProccess = false;
-            while ((pos = topicB.find(delimiter)) != std::string::npos) {
-                token = topicB.substr(0, pos);
-                if(token.compare("#")==0){
-                    defProccess = true;
-                    break;
-                }
-                else if(topicPos >= topicSplit.size() || (token.compare(topicSplit[topicPos])!=0 && token.compare("+")!=0)){
-                    proccess = false;
-                    break;
-                }
-                topicPos++;
-                topicB.erase(0, pos + delimiter.length());
-            }
-
-            if(defProccess || (proccess && topicPos+1 == topicSplit.size() && (topicB.compare(topicSplit[topicPos])==0 || topicB.compare("+")==0))){
-                for(auto i = it->second->begin(); i != it->second->end(); ++i){
-                    MQ::BridgeCallback* bc = (*i);
-                    bc->call(name, data, datasize, publisher);
-                }
-            }
-        }
+    static void executeBridge(const char* name, void *data, uint32_t datasize, MQ::PublishCallback *publisher, MQ::topic_t* id = NULL){
+    	if(_bridge_count == 0){
+    		return;
+    	}
+    	compileBridges();
+    	auto execute = [&](MQ::BridgeCallback* bc){
+    		bc->call(name, data, datasize, publisher);
+    	};
+    	forEachBridge(name, id, execute);
     }
 
 
 private:
-    static std::map<std::string, std::list<MQ::BridgeCallback*>*> _bridges;
+    /** Bridge compilado */
+    struct Bridge{
+    	MQ::topic_t id;					/// Identificador del topic origen
+    	char* topic;					/// Topic origen
+    	MQ::BridgeCallback* cb;			/// Callback del bridge
+    	bool exact;						/// Indica si todos los niveles del topic origen tienen token
+    };
+
+    /** Bridges registrados, en orden de insercion */
+    static Bridge* _bridges;
+    static uint16_t _bridge_count;
+    static uint16_t _bridge_size;
+
+    /** Generacion del conjunto de bridges, para invalidar los handles de publicacion */
+    static uint32_t _bridge_generation;
+
+    /** Generacion de los tokens (ver MQBroker::getTokenGeneration) con la que se compilaron los bridges */
+    static uint32_t _bridge_tokens;
+
+    /** Entrada de la cache de publicaciones */
+    struct CacheEntry{
+    	MQ::PublishHandle handle;		/// Handle del topic (sin nombre si la entrada esta libre)
+    	bool referenced;				/// Bit de referencia del algoritmo CLOCK
+    	bool pinned;					/// Indica si una publicacion esta utilizando la entrada
+    };
+
+    /** Cache de publicaciones */
+    static CacheEntry* _cache;
+    static uint16_t _cache_size;
+    static uint16_t _cache_hand;
+    static HashMap<uint16_t>* _cache_index;
+    static MQ::PublishCacheStats _cache_stats;
+    static Mutex _cache_mutex;
+
+
+    /** @fn acquireCacheEntry
+     *  @brief Obtiene la entrada de la cache de un topic, reemplazando otra si no existe. La entrada queda
+     *         reservada para la publicacion en curso hasta 'releaseCacheEntry'. El handle se resuelve, si es
+     *         necesario, al publicar a traves de el, por lo que no se accede al broker con el mutex de la cache.
+     *  @param name Nombre del topic
+     *  @return Entrada o NULL si la cache no puede utilizarse (ej: el topic se esta publicando)
+     */
+    static CacheEntry* acquireCacheEntry(const char* name){
+    	_cache_mutex.lock();
+    	CacheEntry* entry = NULL;
+    	uint16_t slot;
+    	if(!_cache){
+    		_cache_mutex.unlock();
+    		return NULL;
+    	}
+    	if(_cache_index->getItem(name, &slot)){
+    		// una publicacion anidada o de otro thread sobre el mismo topic no utiliza la cache
+    		if(!_cache[slot].pinned){
+    			entry = &_cache[slot];
+    			if(MQBroker::isCurrentHandle(&entry->handle) && entry->handle.bridge_generation == _bridge_generation){
+    				_cache_stats.hits++;
+    			}
+    			else{
+    				_cache_stats.misses++;
+    			}
+    		}
+    		else{
+    			_cache_stats.misses++;
+    		}
+    	}
+    	else{
+    		_cache_stats.misses++;
+    		entry = replaceCacheEntry(name);
+    	}
+    	if(entry){
+    		entry->pinned = true;
+    		entry->referenced = true;
+    	}
+    	_cache_mutex.unlock();
+    	return entry;
+    }
+
+
+    /** @fn releaseCacheEntry
+     *  @brief Libera la reserva de una entrada de la cache. Si el handle no ha quedado resuelto (ej: el
+     *         prefiltro del broker ha descartado el topic), la entrada se libera y pasa a ser la siguiente en
+     *         reutilizarse, de forma que los topics sin suscriptores no desplazan a los demas.
+     *  @param entry Entrada
+     */
+    static void releaseCacheEntry(CacheEntry* entry){
+    	_cache_mutex.lock();
+    	entry->pinned = false;
+    	if(entry->handle.generation == 0 && entry->handle.name && _cache){
+    		_cache_index->removeItem(entry->handle.name);
+    		Heap::memFree(entry->handle.name);
+    		entry->handle.name = NULL;
+    		entry->referenced = false;
+    		_cache_hand = (uint16_t)(entry - _cache);
+    	}
+    	_cache_mutex.unlock();
+    }
+
+
+    /** @fn replaceCacheEntry
+     *  @brief Selecciona con el algoritmo CLOCK una entrada libre o no referenciada desde la ultima vuelta, y
+     *         la asigna a un topic. Conserva los arrays de suscriptores y bridges de la entrada reemplazada.
+     *  @param name Nombre del topic
+     *  @return Entrada o NULL si todas estan en uso o no hay memoria
+     */
+    static CacheEntry* replaceCacheEntry(const char* name){
+    	CacheEntry* entry = NULL;
+    	for(uint32_t i = 0; i < (2 * _cache_size) && !entry; i++){
+    		CacheEntry* e = &_cache[_cache_hand];
+    		_cache_hand = (_cache_hand + 1) % _cache_size;
+    		if(e->pinned){
+    			continue;
+    		}
+    		if(e->referenced && e->handle.name){
+    			e->referenced = false;
+    			continue;
+    		}
+    		entry = e;
+    	}
+    	if(!entry){
+    		return NULL;
+    	}
+    	char* copy = (char*)Heap::memAlloc(strlen(name)+1);
+    	if(!copy){
+    		return NULL;
+    	}
+    	strcpy(copy, name);
+    	if(entry->handle.name){
+    		_cache_index->removeItem(entry->handle.name);
+    		Heap::memFree(entry->handle.name);
+    		_cache_stats.evictions++;
+    	}
+    	entry->handle.name = copy;
+    	// fuerza la resolucion del handle en la siguiente publicacion
+    	entry->handle.generation = 0;
+    	entry->handle.bridge_generation = 0;
+    	if(_cache_index->addItem(copy, (uint16_t)(entry - _cache)) != HashMap<uint16_t>::SUCCESS){
+    		Heap::memFree(copy);
+    		entry->handle.name = NULL;
+    		return NULL;
+    	}
+    	return entry;
+    }
+
+
+    /** @fn destroyCache
+     *  @brief Libera la cache de publicaciones. Requiere el mutex de la cache.
+     */
+    static void destroyCache(){
+    	if(_cache){
+    		for(uint16_t i = 0; i < _cache_size; i++){
+    			release(&_cache[i].handle);
+    			_cache[i].~CacheEntry();
+    		}
+    		Heap::memFree(_cache);
+    	}
+    	delete(_cache_index);
+    	_cache = NULL;
+    	_cache_index = NULL;
+    	_cache_size = 0;
+    	_cache_hand = 0;
+    }
+
+
+    /** @fn findBridge
+     *  @brief Busca un bridge registrado
+     *  @param topic Topic origen
+     *  @param cb Callback del bridge
+     *  @return Posicion o -1 si no existe
+     */
+    static int32_t findBridge(const char* topic, MQ::BridgeCallback* cb){
+    	for(uint16_t i = 0; i < _bridge_count; i++){
+    		if(_bridges[i].cb == cb && strcmp(_bridges[i].topic, topic) == 0){
+    			return i;
+    		}
+    	}
+    	return -1;
+    }
+
+
+    /** @fn forEachBridge
+     *  @brief Recorre los bridges que encajan con un topic. Un bridge puede eliminar otros durante el
+     *         recorrido, por lo que el numero de bridges se relee en cada iteracion.
+     *  @param name Nombre del topic
+     *  @param id Identificador del topic, o NULL para comparar solo los nombres
+     *  @param visitor Funcion a invocar por cada bridge encontrado
+     */
+    template<typename F>
+    static void forEachBridge(const char* name, MQ::topic_t* id, F& visitor){
+    	for(uint16_t i = 0; i < _bridge_count; i++){
+    		Bridge* br = &_bridges[i];
+    		bool match = (id)? (MQBroker::matchIds(&br->id, id) && (br->exact || MQ::matchTopic(br->topic, name))) : MQ::matchTopic(br->topic, name);
+    		if(match){
+    			visitor(br->cb);
+    		}
+    	}
+    }
+
+
+    /** @fn compileBridges
+     *  @brief Obtiene de nuevo los identificadores de los bridges si la recoleccion de tokens los ha reubicado.
+     *         Sus tokens no se liberan, ya que cada bridge mantiene una referencia a ellos.
+     */
+    static void compileBridges(){
+    	uint32_t generation = MQBroker::getTokenGeneration();
+    	if(_bridge_tokens == generation){
+    		return;
+    	}
+    	_bridge_tokens = generation;
+    	for(uint16_t i = 0; i < _bridge_count; i++){
+    		MQBroker::createTopicIdReq(_bridges[i].topic, &_bridges[i].id);
+    	}
+    }
+
+
+    /** @fn resolveBridges
+     *  @brief Actualiza la lista de bridges de un handle de publicacion
+     *  @param handle Handle de publicacion
+     *  @return Resultado
+     */
+    static int32_t resolveBridges(MQ::PublishHandle* handle){
+    	compileBridges();
+    	int32_t err = SUCCESS;
+    	handle->bridge_count = 0;
+    	auto collect = [&](MQ::BridgeCallback* bc){
+    		if(!MQ::appendItem(handle->bridges, handle->bridge_count, handle->bridge_size, bc)){
+    			err = OUT_OF_MEMORY;
+    		}
+    	};
+    	forEachBridge(handle->name, &handle->id, collect);
+    	handle->bridge_generation = (err == SUCCESS)? _bridge_generation : 0;
+    	return err;
+    }
 
 };
 
@@ -1189,17 +4623,16 @@ public:
 		int32_t rc = NOT_FOUND;
 		DEBUG_TRACE_D(_defdbg,"[MQBridge]......", "Eliminando brige %s", from);
 		_mtx.lock();
-		Bridge_t* br = _bridge_list->getFirstItem();
-		while(br){
+		for(Bridge_t* br : *_bridge_list){
 			if(strcmp(from, br->topicFrom) == 0){
-				if((rc = MQClient::unsubscribe(br->topicFrom, &_brsubCb)) == SUCCESS){
+				rc = MQClient::unsubscribe(br->topicFrom, &_brsubCb);
+				if(rc == SUCCESS || rc == DEFERRED){
 					DEBUG_TRACE_D(_defdbg,"[MQBridge]......", "Bridge eliminado %s -> %s", from, br->topicTo);
 					_bridge_list->removeItem(br);
 					Heap::memFree(br);
 					break;
 				}
 			}
-			br = _bridge_list->getNextItem();
 		}
 		_mtx.unlock();
 		return rc;
@@ -1226,12 +4659,12 @@ private:
      */
     virtual void bridgeSubscriptionCb(const char* topic, void* msg, uint16_t msg_len){
 		_mtx.lock();
-		Bridge_t* br = _bridge_list->getFirstItem();
-		while(br){
-			if(strcmp(topic, br->topicFrom) == 0){
+		Bridge_t* br = NULL;
+		for(Bridge_t* b : *_bridge_list){
+			if(strcmp(topic, b->topicFrom) == 0){
+				br = b;
 				break;
 			}
-			br = _bridge_list->getNextItem();
 		}
 		_mtx.unlock();
 		if(br){
@@ -0,0 +1,116 @@
+/*
+ * MpscQueue.h
+ *
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ * 	MpscQueue es una libreria que proporciona una cola FIFO acotada y sin bloqueo, en la que varios productores
+ *	pueden insertar elementos a la vez (incluso desde interrupcion) y un unico consumidor los extrae.
+ *	Las entradas se reservan una unica vez al crear la cola, sobre un anillo de tamano potencia de 2. Cada entrada
+ *	lleva un numero de secuencia que indica si esta libre para la vuelta actual de los productores o lista para el
+ *	consumidor, de forma que los productores solo necesitan una operacion CAS para reservarla.
+ *	Los productores escriben el elemento directamente en la entrada reservada (reserve + commit), y el consumidor
+ *	lo procesa en la propia entrada antes de liberarla (front + pop), sin copias intermedias.
+ *	Si hay varios consumidores, deben serializarse externamente.
+ */
+
+#ifndef __MPSCQUEUE_H
+#define __MPSCQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+
+
+template<typename T>
+class MpscQueue {
+public:
+
+	/** Errores generados por la libreria */
+    enum Exception {
+		SUCCESS = 0,          	///< No exceptions raised
+		NULL_POINTER,         	///< Null pointer in operation
+		OUT_OF_MEMORY,          ///< No more dynamic memory
+	};
+
+
+    /** @fn MpscQueue
+     *  @brief Constructor que reserva las entradas de la cola
+     *  @param size Numero de entradas (se redondea a potencia de 2)
+     */
+    MpscQueue(uint32_t size);
+
+
+    /** @fn ~MpscQueue
+     *  @brief Destructor por defecto
+     */
+    ~MpscQueue();
+
+
+    /** @fn ready
+     *  @brief Chequea si las entradas de la cola se han podido reservar
+     *  @return True si la cola es utilizable
+     */
+    bool ready();
+
+
+    /** @fn reserve
+     *  @brief (Productor) Reserva la siguiente entrada libre de la cola
+     *  @return Entrada a rellenar o NULL si la cola esta llena
+     */
+    T* reserve();
+
+
+    /** @fn commit
+     *  @brief (Productor) Marca una entrada reservada como lista para el consumidor
+     *  @param item Entrada obtenida mediante reserve
+     */
+    void commit(T* item);
+
+
+    /** @fn front
+     *  @brief (Consumidor) Obtiene la primera entrada lista, sin extraerla
+     *  @return Entrada o NULL si no hay ninguna lista
+     */
+    T* front();
+
+
+    /** @fn pop
+     *  @brief (Consumidor) Libera la primera entrada, obtenida previamente mediante front
+     */
+    void pop();
+
+
+    /** @fn isEmpty
+     *  @brief Chequea si no hay entradas listas. Puede invocarse desde cualquier contexto.
+     *  @return True si no hay entradas listas
+     */
+    bool isEmpty();
+
+
+    /** @fn getDropCount
+     *  @brief Obtiene el numero de reservas rechazadas por cola llena
+     *  @return Numero de reservas rechazadas
+     */
+    uint32_t getDropCount();
+
+private:
+
+    /** Entrada de la cola. El elemento se coloca al inicio para obtener la entrada a partir de el */
+    struct Slot{
+        T item;                             ///< Elemento
+        std::atomic<uint32_t> seq;          ///< Numero de secuencia
+    };
+
+    Slot*    _slots;                        ///< Anillo de entradas
+    uint32_t _mask;                         ///< Numero de entradas - 1
+    std::atomic<uint32_t> _head;            ///< Posicion del consumidor
+    std::atomic<uint32_t> _tail;            ///< Posicion de los productores
+    std::atomic<uint32_t> _drops;           ///< Reservas rechazadas por cola llena
+
+};
+
+#include "MpscQueue_tpp.h"
+
+#endif
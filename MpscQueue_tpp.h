@@ -0,0 +1,126 @@
+/*
+ * MpscQueue.tpp
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ *  Implementacion de la libreria MpscQueue.
+ */
+
+/** Archivo de cabecera para abstraer las reservas de memoria del Heap */
+#include "Heap.h"
+#include <new>
+
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC FUNCTIONS ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename T>
+MpscQueue<T>::MpscQueue(uint32_t size) : _head(0), _tail(0), _drops(0) {
+    uint32_t s = 2;
+    while(s < size){
+        s <<= 1;
+    }
+    _mask = s - 1;
+    _slots = (Slot*)Heap::memAlloc(s * sizeof(Slot));
+    if(_slots){
+        // cada entrada se inicializa a 0 y queda libre para la primera vuelta de los productores
+        for(uint32_t i = 0; i < s; i++){
+            new (&_slots[i]) Slot();
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+MpscQueue<T>::~MpscQueue(){
+    if(_slots){
+        for(uint32_t i = 0; i <= _mask; i++){
+            _slots[i].~Slot();
+        }
+        Heap::memFree(_slots);
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+bool MpscQueue<T>::ready(){
+    return (_slots)? true : false;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+T* MpscQueue<T>::reserve(){
+    if(!_slots){
+        return NULL;
+    }
+    uint32_t pos = _tail.load(std::memory_order_relaxed);
+    for(;;){
+        Slot* slot = &_slots[pos & _mask];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if(diff == 0){
+            // entrada libre, intenta reservarla
+            if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                return &slot->item;
+            }
+        }
+        else if(diff < 0){
+            // el consumidor aun no ha liberado la entrada de la vuelta anterior: cola llena
+            _drops.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        else{
+            pos = _tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+void MpscQueue<T>::commit(T* item){
+    // solo el productor que la reservo accede a la entrada, cuya secuencia coincide con su posicion
+    Slot* slot = (Slot*)item;
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+T* MpscQueue<T>::front(){
+    if(!_slots){
+        return NULL;
+    }
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    Slot* slot = &_slots[pos & _mask];
+    if(slot->seq.load(std::memory_order_acquire) != (pos + 1)){
+        return NULL;
+    }
+    return &slot->item;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+void MpscQueue<T>::pop(){
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    // la entrada queda libre para la siguiente vuelta de los productores
+    _slots[pos & _mask].seq.store(pos + _mask + 1, std::memory_order_release);
+    _head.store(pos + 1, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+bool MpscQueue<T>::isEmpty(){
+    if(!_slots){
+        return true;
+    }
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    return (_slots[pos & _mask].seq.load(std::memory_order_acquire) != (pos + 1));
+}
+
+//------------------------------------------------------------------------------------
+template<typename T>
+uint32_t MpscQueue<T>::getDropCount(){
+    return _drops.load(std::memory_order_relaxed);
+}
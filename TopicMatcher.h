@@ -0,0 +1,167 @@
+/*
+ * TopicMatcher.h
+ *
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ * 	TopicMatcher es un indice lineal de suscripciones que compara un identificador publicado con todas las
+ *	suscripciones registradas mediante instrucciones vectoriales. Los identificadores se almacenan por columnas
+ *	(un array de tokens por nivel), de forma que una unica comparacion procesa tantas suscripciones como tokens
+ *	caben en un registro: 16 (SSE2, NEON) o 32 (AVX2) con tokens de 8 bits. Si no hay soporte vectorial, o si se
+ *	define TOPICMATCHER_SIMD_ENABLED a 0, se utiliza una implementacion escalar equivalente.
+ *
+ *	Utiliza la misma codificacion de wildcards que TopicTree (0: fin del topic, 1: '+', 2: '#') y admite tokens
+ *	de 8, 16 o 32 bits. Frente al arbol, no reserva nodos por nivel y su coste es proporcional al numero de
+ *	suscripciones, por lo que resulta adecuado para conjuntos pequenos o medianos de suscripciones.
+ *
+ *	Las suscripciones se eliminan intercambiando la ultima con la eliminada, por lo que el orden de entrega no se
+ *	conserva.
+ */
+
+#ifndef __TOPICMATCHER_H
+#define __TOPICMATCHER_H
+
+#include <stdint.h>
+
+
+/** Seleccion de la implementacion vectorial. Definir TOPICMATCHER_SIMD_ENABLED a 0 fuerza la escalar. */
+#ifndef TOPICMATCHER_SIMD_ENABLED
+#define TOPICMATCHER_SIMD_ENABLED	1
+#endif
+#if TOPICMATCHER_SIMD_ENABLED == 1 && defined(__AVX2__)
+#include <immintrin.h>
+#define TOPICMATCHER_VECTOR_BYTES	32
+#elif TOPICMATCHER_SIMD_ENABLED == 1 && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define TOPICMATCHER_VECTOR_BYTES	16
+#elif TOPICMATCHER_SIMD_ENABLED == 1 && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TOPICMATCHER_VECTOR_BYTES	16
+#else
+#define TOPICMATCHER_VECTOR_BYTES	0
+#endif
+
+
+
+template<typename T, typename Tk = uint8_t>
+class TopicMatcher {
+public:
+
+	/** Errores generados por la libreria */
+    enum Exception {
+		SUCCESS = 0,          	///< No exceptions raised
+		NULL_POINTER,         	///< Null pointer in operation
+		OUT_OF_MEMORY,          ///< No more dynamic memory
+		ITEM_NOT_FOUND,			///< Item not found in matcher
+	};
+
+	/** Valores reservados de los tokens */
+	enum Keys {
+		KeyNotUsed = 0,			///< Fin del topic
+		KeyAny,					///< Wildcard '+'
+		KeyAll,					///< Wildcard '#'
+	};
+
+
+    /** @fn TopicMatcher
+     *  @brief Constructor que crea un indice vacio
+     *  @param max_level Profundidad maxima de los identificadores
+     */
+    TopicMatcher(uint8_t max_level);
+
+
+    /** @fn ~TopicMatcher
+     *  @brief Destructor por defecto
+     */
+    ~TopicMatcher();
+
+
+    /** @fn addItem
+     *  @brief Registra un objeto con el identificador de su suscripcion
+     *  @param id Identificador del topic (array de tokens finalizado en KeyNotUsed o en max_level)
+     *  @param item Objeto a registrar
+     *  @return Resultado
+     */
+    int32_t addItem(const Tk* id, T* item);
+
+
+    /** @fn removeItem
+     *  @brief Elimina un objeto registrado con un identificador. La ultima suscripcion ocupa su posicion.
+     *  @param id Identificador del topic
+     *  @param item Objeto a eliminar
+     *  @return Resultado
+     */
+    int32_t removeItem(const Tk* id, T* item);
+
+
+    /** @fn getItemCount
+     *  @brief Obtiene el numero de objetos registrados
+     *  @return Numero de objetos
+     */
+    uint32_t getItemCount();
+
+
+    /** @fn match
+     *  @brief Recorre todas las suscripciones que encajan con el identificador publicado, teniendo en cuenta
+     *         los wildcards registrados. Por cada objeto encontrado invoca a visitor(T*). El visitor no puede
+     *         modificar el indice.
+     *  @param id Identificador publicado
+     *  @param visitor Funcion a invocar por cada objeto encontrado
+     *  @return Numero de objetos encontrados
+     */
+    template<typename F>
+    uint32_t match(const Tk* id, F& visitor) const;
+
+private:
+
+    /** Numero de suscripciones por bloque de columnas. Multiplo del numero de tokens por registro vectorial,
+     *  de forma que las cargas nunca exceden la capacidad reservada */
+    static const uint32_t BlockSize = 32;
+
+    Tk*      _cols;         ///< Tokens por columnas: nivel 'l' de la suscripcion 'i' en _cols[l*_size + i]
+    T**      _items;        ///< Objetos registrados, en el mismo orden que las columnas
+    uint8_t  _max_level;    ///< Profundidad maxima
+    uint32_t _count;        ///< Numero de objetos registrados
+    uint32_t _size;         ///< Capacidad de cada columna
+
+
+    /** @fn grow
+     *  @brief Duplica la capacidad de las columnas
+     *  @return Resultado
+     */
+    int32_t grow();
+
+
+    /** @fn getToken
+     *  @brief Obtiene el token de un nivel, o KeyNotUsed si el identificador ha finalizado antes
+     *  @param id Identificador del topic
+     *  @param level Nivel
+     *  @param ended Indica si ya se ha encontrado el fin del identificador (se actualiza)
+     *  @return Token
+     */
+    Tk getToken(const Tk* id, uint8_t level, bool* ended) const;
+
+
+    /** @fn matchItem
+     *  @brief Comparacion escalar de una suscripcion con el identificador publicado
+     *  @param id Identificador publicado
+     *  @param i Posicion de la suscripcion
+     *  @return True si encajan
+     */
+    bool matchItem(const Tk* id, uint32_t i) const;
+
+
+    /** @fn matchBlock
+     *  @brief Comparacion vectorial de un bloque de suscripciones con el identificador publicado
+     *  @param id Identificador publicado
+     *  @param from Posicion de la primera suscripcion del bloque
+     *  @return Mascara con un bit por cada byte de los tokens que encajan (sizeof(Tk) bits por suscripcion)
+     */
+    uint32_t matchBlock(const Tk* id, uint32_t from) const;
+
+};
+
+#include "TopicMatcher_tpp.h"
+
+#endif
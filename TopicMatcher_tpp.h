@@ -0,0 +1,275 @@
+/*
+ * TopicMatcher.tpp
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ *  Implementacion de la libreria TopicMatcher.
+ */
+
+/** Archivo de cabecera para abstraer las reservas de memoria del Heap */
+#include "Heap.h"
+#include <string.h>
+
+
+
+//------------------------------------------------------------------------------------
+//-- VECTOR OPERATIONS ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+#if TOPICMATCHER_VECTOR_BYTES > 0
+
+/** Operaciones vectoriales comunes a cualquier ancho de token */
+struct TopicMatcherVec {
+#if TOPICMATCHER_VECTOR_BYTES == 32
+    typedef __m256i Vector;
+    static inline Vector load(const void* p){ return _mm256_loadu_si256((const __m256i*)p); }
+    static inline Vector zero(){ return _mm256_setzero_si256(); }
+    static inline Vector ones(){ return _mm256_set1_epi8(-1); }
+    static inline Vector vand(Vector a, Vector b){ return _mm256_and_si256(a, b); }
+    static inline Vector vor(Vector a, Vector b){ return _mm256_or_si256(a, b); }
+    static inline uint32_t mask(Vector a){ return (uint32_t)_mm256_movemask_epi8(a); }
+    static inline Vector set(uint8_t v){ return _mm256_set1_epi8((char)v); }
+    static inline Vector set(uint16_t v){ return _mm256_set1_epi16((short)v); }
+    static inline Vector set(uint32_t v){ return _mm256_set1_epi32((int)v); }
+    static inline Vector eq(Vector a, Vector b, uint8_t){ return _mm256_cmpeq_epi8(a, b); }
+    static inline Vector eq(Vector a, Vector b, uint16_t){ return _mm256_cmpeq_epi16(a, b); }
+    static inline Vector eq(Vector a, Vector b, uint32_t){ return _mm256_cmpeq_epi32(a, b); }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    typedef uint8x16_t Vector;
+    static inline Vector load(const void* p){ return vld1q_u8((const uint8_t*)p); }
+    static inline Vector zero(){ return vdupq_n_u8(0); }
+    static inline Vector ones(){ return vdupq_n_u8(0xff); }
+    static inline Vector vand(Vector a, Vector b){ return vandq_u8(a, b); }
+    static inline Vector vor(Vector a, Vector b){ return vorrq_u8(a, b); }
+    static inline uint32_t mask(Vector a){
+        // NEON no dispone de movemask: se pondera cada byte por su bit y se suma cada mitad
+        static const uint8_t bits[16] = {1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128};
+        Vector m = vandq_u8(a, vld1q_u8(bits));
+        return (uint32_t)vaddv_u8(vget_low_u8(m)) | ((uint32_t)vaddv_u8(vget_high_u8(m)) << 8);
+    }
+    static inline Vector set(uint8_t v){ return vdupq_n_u8(v); }
+    static inline Vector set(uint16_t v){ return vreinterpretq_u8_u16(vdupq_n_u16(v)); }
+    static inline Vector set(uint32_t v){ return vreinterpretq_u8_u32(vdupq_n_u32(v)); }
+    static inline Vector eq(Vector a, Vector b, uint8_t){ return vceqq_u8(a, b); }
+    static inline Vector eq(Vector a, Vector b, uint16_t){ return vreinterpretq_u8_u16(vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+    static inline Vector eq(Vector a, Vector b, uint32_t){ return vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b))); }
+#else
+    typedef __m128i Vector;
+    static inline Vector load(const void* p){ return _mm_loadu_si128((const __m128i*)p); }
+    static inline Vector zero(){ return _mm_setzero_si128(); }
+    static inline Vector ones(){ return _mm_set1_epi8(-1); }
+    static inline Vector vand(Vector a, Vector b){ return _mm_and_si128(a, b); }
+    static inline Vector vor(Vector a, Vector b){ return _mm_or_si128(a, b); }
+    static inline uint32_t mask(Vector a){ return (uint32_t)_mm_movemask_epi8(a); }
+    static inline Vector set(uint8_t v){ return _mm_set1_epi8((char)v); }
+    static inline Vector set(uint16_t v){ return _mm_set1_epi16((short)v); }
+    static inline Vector set(uint32_t v){ return _mm_set1_epi32((int)v); }
+    static inline Vector eq(Vector a, Vector b, uint8_t){ return _mm_cmpeq_epi8(a, b); }
+    static inline Vector eq(Vector a, Vector b, uint16_t){ return _mm_cmpeq_epi16(a, b); }
+    static inline Vector eq(Vector a, Vector b, uint32_t){ return _mm_cmpeq_epi32(a, b); }
+#endif
+};
+
+#endif
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC FUNCTIONS ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename T, typename Tk>
+TopicMatcher<T,Tk>::TopicMatcher(uint8_t max_level){
+    _max_level = max_level;
+    _count = 0;
+    _size = 0;
+    _cols = 0;
+    _items = 0;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+TopicMatcher<T,Tk>::~TopicMatcher(){
+    if(_cols){
+        Heap::memFree(_cols);
+    }
+    if(_items){
+        Heap::memFree(_items);
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicMatcher<T,Tk>::addItem(const Tk* id, T* item){
+    if(!id || !item){
+        return(NULL_POINTER);
+    }
+    if(_count >= _size && grow() != SUCCESS){
+        return(OUT_OF_MEMORY);
+    }
+    bool ended = false;
+    for(uint8_t level = 0; level < _max_level; level++){
+        _cols[(level * _size) + _count] = getToken(id, level, &ended);
+    }
+    _items[_count++] = item;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicMatcher<T,Tk>::removeItem(const Tk* id, T* item){
+    if(!id || !item){
+        return(NULL_POINTER);
+    }
+    for(uint32_t i = 0; i < _count; i++){
+        if(_items[i] != item){
+            continue;
+        }
+        bool ended = false, equal = true;
+        for(uint8_t level = 0; level < _max_level && equal; level++){
+            equal = (_cols[(level * _size) + i] == getToken(id, level, &ended));
+        }
+        if(!equal){
+            continue;
+        }
+        // la ultima suscripcion ocupa el hueco
+        uint32_t last = --_count;
+        for(uint8_t level = 0; level < _max_level; level++){
+            _cols[(level * _size) + i] = _cols[(level * _size) + last];
+            _cols[(level * _size) + last] = KeyNotUsed;
+        }
+        _items[i] = _items[last];
+        return SUCCESS;
+    }
+    return(ITEM_NOT_FOUND);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+uint32_t TopicMatcher<T,Tk>::getItemCount(){
+    return _count;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+template<typename F>
+uint32_t TopicMatcher<T,Tk>::match(const Tk* id, F& visitor) const{
+    if(!id){
+        return 0;
+    }
+    uint32_t count = 0;
+#if TOPICMATCHER_VECTOR_BYTES > 0
+    static const uint32_t lanes = TOPICMATCHER_VECTOR_BYTES / sizeof(Tk);
+    static const uint32_t lane_bits = (sizeof(Tk) == 4)? 0xf : ((sizeof(Tk) == 2)? 0x3 : 0x1);
+    for(uint32_t from = 0; from < _count; from += lanes){
+        uint32_t bits = matchBlock(id, from);
+        while(bits){
+            uint32_t lane = __builtin_ctz(bits) / sizeof(Tk);
+            bits &= ~(lane_bits << (lane * sizeof(Tk)));
+            // las posiciones libres del ultimo bloque no contienen suscripciones
+            if(from + lane >= _count){
+                break;
+            }
+            visitor(_items[from + lane]);
+            count++;
+        }
+    }
+#else
+    for(uint32_t i = 0; i < _count; i++){
+        if(matchItem(id, i)){
+            visitor(_items[i]);
+            count++;
+        }
+    }
+#endif
+    return count;
+}
+
+
+//------------------------------------------------------------------------------------
+//-- PRIVATE FUNCTIONS ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename T, typename Tk>
+int32_t TopicMatcher<T,Tk>::grow(){
+    uint32_t size = (_size)? (_size << 1) : BlockSize;
+    Tk* cols = (Tk*)Heap::memAlloc(_max_level * size * sizeof(Tk));
+    if(!cols){
+        return(OUT_OF_MEMORY);
+    }
+    T** items = (T**)Heap::memAlloc(size * sizeof(T*));
+    if(!items){
+        Heap::memFree(cols);
+        return(OUT_OF_MEMORY);
+    }
+    // las posiciones libres se marcan como no utilizadas, ya que las cargas vectoriales las incluyen
+    memset(cols, 0, _max_level * size * sizeof(Tk));
+    if(_cols){
+        for(uint8_t level = 0; level < _max_level; level++){
+            memcpy(&cols[level * size], &_cols[level * _size], _count * sizeof(Tk));
+        }
+        memcpy(items, _items, _count * sizeof(T*));
+        Heap::memFree(_cols);
+        Heap::memFree(_items);
+    }
+    _cols = cols;
+    _items = items;
+    _size = size;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+Tk TopicMatcher<T,Tk>::getToken(const Tk* id, uint8_t level, bool* ended) const{
+    if(*ended || id[level] == KeyNotUsed){
+        *ended = true;
+        return KeyNotUsed;
+    }
+    return id[level];
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+bool TopicMatcher<T,Tk>::matchItem(const Tk* id, uint32_t i) const{
+    for(uint8_t level = 0; level < _max_level; level++){
+        Tk key = _cols[(level * _size) + i];
+        if(key == KeyAll){
+            return true;
+        }
+        if(id[level] == KeyNotUsed){
+            return (key == KeyNotUsed);
+        }
+        if(key != KeyAny && key != id[level]){
+            return false;
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+uint32_t TopicMatcher<T,Tk>::matchBlock(const Tk* id, uint32_t from) const{
+#if TOPICMATCHER_VECTOR_BYTES > 0
+    typedef TopicMatcherVec V;
+    const typename V::Vector key_any = V::set((Tk)KeyAny);
+    const typename V::Vector key_all = V::set((Tk)KeyAll);
+    // 'alive' marca las suscripciones que encajan hasta el nivel actual, 'done' las que han finalizado en '#'
+    typename V::Vector alive = V::ones();
+    typename V::Vector done = V::zero();
+    for(uint8_t level = 0; level < _max_level; level++){
+        typename V::Vector col = V::load(&_cols[(level * _size) + from]);
+        done = V::vor(done, V::vand(alive, V::eq(col, key_all, (Tk)0)));
+        // al finalizar el identificador publicado, solo encajan las suscripciones que finalizan en el mismo nivel
+        if(id[level] == KeyNotUsed){
+            return V::mask(V::vor(done, V::vand(alive, V::eq(col, V::zero(), (Tk)0))));
+        }
+        alive = V::vand(alive, V::vor(V::eq(col, V::set(id[level]), (Tk)0), V::eq(col, key_any, (Tk)0)));
+        if(!V::mask(alive)){
+            return V::mask(done);
+        }
+    }
+    return V::mask(V::vor(done, alive));
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,214 @@
+/*
+ * TopicTable.h
+ *
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ * 	TopicTable es una tabla plana de topics organizada por columnas (structure of arrays): un array contiguo de
+ *	identificadores, un array de desplazamientos de los nombres sobre un unico buffer de nombres, y un array de
+ *	tramos (primer suscriptor, numero y capacidad) sobre un unico array de suscriptores. De esta forma, los
+ *	suscriptores de un topic ocupan posiciones consecutivas y recorrerlos no requiere seguir punteros.
+ *
+ *	Cada topic se identifica por su fila en la tabla. Al eliminar un topic, la ultima fila ocupa su posicion
+ *	(swap-and-pop), por lo que la fila de ese topic cambia. Un suscriptor se identifica por la fila de su topic y
+ *	su posicion dentro del tramo, que solo cambia al eliminar suscriptores anteriores del mismo topic.
+ *
+ *	Cuando un tramo se llena, se reubica al final del array de suscriptores con el doble de capacidad. El hueco
+ *	que deja, asi como el de los nombres eliminados, se recupera al ampliar los buffers, que se compactan en ese
+ *	momento. Los punteros obtenidos de la tabla (nombres y suscriptores) solo son validos hasta la siguiente
+ *	insercion.
+ *
+ *	Incluye un indice hash por nombre, que se reconstruye cuando se compacta el buffer de nombres.
+ */
+
+#ifndef __TOPICTABLE_H
+#define __TOPICTABLE_H
+
+#include <stdint.h>
+#include "HashMap.h"
+
+
+
+template<typename Id, typename S>
+class TopicTable {
+public:
+
+	/** Errores generados por la libreria */
+    enum Exception {
+		SUCCESS = 0,          	///< No exceptions raised
+		NULL_POINTER,         	///< Null pointer in operation
+		LIMIT_EXCEEDED,         ///< Max number of items reached
+		OUT_OF_MEMORY,          ///< No more dynamic memory
+		ITEM_NOT_FOUND,			///< Item not found in table
+	};
+
+
+    /** @fn TopicTable
+     *  @brief Constructor que crea una tabla vacia
+     *  @param max_topics Maximo numero de topics
+     */
+    TopicTable(uint32_t max_topics);
+
+
+    /** @fn ~TopicTable
+     *  @brief Destructor por defecto
+     */
+    ~TopicTable();
+
+
+    /** @fn addTopic
+     *  @brief Inserta un topic sin suscriptores al final de la tabla
+     *  @param name Nombre del topic (se copia en el buffer de nombres)
+     *  @param id Identificador del topic
+     *  @param row Recibe la fila del topic
+     *  @return Resultado
+     */
+    int32_t addTopic(const char* name, const Id* id, uint32_t* row);
+
+
+    /** @fn removeTopic
+     *  @brief Elimina un topic y sus suscriptores. La ultima fila pasa a ocupar su posicion.
+     *  @param row Fila del topic
+     *  @param moved Recibe la fila anterior del topic reubicado (igual a 'row' si era el ultimo)
+     *  @return Resultado
+     */
+    int32_t removeTopic(uint32_t row, uint32_t* moved);
+
+
+    /** @fn findTopic
+     *  @brief Busca un topic por su nombre
+     *  @param name Nombre del topic
+     *  @param row Recibe la fila del topic
+     *  @return True si existe, False si no existe
+     */
+    bool findTopic(const char* name, uint32_t* row);
+
+
+    /** @fn addSubscriber
+     *  @brief Inserta un suscriptor al final del tramo de un topic
+     *  @param row Fila del topic
+     *  @param sbc Suscriptor (se copia)
+     *  @return Resultado
+     */
+    int32_t addSubscriber(uint32_t row, const S& sbc);
+
+
+    /** @fn removeSubscriber
+     *  @brief Elimina un suscriptor de un topic, desplazando los posteriores para conservar el orden
+     *  @param row Fila del topic
+     *  @param pos Posicion del suscriptor en el tramo
+     *  @return Resultado
+     */
+    int32_t removeSubscriber(uint32_t row, uint16_t pos);
+
+
+    /** @fn removeAll
+     *  @brief Elimina todos los topics
+     */
+    void removeAll();
+
+
+    /** @fn getTopicCount
+     *  @brief Obtiene el numero de topics
+     */
+    uint32_t getTopicCount() const { return _count; }
+
+
+    /** @fn getSubscriberTotal
+     *  @brief Obtiene el numero de suscriptores de todos los topics
+     */
+    uint32_t getSubscriberTotal() const { return _subs_count; }
+
+
+    /** @fn getId
+     *  @brief Obtiene el identificador de un topic
+     */
+    const Id* getId(uint32_t row) const { return &_ids[row]; }
+
+
+    /** @fn setId
+     *  @brief Sustituye el identificador de un topic
+     */
+    void setId(uint32_t row, const Id* id) { _ids[row] = *id; }
+
+
+    /** @fn getName
+     *  @brief Obtiene el nombre de un topic
+     */
+    const char* getName(uint32_t row) const { return &_pool[_names[row]]; }
+
+
+    /** @fn getSubscribers
+     *  @brief Obtiene el primer suscriptor del tramo de un topic
+     */
+    S* getSubscribers(uint32_t row) const { return &_subs[_spans[row].first]; }
+
+
+    /** @fn getSubscriberCount
+     *  @brief Obtiene el numero de suscriptores de un topic
+     */
+    uint16_t getSubscriberCount(uint32_t row) const { return _spans[row].count; }
+
+private:
+
+    /** Capacidad inicial de cada columna y de los buffers */
+    static const uint32_t DefaultTopics = 16;
+    static const uint32_t DefaultPoolSize = 256;
+    static const uint32_t DefaultSubscribers = 32;
+
+    /** Tramo de suscriptores de un topic */
+    struct Span{
+        uint32_t first;             ///< Posicion del primer suscriptor
+        uint16_t count;             ///< Numero de suscriptores
+        uint16_t size;              ///< Capacidad del tramo
+    };
+
+    Id*       _ids;                 ///< Identificadores de los topics
+    uint32_t* _names;               ///< Desplazamiento del nombre de cada topic en _pool
+    Span*     _spans;               ///< Tramo de suscriptores de cada topic en _subs
+    uint32_t  _count;               ///< Numero de topics
+    uint32_t  _size;                ///< Capacidad de las columnas
+    uint32_t  _limit;               ///< Maximo numero de topics
+
+    char*     _pool;                ///< Buffer de nombres
+    uint32_t  _pool_used;           ///< Bytes ocupados (incluidos los nombres eliminados)
+    uint32_t  _pool_free;           ///< Bytes de nombres eliminados
+    uint32_t  _pool_size;           ///< Capacidad del buffer de nombres
+
+    S*        _subs;                ///< Suscriptores de todos los topics
+    uint32_t  _subs_used;           ///< Posiciones ocupadas (incluidos los tramos reubicados o eliminados)
+    uint32_t  _subs_free;           ///< Posiciones de tramos reubicados o eliminados
+    uint32_t  _subs_size;           ///< Capacidad del array de suscriptores
+    uint32_t  _subs_count;          ///< Numero de suscriptores
+
+    HashMap<uint32_t> _index;       ///< Indice hash: nombre -> fila
+
+
+    /** @fn growTopics
+     *  @brief Duplica la capacidad de las columnas
+     *  @return Resultado
+     */
+    int32_t growTopics();
+
+
+    /** @fn reservePool
+     *  @brief Asegura espacio para un nombre al final del buffer de nombres, compactandolo si es necesario
+     *  @param len Bytes necesarios
+     *  @return Resultado
+     */
+    int32_t reservePool(uint32_t len);
+
+
+    /** @fn reserveSubscribers
+     *  @brief Asegura espacio para un tramo al final del array de suscriptores, compactandolo si es necesario
+     *  @param count Posiciones necesarias
+     *  @return Resultado
+     */
+    int32_t reserveSubscribers(uint32_t count);
+
+};
+
+#include "TopicTable_tpp.h"
+
+#endif
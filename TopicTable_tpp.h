@@ -0,0 +1,283 @@
+/*
+ * TopicTable.tpp
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ *  Implementacion de la libreria TopicTable.
+ */
+
+/** Archivo de cabecera para abstraer las reservas de memoria del Heap */
+#include "Heap.h"
+#include <string.h>
+
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC FUNCTIONS ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename Id, typename S>
+TopicTable<Id,S>::TopicTable(uint32_t max_topics) : _index(DefaultTopics){
+    _ids = 0;
+    _names = 0;
+    _spans = 0;
+    _count = 0;
+    _size = 0;
+    _limit = max_topics;
+    _pool = 0;
+    _pool_used = 0;
+    _pool_free = 0;
+    _pool_size = 0;
+    _subs = 0;
+    _subs_used = 0;
+    _subs_free = 0;
+    _subs_size = 0;
+    _subs_count = 0;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+TopicTable<Id,S>::~TopicTable(){
+    removeAll();
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::addTopic(const char* name, const Id* id, uint32_t* row){
+    if(!name || !id || !row){
+        return(NULL_POINTER);
+    }
+    if(_count >= _limit){
+        return(LIMIT_EXCEEDED);
+    }
+    uint32_t len = strlen(name) + 1;
+    if((_count >= _size && growTopics() != SUCCESS) || reservePool(len) != SUCCESS){
+        return(OUT_OF_MEMORY);
+    }
+    memcpy(&_pool[_pool_used], name, len);
+    if(_index.addItem(&_pool[_pool_used], _count) != HashMap<uint32_t>::SUCCESS){
+        return(OUT_OF_MEMORY);
+    }
+    _ids[_count] = *id;
+    _names[_count] = _pool_used;
+    _spans[_count].first = 0;
+    _spans[_count].count = 0;
+    _spans[_count].size = 0;
+    _pool_used += len;
+    *row = _count++;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::removeTopic(uint32_t row, uint32_t* moved){
+    if(!moved){
+        return(NULL_POINTER);
+    }
+    if(row >= _count){
+        return(ITEM_NOT_FOUND);
+    }
+    uint32_t last = _count - 1;
+    _index.removeItem(getName(row));
+    _pool_free += strlen(getName(row)) + 1;
+    _subs_free += _spans[row].size;
+    _subs_count -= _spans[row].count;
+    // la ultima fila ocupa el hueco
+    if(row != last){
+        _index.removeItem(getName(last));
+        _ids[row] = _ids[last];
+        _names[row] = _names[last];
+        _spans[row] = _spans[last];
+        _index.addItem(getName(row), row);
+    }
+    _count--;
+    *moved = last;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+bool TopicTable<Id,S>::findTopic(const char* name, uint32_t* row){
+    return _index.getItem(name, row);
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::addSubscriber(uint32_t row, const S& sbc){
+    if(row >= _count){
+        return(ITEM_NOT_FOUND);
+    }
+    // si el tramo esta lleno, se reubica al final con el doble de capacidad
+    if(_spans[row].count >= _spans[row].size){
+        if(_spans[row].size >= 0x8000){
+            return(LIMIT_EXCEEDED);
+        }
+        uint16_t size = (_spans[row].size)? (_spans[row].size << 1) : 1;
+        if(reserveSubscribers(size) != SUCCESS){
+            return(OUT_OF_MEMORY);
+        }
+        Span* span = &_spans[row];
+        if(span->count){
+            memcpy(&_subs[_subs_used], &_subs[span->first], span->count * sizeof(S));
+        }
+        _subs_free += span->size;
+        span->first = _subs_used;
+        span->size = size;
+        _subs_used += size;
+    }
+    _subs[_spans[row].first + _spans[row].count] = sbc;
+    _spans[row].count++;
+    _subs_count++;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::removeSubscriber(uint32_t row, uint16_t pos){
+    if(row >= _count || pos >= _spans[row].count){
+        return(ITEM_NOT_FOUND);
+    }
+    Span* span = &_spans[row];
+    span->count--;
+    memmove(&_subs[span->first + pos], &_subs[span->first + pos + 1], (span->count - pos) * sizeof(S));
+    _subs_count--;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+void TopicTable<Id,S>::removeAll(){
+    _index.removeAll();
+    if(_ids){
+        Heap::memFree(_ids);
+        Heap::memFree(_names);
+        Heap::memFree(_spans);
+    }
+    if(_pool){
+        Heap::memFree(_pool);
+    }
+    if(_subs){
+        Heap::memFree(_subs);
+    }
+    _ids = 0;
+    _names = 0;
+    _spans = 0;
+    _pool = 0;
+    _subs = 0;
+    _count = _size = 0;
+    _pool_used = _pool_free = _pool_size = 0;
+    _subs_used = _subs_free = _subs_size = _subs_count = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+//-- PRIVATE FUNCTIONS ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::growTopics(){
+    uint32_t size = (_size)? (_size << 1) : DefaultTopics;
+    if(size > _limit){
+        size = _limit;
+    }
+    Id* ids = (Id*)Heap::memAlloc(size * sizeof(Id));
+    uint32_t* names = (uint32_t*)Heap::memAlloc(size * sizeof(uint32_t));
+    Span* spans = (Span*)Heap::memAlloc(size * sizeof(Span));
+    if(!ids || !names || !spans){
+        if(ids){
+            Heap::memFree(ids);
+        }
+        if(names){
+            Heap::memFree(names);
+        }
+        if(spans){
+            Heap::memFree(spans);
+        }
+        return(OUT_OF_MEMORY);
+    }
+    if(_ids){
+        memcpy(ids, _ids, _count * sizeof(Id));
+        memcpy(names, _names, _count * sizeof(uint32_t));
+        memcpy(spans, _spans, _count * sizeof(Span));
+        Heap::memFree(_ids);
+        Heap::memFree(_names);
+        Heap::memFree(_spans);
+    }
+    _ids = ids;
+    _names = names;
+    _spans = spans;
+    _size = size;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::reservePool(uint32_t len){
+    if(_pool_used + len <= _pool_size){
+        return SUCCESS;
+    }
+    // el nuevo buffer duplica el espacio ocupado por los nombres vigentes
+    uint32_t live = _pool_used - _pool_free;
+    uint32_t size = (_pool_size)? _pool_size : DefaultPoolSize;
+    while(size < ((live + len) << 1)){
+        size <<= 1;
+    }
+    char* pool = (char*)Heap::memAlloc(size);
+    if(!pool){
+        return(OUT_OF_MEMORY);
+    }
+    // copia los nombres de forma compacta, en el orden de las filas, y reconstruye el indice
+    uint32_t used = 0;
+    _index.removeAll();
+    for(uint32_t row = 0; row < _count; row++){
+        uint32_t n = strlen(getName(row)) + 1;
+        memcpy(&pool[used], getName(row), n);
+        _names[row] = used;
+        _index.addItem(&pool[used], row);
+        used += n;
+    }
+    if(_pool){
+        Heap::memFree(_pool);
+    }
+    _pool = pool;
+    _pool_size = size;
+    _pool_used = used;
+    _pool_free = 0;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename Id, typename S>
+int32_t TopicTable<Id,S>::reserveSubscribers(uint32_t count){
+    if(_subs_used + count <= _subs_size){
+        return SUCCESS;
+    }
+    // el nuevo array duplica el espacio ocupado por los tramos vigentes
+    uint32_t live = _subs_used - _subs_free;
+    uint32_t size = (_subs_size)? _subs_size : DefaultSubscribers;
+    while(size < ((live + count) << 1)){
+        size <<= 1;
+    }
+    S* subs = (S*)Heap::memAlloc(size * sizeof(S));
+    if(!subs){
+        return(OUT_OF_MEMORY);
+    }
+    // copia los tramos de forma compacta, en el orden de las filas, conservando su capacidad
+    uint32_t used = 0;
+    for(uint32_t row = 0; row < _count; row++){
+        if(_spans[row].count){
+            memcpy(&subs[used], &_subs[_spans[row].first], _spans[row].count * sizeof(S));
+        }
+        _spans[row].first = used;
+        used += _spans[row].size;
+    }
+    if(_subs){
+        Heap::memFree(_subs);
+    }
+    _subs = subs;
+    _subs_size = size;
+    _subs_used = used;
+    _subs_free = 0;
+    return SUCCESS;
+}
@@ -0,0 +1,221 @@
+/*
+ * TopicTree.h
+ *
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ * 	TopicTree es un indice en arbol (trie) de suscripciones, en el que cada nivel del arbol se corresponde con un
+ *	nivel del identificador del topic. Cada nodo dispone de una lista ordenada de hijos indexada por el valor del
+ *	token, y de dos ramas dedicadas para los wildcards '+' y '#'. De esta forma, la busqueda de los topics que
+ *	encajan con una publicacion depende de la profundidad del topic y del numero de coincidencias, y no del numero
+ *	total de suscripciones registradas.
+ *
+ *	Los valores de los wildcards coinciden con la codificacion utilizada por MQBroker:
+ *		0: nivel no utilizado (fin del topic)
+ *		1: wildcard '+'
+ *		2: wildcard '#'
+ *
+ *	Las hojas del arbol son punteros a cualquier tipo de datos, ya que el arbol se define como un template.
+ */
+
+#ifndef __TOPICTREE_H
+#define __TOPICTREE_H
+
+#include <stdint.h>
+
+
+
+template<typename T, typename Tk = uint8_t>
+class TopicTree {
+public:
+
+	/** Errores generados por la libreria */
+    enum Exception {
+		SUCCESS = 0,          	///< No exceptions raised
+		NULL_POINTER,         	///< Null pointer in operation
+		OUT_OF_MEMORY,          ///< No more dynamic memory
+		ITEM_NOT_FOUND,			///< Item not found in tree
+	};
+
+	/** Valores reservados de los tokens */
+	enum Keys {
+		KeyNotUsed = 0,			///< Fin del topic
+		KeyAny,					///< Wildcard '+'
+		KeyAll,					///< Wildcard '#'
+	};
+
+
+    /** @fn TopicTree
+     *  @brief Constructor que crea un arbol vacio
+     *  @param max_level Profundidad maxima de los identificadores
+     */
+    TopicTree(uint8_t max_level);
+
+
+    /** @fn ~TopicTree
+     *  @brief Destructor por defecto
+     */
+    ~TopicTree();
+
+
+    /** @fn addItem
+     *  @brief Registra un objeto en la hoja correspondiente al identificador
+     *  @param id Identificador del topic (array de tokens finalizado en KeyNotUsed o en max_level)
+     *  @param item Objeto a registrar
+     *  @return Resultado
+     */
+    int32_t addItem(const Tk* id, T* item);
+
+
+    /** @fn removeItem
+     *  @brief Elimina un objeto de la hoja correspondiente al identificador, liberando las ramas
+     *         que quedan vacias
+     *  @param id Identificador del topic
+     *  @param item Objeto a eliminar
+     *  @return Resultado
+     */
+    int32_t removeItem(const Tk* id, T* item);
+
+
+    /** @fn getItemCount
+     *  @brief Obtiene el numero de objetos registrados
+     *  @return Numero de objetos
+     */
+    uint32_t getItemCount();
+
+
+    /** @fn match
+     *  @brief Recorre todas las hojas cuyo identificador encaja con el identificador publicado,
+     *         teniendo en cuenta los wildcards registrados. Por cada objeto encontrado invoca
+     *         a visitor(T*).
+     *         Durante el recorrido se permite registrar y eliminar objetos desde el visitor; los
+     *         nodos vacios se liberan al finalizar el recorrido mas externo.
+     *  @param id Identificador publicado
+     *  @param visitor Funcion a invocar por cada objeto encontrado
+     *  @return Numero de objetos encontrados
+     */
+    template<typename F>
+    uint32_t match(const Tk* id, F& visitor);
+
+
+    /** @fn match
+     *  @brief Recorrido de solo lectura. Igual que el anterior, pero el visitor no puede modificar
+     *         el arbol. Al no alterar el estado del arbol, admite recorridos concurrentes desde varios
+     *         hilos siempre que el arbol no se modifique mientras tanto.
+     *  @param id Identificador publicado
+     *  @param visitor Funcion a invocar por cada objeto encontrado
+     *  @return Numero de objetos encontrados
+     */
+    template<typename F>
+    uint32_t match(const Tk* id, F& visitor) const;
+
+
+    /** @fn renameKeys
+     *  @brief Sustituye los tokens de los nodos del arbol segun una tabla de correspondencias, sin reservar
+     *         memoria y manteniendo ordenados los hijos de cada nodo. Los tokens destino no deben existir
+     *         en el arbol. No debe utilizarse durante un recorrido.
+     *  @param from Tokens a sustituir
+     *  @param to Nuevos tokens
+     *  @param count Numero de tokens
+     *  @return Resultado
+     */
+    int32_t renameKeys(const Tk* from, const Tk* to, uint16_t count);
+
+private:
+
+    /** Estructura de los nodos del arbol */
+    struct Node{
+        Tk key;                     ///< Token asociado al nodo
+        Node* any;                  ///< Rama del wildcard '+'
+        Node* all;                  ///< Rama del wildcard '#'
+        Node** child;               ///< Hijos ordenados por token
+        uint16_t child_count;       ///< Numero de hijos
+        uint16_t child_size;        ///< Capacidad del array de hijos
+        T** leaf;                   ///< Objetos que terminan en este nodo
+        uint16_t leaf_count;        ///< Numero de objetos
+        uint16_t leaf_size;         ///< Capacidad del array de objetos
+    };
+
+    Node*    _root;         ///< Nodo raiz
+    uint8_t  _max_level;    ///< Profundidad maxima
+    uint32_t _count;        ///< Numero de objetos registrados
+    uint8_t  _walking;      ///< Recorridos en curso (anidados)
+    bool     _prune;        ///< Flag de poda pendiente al finalizar los recorridos
+
+
+    /** @fn createNode
+     *  @brief Crea un nodo vacio
+     *  @param key Token asociado
+     *  @return Nodo o NULL si no hay memoria
+     */
+    Node* createNode(Tk key);
+
+
+    /** @fn destroyNode
+     *  @brief Libera un nodo y todas sus ramas
+     *  @param node Nodo a liberar
+     */
+    void destroyNode(Node* node);
+
+
+    /** @fn findChild
+     *  @brief Busca (busqueda binaria) la posicion de un hijo
+     *  @param node Nodo padre
+     *  @param key Token a buscar
+     *  @param pos Recibe la posicion del hijo o la posicion de insercion
+     *  @return Hijo o NULL si no existe
+     */
+    Node* findChild(Node* node, Tk key, uint16_t* pos) const;
+
+
+    /** @fn getOrCreateChild
+     *  @brief Obtiene la rama asociada a un token, creandola si no existe
+     *  @param node Nodo padre
+     *  @param key Token
+     *  @return Hijo o NULL si no hay memoria
+     */
+    Node* getOrCreateChild(Node* node, Tk key);
+
+
+    /** @fn removeFrom
+     *  @brief Elimina recursivamente un objeto, liberando las ramas que quedan vacias
+     *  @param node Nodo actual
+     *  @param id Identificador del topic
+     *  @param level Nivel del nodo actual
+     *  @param item Objeto a eliminar
+     *  @return Resultado
+     */
+    int32_t removeFrom(Node* node, const Tk* id, uint8_t level, T* item);
+
+
+    /** @fn isEmpty
+     *  @brief Chequea si un nodo no tiene ni hojas ni ramas
+     */
+    bool isEmpty(Node* node);
+
+
+    /** @fn prune
+     *  @brief Libera las ramas vacias de un nodo
+     *  @param node Nodo a podar
+     */
+    void prune(Node* node);
+
+
+    /** @fn renameFrom
+     *  @brief Sustitucion recursiva de tokens (ver renameKeys)
+     */
+    void renameFrom(Node* node, const Tk* from, const Tk* to, uint16_t count);
+
+
+    /** @fn walk
+     *  @brief Recorrido recursivo del arbol
+     */
+    template<typename F>
+    uint32_t walk(Node* node, const Tk* id, uint8_t level, F& visitor) const;
+
+};
+
+#include "TopicTree_tpp.h"
+
+#endif
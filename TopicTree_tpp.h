@@ -0,0 +1,417 @@
+/*
+ * TopicTree.tpp
+ *
+ *  Version: 17 Oct 2026
+ *  Author: raulMrello
+ *
+ *  Implementacion de la libreria TopicTree.
+ */
+
+/** Archivo de cabecera para abstraer las reservas de memoria del Heap */
+#include "Heap.h"
+#include <string.h>
+
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC FUNCTIONS ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename T, typename Tk>
+TopicTree<T,Tk>::TopicTree(uint8_t max_level){
+    _max_level = max_level;
+    _count = 0;
+    _walking = 0;
+    _prune = false;
+    _root = createNode(KeyNotUsed);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+TopicTree<T,Tk>::~TopicTree(){
+    destroyNode(_root);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicTree<T,Tk>::addItem(const Tk* id, T* item){
+    if(!id || !item || !_root){
+        return(NULL_POINTER);
+    }
+    // desciende por el arbol creando las ramas no existentes
+    Node* node = _root;
+    for(uint8_t level = 0; level < _max_level && id[level] != KeyNotUsed; level++){
+        node = getOrCreateChild(node, id[level]);
+        if(!node){
+            return(OUT_OF_MEMORY);
+        }
+        // tras un '#' no se analizan mas niveles
+        if(id[level] == KeyAll){
+            break;
+        }
+    }
+    // si no hay hueco para la hoja, duplica el array sin superar la capacidad del contador
+    if(node->leaf_count >= node->leaf_size){
+        if(node->leaf_size == 0xFFFF){
+            return(OUT_OF_MEMORY);
+        }
+        uint16_t size = (node->leaf_size)? ((node->leaf_size < 0x8000)? (node->leaf_size << 1) : 0xFFFF) : 2;
+        T** leaf = (T**)Heap::memAlloc(size * sizeof(T*));
+        if(!leaf){
+            return(OUT_OF_MEMORY);
+        }
+        if(node->leaf){
+            memcpy(leaf, node->leaf, node->leaf_count * sizeof(T*));
+            Heap::memFree(node->leaf);
+        }
+        node->leaf = leaf;
+        node->leaf_size = size;
+    }
+    node->leaf[node->leaf_count++] = item;
+    _count++;
+    return SUCCESS;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicTree<T,Tk>::removeItem(const Tk* id, T* item){
+    if(!id || !item || !_root){
+        return(NULL_POINTER);
+    }
+    int32_t rc = removeFrom(_root, id, 0, item);
+    if(rc == SUCCESS){
+        _count--;
+    }
+    return rc;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+uint32_t TopicTree<T,Tk>::getItemCount(){
+    return _count;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+template<typename F>
+uint32_t TopicTree<T,Tk>::match(const Tk* id, F& visitor){
+    if(!id || !_root){
+        return 0;
+    }
+    _walking++;
+    uint32_t count = walk(_root, id, 0, visitor);
+    // al finalizar el recorrido mas externo, libera las ramas que hayan quedado vacias
+    if(--_walking == 0 && _prune){
+        _prune = false;
+        prune(_root);
+    }
+    return count;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+template<typename F>
+uint32_t TopicTree<T,Tk>::match(const Tk* id, F& visitor) const{
+    if(!id || !_root){
+        return 0;
+    }
+    return walk(_root, id, 0, visitor);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicTree<T,Tk>::renameKeys(const Tk* from, const Tk* to, uint16_t count){
+    if(!from || !to || !_root){
+        return(NULL_POINTER);
+    }
+    renameFrom(_root, from, to, count);
+    return SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------------
+//-- PRIVATE FUNCTIONS ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename T, typename Tk>
+typename TopicTree<T,Tk>::Node* TopicTree<T,Tk>::createNode(Tk key){
+    Node* node = (Node*)Heap::memAlloc(sizeof(Node));
+    if(!node){
+        return 0;
+    }
+    memset(node, 0, sizeof(Node));
+    node->key = key;
+    return node;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+void TopicTree<T,Tk>::destroyNode(Node* node){
+    if(!node){
+        return;
+    }
+    destroyNode(node->any);
+    destroyNode(node->all);
+    for(uint16_t i = 0; i < node->child_count; i++){
+        destroyNode(node->child[i]);
+    }
+    if(node->child){
+        Heap::memFree(node->child);
+    }
+    if(node->leaf){
+        Heap::memFree(node->leaf);
+    }
+    Heap::memFree(node);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+typename TopicTree<T,Tk>::Node* TopicTree<T,Tk>::findChild(Node* node, Tk key, uint16_t* pos) const{
+    uint16_t lo = 0, hi = node->child_count;
+    while(lo < hi){
+        uint16_t mid = (lo + hi) >> 1;
+        Tk k = node->child[mid]->key;
+        if(k == key){
+            *pos = mid;
+            return node->child[mid];
+        }
+        if(k < key){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+typename TopicTree<T,Tk>::Node* TopicTree<T,Tk>::getOrCreateChild(Node* node, Tk key){
+    // las ramas de wildcards tienen un acceso dedicado
+    if(key == KeyAny){
+        if(!node->any){
+            node->any = createNode(key);
+        }
+        return node->any;
+    }
+    if(key == KeyAll){
+        if(!node->all){
+            node->all = createNode(key);
+        }
+        return node->all;
+    }
+    uint16_t pos;
+    Node* child = findChild(node, key, &pos);
+    if(child){
+        return child;
+    }
+    child = createNode(key);
+    if(!child){
+        return 0;
+    }
+    // si no hay hueco, amplia el array de hijos
+    if(node->child_count >= node->child_size){
+        uint16_t size = (node->child_size)? (node->child_size << 1) : 2;
+        Node** array = (Node**)Heap::memAlloc(size * sizeof(Node*));
+        if(!array){
+            Heap::memFree(child);
+            return 0;
+        }
+        if(node->child){
+            memcpy(array, node->child, node->child_count * sizeof(Node*));
+            Heap::memFree(node->child);
+        }
+        node->child = array;
+        node->child_size = size;
+    }
+    // inserta de forma ordenada
+    memmove(&node->child[pos+1], &node->child[pos], (node->child_count - pos) * sizeof(Node*));
+    node->child[pos] = child;
+    node->child_count++;
+    return child;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+bool TopicTree<T,Tk>::isEmpty(Node* node){
+    return (!node->leaf_count && !node->child_count && !node->any && !node->all);
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+void TopicTree<T,Tk>::prune(Node* node){
+    // compacta las hojas marcadas como libres
+    uint16_t n = 0;
+    for(uint16_t i = 0; i < node->leaf_count; i++){
+        if(node->leaf[i]){
+            node->leaf[n++] = node->leaf[i];
+        }
+    }
+    node->leaf_count = n;
+    if(!n && node->leaf){
+        Heap::memFree(node->leaf);
+        node->leaf = 0;
+        node->leaf_size = 0;
+    }
+    // poda las ramas
+    if(node->any){
+        prune(node->any);
+        if(isEmpty(node->any)){
+            destroyNode(node->any);
+            node->any = 0;
+        }
+    }
+    if(node->all){
+        prune(node->all);
+        if(isEmpty(node->all)){
+            destroyNode(node->all);
+            node->all = 0;
+        }
+    }
+    uint16_t c = 0;
+    for(uint16_t i = 0; i < node->child_count; i++){
+        Node* child = node->child[i];
+        prune(child);
+        if(isEmpty(child)){
+            destroyNode(child);
+        }
+        else{
+            node->child[c++] = child;
+        }
+    }
+    node->child_count = c;
+    if(!c && node->child){
+        Heap::memFree(node->child);
+        node->child = 0;
+        node->child_size = 0;
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+void TopicTree<T,Tk>::renameFrom(Node* node, const Tk* from, const Tk* to, uint16_t count){
+    bool renamed = false;
+    for(uint16_t i = 0; i < node->child_count; i++){
+        Node* child = node->child[i];
+        for(uint16_t k = 0; k < count; k++){
+            if(child->key == from[k]){
+                child->key = to[k];
+                renamed = true;
+                break;
+            }
+        }
+        renameFrom(child, from, to, count);
+    }
+    // la rama '#' no tiene descendientes, por lo que no requiere cambios
+    if(node->any){
+        renameFrom(node->any, from, to, count);
+    }
+    // reordena los hijos por insercion, ya que solo cambian unos pocos tokens
+    if(renamed){
+        for(uint16_t i = 1; i < node->child_count; i++){
+            Node* child = node->child[i];
+            uint16_t j = i;
+            while(j > 0 && node->child[j-1]->key > child->key){
+                node->child[j] = node->child[j-1];
+                j--;
+            }
+            node->child[j] = child;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+int32_t TopicTree<T,Tk>::removeFrom(Node* node, const Tk* id, uint8_t level, T* item){
+    // si ha llegado a la hoja, busca el objeto
+    if(level >= _max_level || id[level] == KeyNotUsed || (level > 0 && id[level-1] == KeyAll)){
+        for(uint16_t i = 0; i < node->leaf_count; i++){
+            if(node->leaf[i] == item){
+                // durante un recorrido no se desplazan las hojas, se marcan como libres
+                if(_walking){
+                    node->leaf[i] = 0;
+                    _prune = true;
+                    return SUCCESS;
+                }
+                node->leaf_count--;
+                memmove(&node->leaf[i], &node->leaf[i+1], (node->leaf_count - i) * sizeof(T*));
+                if(!node->leaf_count){
+                    Heap::memFree(node->leaf);
+                    node->leaf = 0;
+                    node->leaf_size = 0;
+                }
+                return SUCCESS;
+            }
+        }
+        return(ITEM_NOT_FOUND);
+    }
+    // en otro caso, desciende por la rama correspondiente
+    uint16_t pos = 0;
+    Node* child;
+    if(id[level] == KeyAny){
+        child = node->any;
+    }
+    else if(id[level] == KeyAll){
+        child = node->all;
+    }
+    else{
+        child = findChild(node, id[level], &pos);
+    }
+    if(!child){
+        return(ITEM_NOT_FOUND);
+    }
+    int32_t rc = removeFrom(child, id, level+1, item);
+    // si la rama queda vacia, la libera (salvo durante un recorrido)
+    if(rc == SUCCESS && !_walking && isEmpty(child)){
+        if(child == node->any){
+            node->any = 0;
+        }
+        else if(child == node->all){
+            node->all = 0;
+        }
+        else{
+            node->child_count--;
+            memmove(&node->child[pos], &node->child[pos+1], (node->child_count - pos) * sizeof(Node*));
+        }
+        destroyNode(child);
+    }
+    return rc;
+}
+
+//------------------------------------------------------------------------------------
+template<typename T, typename Tk>
+template<typename F>
+uint32_t TopicTree<T,Tk>::walk(Node* node, const Tk* id, uint8_t level, F& visitor) const{
+    uint32_t count = 0;
+    // la rama '#' encaja con cualquier resto del topic (incluso vacio)
+    if(node->all){
+        for(uint16_t i = 0; i < node->all->leaf_count; i++){
+            if(node->all->leaf[i]){
+                visitor(node->all->leaf[i]);
+                count++;
+            }
+        }
+    }
+    // si ha llegado al final del topic publicado, notifica las hojas de este nodo
+    if(level >= _max_level || id[level] == KeyNotUsed){
+        for(uint16_t i = 0; i < node->leaf_count; i++){
+            if(node->leaf[i]){
+                visitor(node->leaf[i]);
+                count++;
+            }
+        }
+        return count;
+    }
+    // en otro caso, desciende por la rama del token y por la rama '+'
+    uint16_t pos;
+    Node* child = findChild(node, id[level], &pos);
+    if(child){
+        count += walk(child, id, level+1, visitor);
+    }
+    if(node->any){
+        count += walk(node->any, id, level+1, visitor);
+    }
+    return count;
+}
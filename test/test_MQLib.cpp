@@ -13,6 +13,8 @@
 #include "mbed.h"
 #include "AppConfig.h"
 #include "MQLib.h"
+#include "TopicMatcher.h"
+#include "TopicTable.h"
 
 
 #if ESP_PLATFORM == 1 || (__MBED__ == 1 && defined(ENABLE_TEST_DEBUGGING) && defined(ENABLE_TEST_MQLib))
@@ -26,6 +28,8 @@
 /** required for test execution */
 static MQ::PublishCallback s_published_cb;
 static MQ::SubscribeCallback s_subscribe_cb;
+/** '#' subscriber, kept so that the tests that need unmatched publications can suspend it */
+static MQ::SubscribeCallback s_all_topics_cb;
 static void subscriptionCb(const char* topic, void* msg, uint16_t msg_len);
 static void publishedCb(const char* topic, int32_t result);
 static void executePrerequisites();
@@ -84,8 +88,9 @@ TEST_CASE("Check simple topics matching .........", "[MQLib]") {
 	const char** tklist;
 	uint32_t tkcount;
 	MQ::MQClient::getInternalTokenList(tklist, tkcount);
-	DEBUG_TRACE_D(_EXPR_, _MODULE_, "Registered tokens (should be 10): %d", tkcount);
-	TEST_ASSERT_EQUAL(tkcount, 10);
+	// numeric levels (0, 2) are not registered as tokens
+	DEBUG_TRACE_D(_EXPR_, _MODULE_, "Registered tokens (should be 8): %d", tkcount);
+	TEST_ASSERT_EQUAL(tkcount, 8);
 
 	for(int i=0; i < tkcount; i++){
 		DEBUG_TRACE_D(_EXPR_, _MODULE_, "%s", *tklist);
@@ -238,7 +243,8 @@ TEST_CASE("Check simple topics rejections .......", "[MQLib]") {
 
 	if(!MQ::MQClient::existsTopic("#")){
 		DEBUG_TRACE_D(_EXPR_, _MODULE_, "Suscription to #");
-		res = MQ::MQClient::subscribe("#", new MQ::SubscribeCallback(&subscriptionCb));
+		s_all_topics_cb = callback(&subscriptionCb);
+		res = MQ::MQClient::subscribe("#", &s_all_topics_cb);
 		TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
 	}
 
@@ -319,6 +325,1880 @@ TEST_CASE("MQLib BRIDGE2 REMOVE .................", "[MQLib]") {
 	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("topic/bridge", &bc2), MQ::SUCCESS);
 }
 
+//---------------------------------------------------------------------------
+/**
+ * @brief Check subscription index after unsubscriptions:
+ * tree/+/leaf
+ * tree/#
+ */
+static MQ::SubscribeCallback s_tree_any_cb;
+static MQ::SubscribeCallback s_tree_all_cb;
+
+TEST_CASE("Check wildcards unsubscription .......", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	int32_t res;
+
+	// previous subscriptions (ie: '#') may also match
+	s_subscription_count = 0;
+	res = MQ::MQClient::publish("tree/node/leaf", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	uint32_t prev_count = s_subscription_count;
+
+	s_tree_any_cb = callback(&subscriptionCb);
+	s_tree_all_cb = callback(&subscriptionCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("tree/+/leaf", &s_tree_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("tree/#", &s_tree_all_cb), MQ::SUCCESS);
+
+	s_subscription_count = 0;
+	res = MQ::MQClient::publish("tree/node/leaf", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_subscription_count, prev_count + 2);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("tree/+/leaf", &s_tree_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_FALSE(MQ::MQClient::existsTopic("tree/+/leaf"));
+	s_subscription_count = 0;
+	res = MQ::MQClient::publish("tree/node/leaf", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_subscription_count, prev_count + 1);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("tree/#", &s_tree_all_cb), MQ::SUCCESS);
+	s_subscription_count = 0;
+	res = MQ::MQClient::publish("tree/node/leaf", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_subscription_count, prev_count);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check topic name index with several subscriptions and removals:
+ * idx/0 ... idx/31
+ */
+static MQ::SubscribeCallback s_index_cb;
+
+TEST_CASE("Check topic name index ...............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	char name[16];
+
+	s_index_cb = callback(&subscriptionCb);
+	for(int i = 0; i < 32; i++){
+		sprintf(name, "idx/%d", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe(name, &s_index_cb), MQ::SUCCESS);
+	}
+	// subscriber already registered
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("idx/0", &s_index_cb), MQ::EXISTS);
+
+	// removes the even ones
+	for(int i = 0; i < 32; i += 2){
+		sprintf(name, "idx/%d", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe(name, &s_index_cb), MQ::SUCCESS);
+	}
+	for(int i = 0; i < 32; i++){
+		sprintf(name, "idx/%d", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::existsTopic(name), ((i & 1) != 0));
+	}
+	TEST_ASSERT_FALSE(MQ::MQClient::existsTopic("idx"));
+	TEST_ASSERT_FALSE(MQ::MQClient::existsTopic("idx/1/"));
+
+	// removes the rest
+	for(int i = 1; i < 32; i += 2){
+		sprintf(name, "idx/%d", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe(name, &s_index_cb), MQ::SUCCESS);
+		TEST_ASSERT_FALSE(MQ::MQClient::existsTopic(name));
+	}
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that tokens sharing a prefix get different ids:
+ * pfx/variable
+ * pfx/var
+ */
+static MQ::SubscribeCallback s_prefix_cb;
+static uint32_t s_prefix_count = 0;
+static void prefixCb(const char* topic, void* msg, uint16_t msg_len){
+	s_prefix_count++;
+}
+
+TEST_CASE("Check token prefixes .................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	int32_t res;
+
+	s_prefix_cb = callback(&prefixCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("pfx/variable", &s_prefix_cb), MQ::SUCCESS);
+
+	// 'var' must be registered as a new token, not matched against 'variable'
+	s_prefix_count = 0;
+	res = MQ::MQClient::publish("pfx/var", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_prefix_count, 0);
+
+	MQ::topic_t id_long, id_short;
+	MQ::MQClient::getTopicId(&id_long, "pfx/variable");
+	MQ::MQClient::getTopicId(&id_short, "pfx/var");
+	TEST_ASSERT_EQUAL(id_long.tk[0], id_short.tk[0]);
+	TEST_ASSERT_NOT_EQUAL(id_long.tk[1], id_short.tk[1]);
+
+	res = MQ::MQClient::publish("pfx/variable", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(res, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_prefix_count, 1);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("pfx/variable", &s_prefix_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check publications through pre-resolved handles:
+ * handle/a/b
+ * handle/+/b (subscribed after resolution)
+ */
+static MQ::SubscribeCallback s_handle_cb;
+static MQ::SubscribeCallback s_handle_any_cb;
+static uint32_t s_handle_count = 0;
+static void handleCb(const char* topic, void* msg, uint16_t msg_len){
+	TEST_ASSERT_EQUAL_STRING(topic, "handle/a/b");
+	s_handle_count++;
+}
+
+TEST_CASE("Check publish handles ................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	MQ::PublishHandle handle;
+
+	s_handle_cb = callback(&handleCb);
+	s_handle_any_cb = callback(&handleCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("handle/a/b", &s_handle_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("handle/a/b", &handle), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(handle.generation, MQ::MQBroker::getGeneration());
+
+	s_handle_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_handle_count, 1);
+
+	// a new subscription invalidates the handle, which is refreshed on the next publication
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("handle/+/b", &s_handle_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_NOT_EQUAL(handle.generation, MQ::MQBroker::getGeneration());
+	s_handle_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_handle_count, 2);
+
+	// and so does an unsubscription
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("handle/a/b", &s_handle_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("handle/+/b", &s_handle_any_cb), MQ::SUCCESS);
+	s_handle_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_handle_count, 0);
+
+	MQ::MQClient::release(&handle);
+	TEST_ASSERT_NULL(handle.name);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check zero-copy delivery: read-only subscribers get the publisher's buffer and
+ * mutable subscribers get a private copy:
+ * zcopy/a (mutable)
+ * zcopy/+ (read-only)
+ */
+static MQ::SubscribeCallback s_view_cb;
+static MQ::SubscribeCallback s_mutable_cb;
+static void* s_view_msg = NULL;
+static void* s_mutable_msg = NULL;
+static char s_view_data[8];
+static void viewCb(const char* topic, void* msg, uint16_t msg_len){
+	s_view_msg = msg;
+	memcpy(s_view_data, msg, msg_len);
+}
+static void mutableCb(const char* topic, void* msg, uint16_t msg_len){
+	s_mutable_msg = msg;
+	memset(msg, 'x', msg_len);
+}
+
+TEST_CASE("Check zero-copy delivery .............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	char data[8] = "zerocp";
+
+	s_view_cb = callback(&viewCb);
+	s_mutable_cb = callback(&mutableCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("zcopy/a", &s_mutable_cb, MQ::SubscribeMutable), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("zcopy/+", &s_view_cb), MQ::SUCCESS);
+
+	// by default both subscribers get a copy
+	s_view_msg = s_mutable_msg = NULL;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("zcopy/a", data, sizeof(data), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_NOT_NULL(s_view_msg);
+	TEST_ASSERT_TRUE(s_view_msg != (void*)data);
+	TEST_ASSERT_EQUAL_STRING(s_view_data, "zerocp");
+
+	// in zero-copy mode the read-only one gets the original buffer, the mutable one a copy
+	MQ::MQBroker::setZeroCopy(true);
+	s_view_msg = s_mutable_msg = NULL;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("zcopy/a", data, sizeof(data), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_TRUE(s_view_msg == (void*)data);
+	TEST_ASSERT_NOT_NULL(s_mutable_msg);
+	TEST_ASSERT_TRUE(s_mutable_msg != (void*)data);
+	TEST_ASSERT_EQUAL_STRING(data, "zerocp");
+	TEST_ASSERT_EQUAL_STRING(s_view_data, "zerocp");
+	MQ::MQBroker::setZeroCopy(false);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("zcopy/a", &s_mutable_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("zcopy/+", &s_view_cb), MQ::SUCCESS);
+}
+
+#if HEAP_POOL_ENABLED == 1
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that small blocks are served by the Heap slab pool and returned to it
+ */
+TEST_CASE("Check heap pool ......................", "[MQLib]") {
+	Heap::PoolStats before, after;
+	TEST_ASSERT_TRUE(Heap::getPoolStats(1, &before));
+	TEST_ASSERT_EQUAL(before.block_size, 32);
+
+	// a 20-byte block goes to the 32-byte class and is reused after being released
+	void* ptr = Heap::memAlloc(20);
+	TEST_ASSERT_NOT_NULL(ptr);
+	TEST_ASSERT_TRUE(Heap::getPoolStats(1, &after));
+	TEST_ASSERT_EQUAL(after.hits, before.hits + 1);
+	TEST_ASSERT_EQUAL(after.used, before.used + 1);
+	Heap::memFree(ptr);
+	TEST_ASSERT_EQUAL(Heap::memAlloc(24), ptr);
+	Heap::memFree(ptr);
+	TEST_ASSERT_TRUE(Heap::getPoolStats(1, &after));
+	TEST_ASSERT_EQUAL(after.used, before.used);
+
+	// blocks bigger than the largest class fall back to malloc
+	uint32_t large = Heap::getLargeAllocCount();
+	ptr = Heap::memAlloc(1024);
+	TEST_ASSERT_NOT_NULL(ptr);
+	TEST_ASSERT_EQUAL(Heap::getLargeAllocCount(), large + 1);
+	Heap::memFree(ptr);
+}
+#endif
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that objects with an embedded node are inserted without allocating memory
+ * and removed in O(1) through their node
+ */
+struct NodeItem{
+	int value;
+	ListNode<NodeItem> node;
+};
+
+TEST_CASE("Check intrusive list nodes ...........", "[MQLib]") {
+	NodeItem items[4];
+	List<NodeItem> list;
+	Heap::PoolStats before, after;
+	bool pool = Heap::getPoolStats(0, &before);
+	for(int i = 0; i < 4; i++){
+		items[i].value = i;
+		TEST_ASSERT_EQUAL(list.addItem(&items[i], &items[i].node), List<NodeItem>::SUCCESS);
+	}
+	if(pool){
+		TEST_ASSERT_TRUE(Heap::getPoolStats(0, &after));
+		TEST_ASSERT_EQUAL(after.hits, before.hits);
+	}
+	TEST_ASSERT_EQUAL(list.getItemCount(), 4);
+
+	// remove from the middle, the head and the tail
+	TEST_ASSERT_EQUAL(list.removeNode(&items[2].node), List<NodeItem>::SUCCESS);
+	TEST_ASSERT_NULL(items[2].node.item);
+	TEST_ASSERT_EQUAL(list.removeNode(&items[2].node), List<NodeItem>::ITEM_NOT_FOUND);
+	TEST_ASSERT_EQUAL(list.removeNode(&items[0].node), List<NodeItem>::SUCCESS);
+	TEST_ASSERT_EQUAL(list.getFirstItem(), &items[1]);
+	TEST_ASSERT_EQUAL(list.getNextItem(), &items[3]);
+	TEST_ASSERT_NULL(list.getNextItem());
+	TEST_ASSERT_EQUAL(list.removeNode(&items[3].node), List<NodeItem>::SUCCESS);
+	TEST_ASSERT_EQUAL(list.getLastItem(), &items[1]);
+
+	// the same node can be reused once removed
+	TEST_ASSERT_EQUAL(list.addItem(&items[2], &items[2].node), List<NodeItem>::SUCCESS);
+	TEST_ASSERT_EQUAL(list.getItemCount(), 2);
+	list.removeAll();
+	TEST_ASSERT_NULL(items[1].node.item);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that a topic tree leaf holds more than 255 objects sharing the same id, as happens
+ * with an external token list where unknown levels share the same token
+ */
+typedef TopicTree<int, MQ::key_t> LeafTree;
+
+TEST_CASE("Check topic tree leaves ..............", "[MQLib]") {
+	static int items[300];
+	LeafTree tree(MQ::MAX_TOKEN_LEVEL);
+	MQ::key_t id[] = {10, 20, LeafTree::KeyNotUsed};
+	for(int i = 0; i < 300; i++){
+		TEST_ASSERT_EQUAL(tree.addItem(id, &items[i]), LeafTree::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(tree.getItemCount(), 300);
+	uint32_t count = 0;
+	bool found[300] = {false};
+	auto visitor = [&](int* item){
+		found[item - items] = true;
+		count++;
+	};
+	TEST_ASSERT_EQUAL(tree.match(id, visitor), 300);
+	TEST_ASSERT_EQUAL(count, 300);
+	for(int i = 0; i < 300; i++){
+		TEST_ASSERT_TRUE(found[i]);
+	}
+	for(int i = 0; i < 300; i++){
+		TEST_ASSERT_EQUAL(tree.removeItem(id, &items[i]), LeafTree::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(tree.getItemCount(), 0);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that list traversals are reentrant: nested range-for loops over the same
+ * list, and a subscriber that subscribes again to its topic while it is being published.
+ * nest/a (3 subscribers, the first one adds a 4th during the publication)
+ */
+static MQ::SubscribeCallback s_nest_cb[4];
+static uint32_t s_nest_count = 0;
+static void nestCb(const char* topic, void* msg, uint16_t msg_len){
+	s_nest_count++;
+}
+static void nestFirstCb(const char* topic, void* msg, uint16_t msg_len){
+	s_nest_count++;
+	// walks and modifies the subscriber list of the topic being published
+	TEST_ASSERT_TRUE(MQ::MQClient::existsTopic("nest/a"));
+	MQ::MQClient::subscribe("nest/a", &s_nest_cb[3]);
+}
+
+TEST_CASE("Check reentrant list iterators .......", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	int values[3] = {1, 2, 3};
+	List<int> list;
+	for(int i = 0; i < 3; i++){
+		TEST_ASSERT_EQUAL(list.addItem(&values[i]), List<int>::SUCCESS);
+	}
+	int pairs = 0;
+	for(int* a : list){
+		list.getFirstItem();
+		for(int* b : list){
+			pairs += (*a) * (*b);
+		}
+	}
+	TEST_ASSERT_EQUAL(pairs, 36);
+	list.removeAll();
+
+	s_nest_cb[0] = callback(&nestFirstCb);
+	for(int i = 1; i < 4; i++){
+		s_nest_cb[i] = callback(&nestCb);
+	}
+	for(int i = 0; i < 3; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("nest/a", &s_nest_cb[i]), MQ::SUCCESS);
+	}
+	s_nest_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("nest/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	// the subscriber added during the publication is appended at the tail and also receives it
+	TEST_ASSERT_EQUAL(s_nest_count, 4);
+	for(int i = 0; i < 4; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("nest/a", &s_nest_cb[i]), MQ::SUCCESS);
+	}
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check lock-free publications over subscription snapshots, and that retired snapshots are not
+ * released while publishers may still be reading them:
+ * lockfree/a/b
+ * lockfree/+/b (subscribed while the mode is active)
+ * lockfree/s/+ (subscribed and unsubscribed repeatedly while several threads publish)
+ */
+static MQ::SubscribeCallback s_lockfree_cb;
+static MQ::SubscribeCallback s_lockfree_any_cb;
+static uint32_t s_lockfree_count = 0;
+static void lockfreeCb(const char* topic, void* msg, uint16_t msg_len){
+	TEST_ASSERT_EQUAL_STRING(topic, "lockfree/a/b");
+	s_lockfree_count++;
+}
+
+static MQ::SubscribeCallback s_lockfree_stress_cb;
+static std::atomic<uint32_t> s_lockfree_delivered(0);
+static std::atomic<bool> s_lockfree_stop(false);
+static void lockfreeStressCb(const char* topic, void* msg, uint16_t msg_len){
+	s_lockfree_delivered++;
+}
+static void lockfreePublishTask(){
+	uint32_t value = 0;
+	while(!s_lockfree_stop){
+		MQ::MQClient::publish("lockfree/s/x", &value, sizeof(value), &s_published_cb);
+		value++;
+	}
+}
+
+TEST_CASE("Check lock-free publish ..............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	MQ::PublishHandle handle;
+
+	s_lockfree_cb = callback(&lockfreeCb);
+	s_lockfree_any_cb = callback(&lockfreeCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("lockfree/a/b", &s_lockfree_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("lockfree/a/b", &handle), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(true), MQ::SUCCESS);
+
+	s_lockfree_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("lockfree/a/b", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_lockfree_count, 2);
+
+	// subscriptions made while the mode is active are visible to the next publication
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("lockfree/+/b", &s_lockfree_any_cb), MQ::SUCCESS);
+	s_lockfree_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("lockfree/a/b", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_lockfree_count, 4);
+
+	// and so are unsubscriptions
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("lockfree/a/b", &s_lockfree_cb), MQ::SUCCESS);
+	s_lockfree_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("lockfree/a/b", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_lockfree_count, 1);
+
+	// every subscription change retires the snapshot that the publishers may be walking (the '#'
+	// subscription is suspended meanwhile, as its callback is not meant to run concurrently)
+	bool all_topics = (MQ::MQClient::unsubscribe("#", &s_all_topics_cb) == MQ::SUCCESS);
+	s_lockfree_stress_cb = callback(&lockfreeStressCb);
+	s_lockfree_stop = false;
+	s_lockfree_delivered = 0;
+	Thread publishers[3];
+	for(int i = 0; i < 3; i++){
+		publishers[i].start(callback(&lockfreePublishTask));
+	}
+	for(int i = 0; i < 500; i++){
+		int32_t err = MQ::MQClient::subscribe("lockfree/s/+", &s_lockfree_stress_cb);
+		TEST_ASSERT_TRUE(err == MQ::SUCCESS || err == MQ::DEFERRED);
+		err = MQ::MQClient::unsubscribe("lockfree/s/+", &s_lockfree_stress_cb);
+		TEST_ASSERT_TRUE(err == MQ::SUCCESS || err == MQ::DEFERRED);
+	}
+	// the publishers keep walking the snapshots once the subscription stays
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("lockfree/s/+", &s_lockfree_stress_cb), MQ::SUCCESS);
+	s_lockfree_delivered = 0;
+	for(int i = 0; i < 1000 && s_lockfree_delivered == 0; i++){
+		Thread::wait(1);
+	}
+	TEST_ASSERT_TRUE(s_lockfree_delivered > 0);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("lockfree/s/+", &s_lockfree_stress_cb), MQ::SUCCESS);
+	s_lockfree_stop = true;
+	for(int i = 0; i < 3; i++){
+		publishers[i].join();
+	}
+	TEST_ASSERT_FALSE(MQ::MQBroker::existsTopicReq("lockfree/s/+"));
+	if(all_topics){
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("#", &s_all_topics_cb), MQ::SUCCESS);
+	}
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(false), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("lockfree/+/b", &s_lockfree_any_cb), MQ::SUCCESS);
+	s_lockfree_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_lockfree_count, 0);
+	MQ::MQClient::release(&handle);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check asynchronous dispatch through the worker pool, keeping per-topic order, and that
+ * subscribers cancelled during a delivery are not counted:
+ * async/a
+ * async/b
+ * async/c
+ * async/r/+
+ */
+static MQ::SubscribeCallback s_async_cb;
+static MQ::PublishCallback s_async_published_cb;
+static std::atomic<uint32_t> s_async_count(0);
+static std::atomic<uint32_t> s_async_published(0);
+static uint32_t s_async_next[2] = {0, 0};
+static bool s_async_ordered = true;
+static void asyncCb(const char* topic, void* msg, uint16_t msg_len){
+	// each topic is served by a single worker, so its sequence needs no extra locking
+	uint32_t* next = &s_async_next[(strcmp(topic, "async/a") == 0)? 0 : 1];
+	if(*(uint32_t*)msg != *next){
+		s_async_ordered = false;
+	}
+	(*next)++;
+	s_async_count++;
+}
+static void asyncPublishedCb(const char* topic, int32_t result){
+	TEST_ASSERT_EQUAL(result, MQ::SUCCESS);
+	s_async_published++;
+}
+static MQ::SubscribeCallback s_async_cancel_cb;
+static MQ::SubscribeCallback s_async_replay_cb;
+static MQ::PublishCallback s_async_cancel_published_cb;
+static int32_t s_async_cancel_result = MQ::SUCCESS;
+static void asyncCancelPublishedCb(const char* topic, int32_t result){
+	s_async_cancel_result = result;
+}
+static void asyncReplayCb(const char* topic, void* msg, uint16_t msg_len){
+	// the retained replay is a synchronous delivery, so the only subscriber of async/c is just cancelled
+	uint32_t i = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("async/c", &s_async_cancel_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("async/c", &i, sizeof(i), &s_async_cancel_published_cb), MQ::SUCCESS);
+}
+static void waitAsyncCount(std::atomic<uint32_t>& counter, uint32_t count){
+	for(int i = 0; i < 1000 && counter < count; i++){
+		Thread::wait(5);
+	}
+}
+
+TEST_CASE("Check async dispatch .................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	MQ::PublishHandle handle;
+
+	s_async_cb = callback(&asyncCb);
+	s_async_published_cb = callback(&asyncPublishedCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("async/a", &s_async_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("async/b", &s_async_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("async/b", &handle), MQ::SUCCESS);
+
+	// notified once every subscriber has run
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setAsyncDispatch(2), MQ::SUCCESS);
+	for(uint32_t i = 0; i < 50; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("async/a", &i, sizeof(i), &s_async_published_cb), MQ::SUCCESS);
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, &i, sizeof(i), &s_async_published_cb), MQ::SUCCESS);
+	}
+	waitAsyncCount(s_async_published, 100);
+	TEST_ASSERT_EQUAL(s_async_published, 100);
+	TEST_ASSERT_EQUAL(s_async_count, 100);
+	TEST_ASSERT_TRUE(s_async_ordered);
+
+	// a topic whose subscribers have all been cancelled during a delivery is not enqueued (the '#'
+	// subscription is suspended meanwhile)
+	uint32_t value = 1;
+	bool all_topics = (MQ::MQClient::unsubscribe("#", &s_all_topics_cb) == MQ::SUCCESS);
+	s_async_cancel_cb = callback(&asyncCb);
+	s_async_replay_cb = callback(&asyncReplayCb);
+	s_async_cancel_published_cb = callback(&asyncCancelPublishedCb);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(1024), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("async/r/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("async/c", &s_async_cancel_cb), MQ::SUCCESS);
+	s_async_cancel_result = MQ::SUCCESS;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("async/r/+", &s_async_replay_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_async_cancel_result, MQ::NOT_FOUND);
+	TEST_ASSERT_EQUAL(s_async_count, 100);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("async/r/+", &s_async_replay_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(0), MQ::SUCCESS);
+	if(all_topics){
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("#", &s_all_topics_cb), MQ::SUCCESS);
+	}
+
+	// notified as soon as the message is enqueued; pending messages are delivered on shutdown
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setAsyncDispatch(1, MQ::NotifyOnEnqueued), MQ::SUCCESS);
+	s_async_published = 0;
+	s_async_count = 0;
+	for(uint32_t i = 50; i < 60; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("async/a", &i, sizeof(i), &s_async_published_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(s_async_published, 10);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setAsyncDispatch(0), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_async_count, 10);
+	TEST_ASSERT_TRUE(s_async_ordered);
+
+	// back to synchronous dispatch
+	s_async_count = 0;
+	uint32_t i = 60;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("async/a", &i, sizeof(i), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_async_count, 1);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("async/a", &s_async_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("async/b", &s_async_cb), MQ::SUCCESS);
+	MQ::MQClient::release(&handle);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check publications from interrupt context through the lock-free ring, drained either
+ * manually or by the broker task fed from several producer threads:
+ * isr/a
+ */
+static MQ::SubscribeCallback s_isr_cb;
+static std::atomic<uint32_t> s_isr_count(0);
+static uint32_t s_isr_next[4] = {0, 0, 0, 0};
+static bool s_isr_ordered = true;
+struct IsrMsg{
+	uint32_t producer;
+	uint32_t seq;
+};
+static void isrCb(const char* topic, void* msg, uint16_t msg_len){
+	TEST_ASSERT_EQUAL_STRING(topic, "isr/a");
+	TEST_ASSERT_EQUAL(msg_len, sizeof(IsrMsg));
+	IsrMsg* m = (IsrMsg*)msg;
+	// requests from a single producer are published in the order they were enqueued
+	if(m->producer < 4){
+		if(m->seq != s_isr_next[m->producer]){
+			s_isr_ordered = false;
+		}
+		s_isr_next[m->producer]++;
+	}
+	s_isr_count++;
+}
+struct IsrProducer{
+	uint32_t id;
+	void run(){
+		for(uint32_t i = 0; i < 200; i++){
+			IsrMsg m = {id, i};
+			while(MQ::MQClient::publishFromISR("isr/a", &m, sizeof(m)) == MQ::OUT_OF_MEMORY){
+				Thread::wait(1);
+			}
+		}
+	}
+};
+
+TEST_CASE("Check publish from ISR ...............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	MQ::PublishHandle handle;
+
+	s_isr_cb = callback(&isrCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("isr/a", &s_isr_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("isr/a", &handle), MQ::SUCCESS);
+
+	// manual draining: nothing is published until the ring is processed
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startIsrQueue(8, false), MQ::SUCCESS);
+	IsrMsg m = {4, 0};
+	for(int i = 0; i < 7; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publishFromISR("isr/a", &m, sizeof(m)), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishFromISR(&handle, &m, sizeof(m), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_isr_count, 0);
+	// the ring is full
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishFromISR("isr/a", &m, sizeof(m)), MQ::OUT_OF_MEMORY);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::getIsrDropCount(), 1);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::processIsrRequests(), 8);
+	TEST_ASSERT_EQUAL(s_isr_count, 8);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::processIsrRequests(), 0);
+
+	// payloads larger than a ring entry are rejected
+	char big[64] = {0};
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishFromISR("isr/a", big, sizeof(big)), MQ::OUT_OF_BOUNDS);
+
+	// broker task draining requests from several producers
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startIsrQueue(64), MQ::SUCCESS);
+	s_isr_count = 0;
+	IsrProducer producers[4];
+	Thread threads[4];
+	for(uint32_t i = 0; i < 4; i++){
+		producers[i].id = i;
+		threads[i].start(callback(&producers[i], &IsrProducer::run));
+	}
+	for(uint32_t i = 0; i < 4; i++){
+		threads[i].join();
+	}
+	// stopping the queue publishes whatever is still pending
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startIsrQueue(0), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_isr_count, 800);
+	TEST_ASSERT_TRUE(s_isr_ordered);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishFromISR("isr/a", &m, sizeof(m)), MQ::DEINIT);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("isr/a", &s_isr_cb), MQ::SUCCESS);
+	MQ::MQClient::release(&handle);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that operations on a busy broker are deferred without blocking, reported as DEFERRED
+ * and applied by the thread that releases it:
+ * defer/hold (its subscriber keeps the broker locked)
+ * defer/a, defer/b, defer/c
+ */
+static MQ::SubscribeCallback s_defer_hold_cb;
+static MQ::SubscribeCallback s_defer_cb;
+static std::atomic<bool> s_defer_holding(false);
+static std::atomic<bool> s_defer_release(false);
+static std::atomic<uint32_t> s_defer_count(0);
+static void deferHoldCb(const char* topic, void* msg, uint16_t msg_len){
+	s_defer_holding = true;
+	while(!s_defer_release){
+		Thread::wait(1);
+	}
+}
+static void deferCb(const char* topic, void* msg, uint16_t msg_len){
+	s_defer_count++;
+}
+static void deferHoldTask(){
+	MQ::MQClient::publish("defer/hold", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+}
+static void deferSubscribeTask(){
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/b", &s_defer_cb), MQ::DEFERRED);
+}
+static MQ::BridgeCallback s_defer_bridge_cb;
+static std::atomic<uint32_t> s_defer_bridged(0);
+static void deferBridgeCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_defer_bridged++;
+}
+static void deferPublishTask(){
+	// the bridges of a deferred publication run at once, matched by name without waiting for the broker
+	Timer tm;
+	tm.start();
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("defer/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::DEFERRED);
+	TEST_ASSERT_TRUE(tm.read_us() < 500000);
+}
+
+TEST_CASE("Check deferred operations ............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	s_defer_hold_cb = callback(&deferHoldCb);
+	s_defer_cb = callback(&deferCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/hold", &s_defer_hold_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/a", &s_defer_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/c", &s_defer_cb), MQ::SUCCESS);
+	s_defer_bridge_cb = callback(&deferBridgeCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("defer/+", &s_defer_bridge_cb), 0);
+
+	// keep the broker locked from another thread
+	Thread holder;
+	holder.start(callback(&deferHoldTask));
+	while(!s_defer_holding){
+		Thread::wait(1);
+	}
+
+	// every operation is queued after a short wait instead of blocking or returning LOCK_TIMEOUT
+	Thread subscriber, publisher;
+	subscriber.start(callback(&deferSubscribeTask));
+	publisher.start(callback(&deferPublishTask));
+	Timer tm;
+	tm.start();
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/c", &s_defer_cb), MQ::DEFERRED);
+	TEST_ASSERT_TRUE(tm.read_us() < 500000);
+	subscriber.join();
+	publisher.join();
+	TEST_ASSERT_EQUAL(s_defer_count, 0);
+	TEST_ASSERT_EQUAL(s_defer_bridged, 1);
+
+	// the holder applies them when it releases the broker
+	s_defer_release = true;
+	holder.join();
+	TEST_ASSERT_EQUAL(s_defer_count, 1);
+	TEST_ASSERT_TRUE(MQ::MQBroker::existsTopicReq("defer/b"));
+	TEST_ASSERT_FALSE(MQ::MQBroker::existsTopicReq("defer/c"));
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("defer/+", &s_defer_bridge_cb), 0);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/hold", &s_defer_hold_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/a", &s_defer_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/b", &s_defer_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check that deferred operations are not overtaken by later operations of the same thread,
+ * neither by locked publications nor by lock-free ones:
+ * defer/ohold (its subscriber keeps the broker locked for a while)
+ * defer/order, defer/late
+ */
+static MQ::SubscribeCallback s_order_hold_cb;
+static MQ::SubscribeCallback s_order_cb;
+static std::atomic<uint32_t> s_order_next(0);
+static std::atomic<bool> s_order_ordered(true);
+static std::atomic<bool> s_order_holding(false);
+static std::atomic<bool> s_order_done(false);
+static void orderHoldCb(const char* topic, void* msg, uint16_t msg_len){
+	s_order_holding = true;
+	Thread::wait(3);
+}
+static void orderCb(const char* topic, void* msg, uint16_t msg_len){
+	if(*(uint32_t*)msg != s_order_next){
+		s_order_ordered = false;
+	}
+	s_order_next++;
+}
+static void orderHoldTask(){
+	for(int i = 0; i < 20; i++){
+		MQ::MQClient::publish("defer/ohold", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	}
+	s_order_done = true;
+}
+static void deferRetainHoldTask(){
+	// retained publications always take the broker, even in lock-free mode
+	MQ::MQClient::publish("defer/hold", (void*)s_msg, strlen(s_msg)+1, &s_published_cb, MQ::PublishRetain);
+}
+
+TEST_CASE("Check deferred operations order ......", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	s_order_hold_cb = callback(&orderHoldCb);
+	s_order_cb = callback(&orderCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/ohold", &s_order_hold_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/order", &s_order_cb), MQ::SUCCESS);
+
+	// the publications of a thread are delivered in order, whether they are deferred or not
+	Thread holder;
+	holder.start(callback(&orderHoldTask));
+	while(!s_order_holding){
+		Thread::wait(1);
+	}
+	uint32_t count = 0, deferred = 0;
+	s_order_next = 0;
+	while(!s_order_done){
+		int32_t err = MQ::MQClient::publish("defer/order", &count, sizeof(count), &s_published_cb);
+		TEST_ASSERT_TRUE(err == MQ::SUCCESS || err == MQ::DEFERRED);
+		deferred += (err == MQ::DEFERRED)? 1 : 0;
+		count++;
+	}
+	holder.join();
+	TEST_ASSERT_TRUE(MQ::MQBroker::existsTopicReq("defer/order"));
+	TEST_ASSERT_TRUE(deferred > 0);
+	TEST_ASSERT_EQUAL(s_order_next, count);
+	TEST_ASSERT_TRUE(s_order_ordered);
+
+	// a lock-free publication does not overtake a deferred subscription
+	s_defer_hold_cb = callback(&deferHoldCb);
+	s_defer_holding = false;
+	s_defer_release = false;
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(1024), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/hold", &s_defer_hold_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(true), MQ::SUCCESS);
+	Thread locker;
+	locker.start(callback(&deferRetainHoldTask));
+	while(!s_defer_holding){
+		Thread::wait(1);
+	}
+	uint32_t value = 0;
+	s_order_next = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("defer/late", &s_order_cb), MQ::DEFERRED);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("defer/late", &value, sizeof(value), &s_published_cb), MQ::DEFERRED);
+	s_defer_release = true;
+	locker.join();
+	TEST_ASSERT_EQUAL(s_order_next, 1);
+	TEST_ASSERT_TRUE(s_order_ordered);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(false), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(0), MQ::SUCCESS);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/hold", &s_defer_hold_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/late", &s_order_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/order", &s_order_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("defer/ohold", &s_order_hold_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check publications made from subscriber callbacks, processed recursively and breadth-first:
+ * chain/step (republishes itself with the next level)
+ * fan/root (publishes fan/a and fan/b), fan/a (publishes fan/c)
+ */
+static MQ::SubscribeCallback s_chain_cb;
+static MQ::SubscribeCallback s_fan_cb;
+static uint32_t s_chain_count = 0;
+static uint32_t s_chain_target = 0;
+static char s_fan_order[8];
+static void chainCb(const char* topic, void* msg, uint16_t msg_len){
+	uint32_t level = *(uint32_t*)msg;
+	s_chain_count++;
+	if(level < s_chain_target){
+		level++;
+		MQ::MQClient::publish("chain/step", &level, sizeof(level), &s_published_cb);
+	}
+}
+static void fanCb(const char* topic, void* msg, uint16_t msg_len){
+	strncat(s_fan_order, topic + strlen("fan/"), 1);
+	if(strcmp(topic, "fan/root") == 0){
+		MQ::MQClient::publish("fan/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+		MQ::MQClient::publish("fan/b", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	}
+	else if(strcmp(topic, "fan/a") == 0){
+		MQ::MQClient::publish("fan/c", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	}
+}
+
+TEST_CASE("Check nested publish dispatch ........", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	MQ::NestedDispatchStats recursive, queued;
+	uint32_t level = 0;
+
+	s_chain_cb = callback(&chainCb);
+	s_fan_cb = callback(&fanCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("chain/step", &s_chain_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("fan/+", &s_fan_cb), MQ::SUCCESS);
+
+	// recursive dispatch: depth-first, every level adds a stack frame
+	s_chain_target = 10;
+	s_chain_count = 0;
+	MQ::MQBroker::resetNestedDispatchStats();
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("chain/step", &level, sizeof(level), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_chain_count, 11);
+	MQ::MQBroker::getNestedDispatchStats(&recursive);
+	TEST_ASSERT_EQUAL(recursive.peak_level, 10);
+	TEST_ASSERT_EQUAL(recursive.peak_queue, 0);
+	s_fan_order[0] = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("fan/root", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL_STRING(s_fan_order, "racb");
+
+	// breadth-first dispatch: nested publications are queued behind the current fan-out
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(true), MQ::SUCCESS);
+	s_chain_count = 0;
+	MQ::MQBroker::resetNestedDispatchStats();
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("chain/step", &level, sizeof(level), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_chain_count, 11);
+	MQ::MQBroker::getNestedDispatchStats(&queued);
+	TEST_ASSERT_EQUAL(queued.peak_level, 10);
+	TEST_ASSERT_EQUAL(queued.peak_queue, 1);
+	TEST_ASSERT_EQUAL(queued.rejected, 0);
+	TEST_ASSERT_TRUE(queued.peak_stack < recursive.peak_stack);
+	s_fan_order[0] = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("fan/root", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL_STRING(s_fan_order, "rabc");
+
+	// chains deeper than the configured limit are cut
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(true, 4), MQ::SUCCESS);
+	s_chain_count = 0;
+	MQ::MQBroker::resetNestedDispatchStats();
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("chain/step", &level, sizeof(level), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_chain_count, 5);
+	MQ::MQBroker::getNestedDispatchStats(&queued);
+	TEST_ASSERT_EQUAL(queued.rejected, 1);
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(false), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("chain/step", &s_chain_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("fan/+", &s_fan_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check batch publications: one broker request for several topics, with a result per entry
+ * and a single completion callback
+ */
+static MQ::SubscribeCallback s_batch_cb;
+static MQ::BatchCallback s_batch_done_cb;
+static uint32_t s_batch_count = 0;
+static uint32_t s_batch_bytes = 0;
+static uint16_t s_batch_done = 0;
+static void batchCb(const char* topic, void* msg, uint16_t msg_len){
+	s_batch_count++;
+	s_batch_bytes += msg_len;
+}
+static void batchDoneCb(const MQ::PublishEntry* entries, const int32_t* results, uint16_t count){
+	s_batch_done = count;
+}
+
+TEST_CASE("Check batch publish ..................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	uint32_t small = 1;
+	char large[24] = "large batch message";
+	MQ::PublishEntry entries[] = {
+		{"batch/a", &small, sizeof(small)},
+		{"batch/b", large, sizeof(large)},
+		{"batch/other/x", &small, sizeof(small)},
+		{NULL, &small, sizeof(small)},
+		{"batch/a", (void*)s_msg, (uint32_t)(strlen(s_msg)+1)},
+	};
+	int32_t results[5];
+
+	s_batch_cb = callback(&batchCb);
+	s_batch_done_cb = callback(&batchDoneCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("batch/+", &s_batch_cb), MQ::SUCCESS);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishBatch(entries, 5, results, &s_batch_done_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(results[0], MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(results[1], MQ::SUCCESS);
+	// only delivered to the '#' subscription made by the prerequisites
+	TEST_ASSERT_EQUAL(results[2], MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(results[3], MQ::NULL_POINTER);
+	TEST_ASSERT_EQUAL(results[4], MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_batch_count, 3);
+	TEST_ASSERT_EQUAL(s_batch_bytes, sizeof(small) + sizeof(large) + strlen(s_msg)+1);
+	TEST_ASSERT_EQUAL(s_batch_done, 5);
+
+	// an empty batch still completes
+	s_batch_done = 1;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publishBatch(entries, 0, results, &s_batch_done_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_batch_done, 0);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("batch/+", &s_batch_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check retained messages: last value per exact topic, replayed to new subscribers
+ * (wildcards included), cleared by an empty retained publication and bounded by a memory budget
+ */
+static MQ::SubscribeCallback s_retain_cb;
+static MQ::SubscribeCallback s_retain_all_cb;
+static uint32_t s_retain_count = 0;
+static uint32_t s_retain_sum = 0;
+static void retainCb(const char* topic, void* msg, uint16_t msg_len){
+	// empty publications only clear the retained value
+	if(msg_len == sizeof(uint32_t)){
+		s_retain_count++;
+		s_retain_sum += *(uint32_t*)msg;
+	}
+}
+
+TEST_CASE("Check retained messages ..............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	uint32_t value, bytes, count;
+
+	// without store, the message is still delivered but not retained
+	value = 1;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/a/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::DEINIT);
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(1024), MQ::SUCCESS);
+	value = 1;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/a/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	value = 2;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/a/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	MQ::MQBroker::getRetainedUsage(&bytes, &count);
+	TEST_ASSERT_EQUAL(count, 1);
+	value = 10;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/a/y", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	value = 100;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/b/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	MQ::MQBroker::getRetainedUsage(&bytes, &count);
+	TEST_ASSERT_EQUAL(count, 3);
+
+	// new subscriptions receive the last value of every matching topic
+	s_retain_cb = callback(&retainCb);
+	s_retain_all_cb = callback(&retainCb);
+	s_retain_count = 0;
+	s_retain_sum = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("retain/a/+", &s_retain_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_retain_count, 2);
+	TEST_ASSERT_EQUAL(s_retain_sum, 12);
+	s_retain_count = 0;
+	s_retain_sum = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_retain_count, 3);
+	TEST_ASSERT_EQUAL(s_retain_sum, 112);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+
+	// an empty retained publication clears the retained value
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/a/y", NULL, 0, &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	MQ::MQBroker::getRetainedUsage(&bytes, &count);
+	TEST_ASSERT_EQUAL(count, 2);
+	s_retain_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_retain_count, 2);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+
+	// the budget evicts the least recently updated topics...
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(bytes), MQ::SUCCESS);
+	value = 1000;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/c/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	MQ::MQBroker::getRetainedUsage(&bytes, &count);
+	TEST_ASSERT_EQUAL(count, 2);
+	s_retain_count = 0;
+	s_retain_sum = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_retain_sum, 1100);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("retain/#", &s_retain_all_cb), MQ::SUCCESS);
+
+	// ...or rejects the new ones
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(bytes, MQ::RetainRejectNew), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/d/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::OUT_OF_MEMORY);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("retain/c/x", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(0), MQ::SUCCESS);
+	MQ::MQBroker::getRetainedUsage(&bytes, &count);
+	TEST_ASSERT_EQUAL(bytes, 0);
+	TEST_ASSERT_EQUAL(count, 0);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("retain/a/+", &s_retain_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check conflating subscriptions: only the newest value per topic is delivered per
+ * interval, on the flush task or when the consumer pulls
+ */
+static MQ::SubscribeCallback s_conflate_cb;
+static uint32_t s_conflate_count = 0;
+static uint32_t s_conflate_last = 0;
+static void conflateCb(const char* topic, void* msg, uint16_t msg_len){
+	s_conflate_count++;
+	s_conflate_last = *(uint32_t*)msg;
+}
+
+TEST_CASE("Check conflating subscriptions .......", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	uint32_t value;
+
+	s_conflate_cb = callback(&conflateCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("conflate/+", &s_conflate_cb, MQ::SubscribeConflate, 100), MQ::SUCCESS);
+
+	// the first update is delivered, the rest only overwrite the pending value
+	s_conflate_count = 0;
+	for(value = 0; value < 100; value++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/a", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	TEST_ASSERT_EQUAL(s_conflate_last, 0);
+
+	// the consumer pulls the newest value
+	TEST_ASSERT_EQUAL(MQ::MQClient::pull(&s_conflate_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 2);
+	TEST_ASSERT_EQUAL(s_conflate_last, 99);
+	TEST_ASSERT_EQUAL(MQ::MQClient::pull(&s_conflate_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 2);
+
+	// the flush task delivers it once the interval expires
+	for(value = 100; value < 105; value++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/a", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(s_conflate_count, 2);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startConflateFlush(10), MQ::SUCCESS);
+	Thread::wait(400);
+	TEST_ASSERT_EQUAL(s_conflate_count, 3);
+	TEST_ASSERT_EQUAL(s_conflate_last, 104);
+
+	// an idle topic delivers its next update directly
+	value = 200;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/a", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 4);
+	TEST_ASSERT_EQUAL(s_conflate_last, 200);
+
+	// the same applies to lock-free publications, delivered from the subscriptions snapshot
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(true), MQ::SUCCESS);
+	s_conflate_count = 0;
+	for(value = 400; value < 410; value++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/b", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	TEST_ASSERT_EQUAL(MQ::MQClient::pull(&s_conflate_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 2);
+	TEST_ASSERT_EQUAL(s_conflate_last, 409);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(false), MQ::SUCCESS);
+
+	// pending values are discarded on unsubscription
+	Thread::wait(400);
+	s_conflate_count = 0;
+	value = 200;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/a", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	value = 300;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/a", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("conflate/+", &s_conflate_cb), MQ::SUCCESS);
+	Thread::wait(300);
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startConflateFlush(0), MQ::SUCCESS);
+
+	// a retained message replayed to a new subscription opens its interval like a publication
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(1024), MQ::SUCCESS);
+	value = 500;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/r", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	s_conflate_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("conflate/+", &s_conflate_cb, MQ::SubscribeConflate, 100), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	TEST_ASSERT_EQUAL(s_conflate_last, 500);
+	value = 501;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("conflate/r", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 1);
+	TEST_ASSERT_EQUAL(MQ::MQClient::pull(&s_conflate_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_conflate_count, 2);
+	TEST_ASSERT_EQUAL(s_conflate_last, 501);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("conflate/+", &s_conflate_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(0), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check numeric topic levels: encoded by value without registering tokens, matched
+ * exactly or through wildcards, and used as @dev/@group scopes
+ */
+static MQ::SubscribeCallback s_scope_dev_cb;
+static MQ::SubscribeCallback s_scope_any_cb;
+static MQ::SubscribeCallback s_scope_all_cb;
+static uint32_t s_scope_dev_count = 0;
+static uint32_t s_scope_any_count = 0;
+static uint32_t s_scope_all_count = 0;
+static void scopeDevCb(const char* topic, void* msg, uint16_t msg_len){
+	s_scope_dev_count++;
+}
+static void scopeAnyCb(const char* topic, void* msg, uint16_t msg_len){
+	s_scope_any_count++;
+}
+static void scopeAllCb(const char* topic, void* msg, uint16_t msg_len){
+	s_scope_all_count++;
+}
+
+TEST_CASE("Check numeric topic levels ...........", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	const char** tklist;
+	uint32_t tkcount, tkcount_before;
+	char name[MQ::DefaultMaxTopicNameLength];
+	MQ::topic_t id_a, id_b;
+
+	s_scope_dev_cb = callback(&scopeDevCb);
+	s_scope_any_cb = callback(&scopeAnyCb);
+	s_scope_all_cb = callback(&scopeAllCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("@dev/8976/cmd", &s_scope_dev_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("@dev/+/cmd", &s_scope_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("@group/78/#", &s_scope_all_cb), MQ::SUCCESS);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("@dev/8976/cmd", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("@dev/8977/cmd", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("@group/78/dev/8976/cmd", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("@group/79/dev/8976/cmd", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_scope_dev_count, 1);
+	TEST_ASSERT_EQUAL(s_scope_any_count, 2);
+	TEST_ASSERT_EQUAL(s_scope_all_count, 1);
+
+	// thousands of device ids do not grow the token dictionary
+	MQ::MQBroker::getInternalTokenListReq(tklist, tkcount_before);
+	for(uint32_t i = 0; i < 2000; i++){
+		sprintf(name, "fleet/%u/state/%u", (unsigned)(100000 + i), (unsigned)(i % 7));
+		MQ::MQClient::publish(name, (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	}
+	MQ::MQBroker::getInternalTokenListReq(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_before + 2);
+
+	// values are compared exactly, and names with leading zeros stay string tokens
+	MQ::MQBroker::getTopicIdReq(&id_a, "@dev/7/cmd");
+	MQ::MQBroker::getTopicIdReq(&id_b, "@dev/7/cmd");
+	TEST_ASSERT_TRUE(MQ::MQBroker::matchIds(&id_a, &id_b));
+	MQ::MQBroker::getTopicIdReq(&id_b, "@dev/8/cmd");
+	TEST_ASSERT_FALSE(MQ::MQBroker::matchIds(&id_a, &id_b));
+	s_scope_any_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("@dev/007/cmd", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_scope_any_count, 1);
+	MQ::MQBroker::getTopicIdReq(&id_b, "@dev/007/cmd");
+	TEST_ASSERT_FALSE(MQ::MQBroker::matchIds(&id_a, &id_b));
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("@dev/8976/cmd", &s_scope_dev_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("@dev/+/cmd", &s_scope_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("@group/78/#", &s_scope_all_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the compile-time topic id configuration: packed id size, name round trip and,
+ * with tokens wider than 8 bits, a dictionary that grows past 256 tokens
+ */
+TEST_CASE("Check topic id configuration .........", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	char name[MQ::DefaultMaxTopicNameLength];
+	MQ::topic_t id;
+
+	TEST_ASSERT_EQUAL(sizeof(MQ::token_t), (MQ_TOKEN_BITS > 8)? 2 : 1);
+	TEST_ASSERT_EQUAL(sizeof(MQ::topic_t), ((MQ::MAX_TOKEN_LEVEL + 1) * sizeof(MQ::token_t)) + (MQ::MAX_NUMERIC_LEVELS * sizeof(uint32_t)));
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("config/name/12/check", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	MQ::MQBroker::getTopicIdReq(&id, "config/name/12/check");
+	MQ::MQBroker::getTopicNameReq(name, MQ::DefaultMaxTopicNameLength, &id);
+	TEST_ASSERT_EQUAL_STRING(name, "config/name/12/check");
+
+#if MQ_TOKEN_BITS > 8
+	const char** tklist;
+	uint32_t tkcount, tkcount_before;
+	MQ::MQBroker::getInternalTokenListReq(tklist, tkcount_before);
+	for(uint32_t i = 0; i < 300; i++){
+		sprintf(name, "config/tk%u", (unsigned)i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(name, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	}
+	MQ::MQBroker::getInternalTokenListReq(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_before + 300);
+	MQ::MQBroker::getTopicIdReq(&id, "config/tk299");
+	MQ::MQBroker::getTopicNameReq(name, MQ::DefaultMaxTopicNameLength, &id);
+	TEST_ASSERT_EQUAL_STRING(name, "config/tk299");
+#endif
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the vectorised subscription matcher against MQBroker::matchIds, with 8 and
+ * 32-bit tokens, including wildcards, topics of different depth and removals
+ */
+static uint32_t s_matcher_hits = 0;
+static void matcherCb(MQ::topic_t* id){
+	s_matcher_hits++;
+}
+static void buildMatcherId(MQ::topic_t* id, uint32_t i, bool wildcards){
+	memset(id, 0, sizeof(MQ::topic_t));
+	uint8_t depth = 1 + (i % MQ::MAX_TOKEN_LEVEL);
+	for(uint8_t l = 0; l < depth; l++){
+		id->tk[l] = 5 + ((i >> l) % 3);
+		if(wildcards && ((i + l) % 7) == 0){
+			id->tk[l] = 1;
+		}
+	}
+	if(wildcards && (i % 11) == 0){
+		id->tk[depth - 1] = 2;
+	}
+}
+
+TEST_CASE("Check vectorised topic matcher .......", "[MQLib]") {
+
+	static const uint32_t num_ids = 200;
+	MQ::topic_t* subs = new MQ::topic_t[num_ids];
+	TEST_ASSERT_NOT_NULL(subs);
+	TopicMatcher<MQ::topic_t, MQ::token_t> matcher(MQ::MAX_TOKEN_LEVEL);
+	TopicMatcher<MQ::topic_t, uint32_t> wide(MQ::MAX_TOKEN_LEVEL);
+	uint32_t keys[num_ids][MQ::MAX_TOKEN_LEVEL];
+	void (*visitor)(MQ::topic_t*) = &matcherCb;
+
+	for(uint32_t i = 0; i < num_ids; i++){
+		buildMatcherId(&subs[i], i, true);
+		for(uint8_t l = 0; l < MQ::MAX_TOKEN_LEVEL; l++){
+			keys[i][l] = subs[i].tk[l];
+		}
+		TEST_ASSERT_EQUAL(matcher.addItem(subs[i].tk, &subs[i]), (TopicMatcher<MQ::topic_t, MQ::token_t>::SUCCESS));
+		TEST_ASSERT_EQUAL(wide.addItem(keys[i], &subs[i]), (TopicMatcher<MQ::topic_t, uint32_t>::SUCCESS));
+	}
+	TEST_ASSERT_EQUAL(matcher.getItemCount(), num_ids);
+
+	// remove every third subscription, so the last ones are moved into the gaps
+	for(uint32_t i = 0; i < num_ids; i += 3){
+		TEST_ASSERT_EQUAL(matcher.removeItem(subs[i].tk, &subs[i]), (TopicMatcher<MQ::topic_t, MQ::token_t>::SUCCESS));
+		TEST_ASSERT_EQUAL(wide.removeItem(keys[i], &subs[i]), (TopicMatcher<MQ::topic_t, uint32_t>::SUCCESS));
+	}
+	TEST_ASSERT_EQUAL(matcher.removeItem(subs[0].tk, &subs[0]), (TopicMatcher<MQ::topic_t, MQ::token_t>::ITEM_NOT_FOUND));
+
+	for(uint32_t j = 0; j < 500; j++){
+		MQ::topic_t pub;
+		uint32_t pub_keys[MQ::MAX_TOKEN_LEVEL];
+		buildMatcherId(&pub, j * 7, false);
+		for(uint8_t l = 0; l < MQ::MAX_TOKEN_LEVEL; l++){
+			pub_keys[l] = pub.tk[l];
+		}
+		uint32_t expected = 0;
+		for(uint32_t i = 0; i < num_ids; i++){
+			if((i % 3) != 0 && MQ::MQBroker::matchIds(&subs[i], &pub)){
+				expected++;
+			}
+		}
+		s_matcher_hits = 0;
+		TEST_ASSERT_EQUAL(matcher.match(pub.tk, visitor), expected);
+		TEST_ASSERT_EQUAL(s_matcher_hits, expected);
+		TEST_ASSERT_EQUAL(wide.match(pub_keys, visitor), expected);
+	}
+	delete[] subs;
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the structure-of-arrays topic table: span relocation, swap-and-pop removal,
+ * name lookups after compaction, and unsubscriptions from inside a delivery:
+ * table/a (the first subscriber cancels itself and the last one)
+ */
+static MQ::SubscribeCallback s_table_cb[3];
+static uint32_t s_table_count = 0;
+static void tableCancelCb(const char* topic, void* msg, uint16_t msg_len){
+	s_table_count++;
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("table/a", &s_table_cb[0]), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("table/a", &s_table_cb[2]), MQ::SUCCESS);
+}
+static void tableCb(const char* topic, void* msg, uint16_t msg_len){
+	s_table_count++;
+}
+
+TEST_CASE("Check contiguous topic table .........", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	static const uint32_t num_topics = 40;
+	TopicTable<uint32_t, uint32_t> table(num_topics);
+	char name[16];
+	uint32_t row, moved;
+	for(uint32_t i = 0; i < num_topics; i++){
+		sprintf(name, "t/%d", (int)i);
+		TEST_ASSERT_EQUAL(table.addTopic(name, &i, &row), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+		TEST_ASSERT_EQUAL(row, i);
+		// each new subscriber may relocate the span of the topic
+		for(uint32_t s = 0; s <= (i % 5); s++){
+			TEST_ASSERT_EQUAL(table.addSubscriber(row, (i << 8) | s), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+		}
+	}
+	TEST_ASSERT_EQUAL(table.addTopic("t/full", &row, &row), (TopicTable<uint32_t, uint32_t>::LIMIT_EXCEEDED));
+	TEST_ASSERT_EQUAL(table.getSubscriberTotal(), 120);
+
+	// the last row takes the place of the removed one
+	TEST_ASSERT_TRUE(table.findTopic("t/3", &row));
+	TEST_ASSERT_EQUAL(table.removeTopic(row, &moved), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+	TEST_ASSERT_EQUAL(moved, num_topics - 1);
+	TEST_ASSERT_FALSE(table.findTopic("t/3", &row));
+	TEST_ASSERT_TRUE(table.findTopic("t/39", &row));
+	TEST_ASSERT_EQUAL(row, 3);
+	TEST_ASSERT_EQUAL(*table.getId(row), 39);
+	TEST_ASSERT_EQUAL(table.getSubscriberCount(row), 5);
+
+	// removing a subscriber keeps the order of the remaining ones
+	TEST_ASSERT_EQUAL(table.removeSubscriber(row, 1), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+	TEST_ASSERT_EQUAL(table.getSubscribers(row)[0], (39 << 8) | 0);
+	TEST_ASSERT_EQUAL(table.getSubscribers(row)[1], (39 << 8) | 2);
+	TEST_ASSERT_EQUAL(table.getSubscriberCount(row), 4);
+
+	// replacing topics with longer names forces the compaction of the name buffer, which must
+	// keep the index coherent
+	for(uint32_t i = 0; i < 8; i++){
+		sprintf(name, "t/%d", (int)(10 + i));
+		TEST_ASSERT_TRUE(table.findTopic(name, &row));
+		TEST_ASSERT_EQUAL(table.removeTopic(row, &moved), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+		sprintf(name, "t/renamed/%d", (int)i);
+		TEST_ASSERT_EQUAL(table.addTopic(name, &i, &row), (TopicTable<uint32_t, uint32_t>::SUCCESS));
+	}
+	for(uint32_t i = 0; i < num_topics - 1; i++){
+		sprintf(name, "t/%d", (int)i);
+		TEST_ASSERT_EQUAL(table.findTopic(name, &row), (i != 3 && (i < 10 || i >= 18)));
+	}
+	TEST_ASSERT_TRUE(table.findTopic("t/renamed/7", &row));
+	TEST_ASSERT_EQUAL_STRING(table.getName(row), "t/renamed/7");
+	table.removeAll();
+	TEST_ASSERT_EQUAL(table.getTopicCount(), 0);
+
+	// subscribers cancelled during a delivery are skipped and purged at the end of it
+	s_table_cb[0] = callback(&tableCancelCb);
+	s_table_cb[1] = callback(&tableCb);
+	s_table_cb[2] = callback(&tableCb);
+	for(int i = 0; i < 3; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("table/a", &s_table_cb[i]), MQ::SUCCESS);
+	}
+	s_table_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("table/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_table_count, 2);
+	s_table_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("table/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_table_count, 1);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("table/a", &s_table_cb[1]), MQ::SUCCESS);
+	TEST_ASSERT_FALSE(MQ::MQClient::existsTopic("table/a"));
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check compiled bridge patterns, through publications by name and by handle:
+ * cbridge/+/value
+ * cbridge/#
+ */
+static MQ::BridgeCallback s_cbridge_any_cb;
+static MQ::BridgeCallback s_cbridge_all_cb;
+static uint32_t s_cbridge_any = 0;
+static uint32_t s_cbridge_all = 0;
+static void cbridgeAnyCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_cbridge_any++;
+}
+static void cbridgeAllCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_cbridge_all++;
+}
+static uint32_t getHeapAllocCount(){
+	uint32_t count = Heap::getLargeAllocCount();
+	Heap::PoolStats stats;
+	for(uint8_t i = 0; i < Heap::PoolClassCount; i++){
+		if(Heap::getPoolStats(i, &stats)){
+			count += stats.hits + stats.misses;
+		}
+	}
+	return count;
+}
+
+TEST_CASE("Check compiled bridge patterns .......", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	s_cbridge_any_cb = callback(&cbridgeAnyCb);
+	s_cbridge_all_cb = callback(&cbridgeAllCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("cbridge/+/value", &s_cbridge_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("cbridge/#", &s_cbridge_all_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("cbridge/#", &s_cbridge_all_cb), -2);
+
+	// matching requires no memory
+	s_cbridge_any = s_cbridge_all = 0;
+	uint32_t allocs = getHeapAllocCount();
+	MQ::MQClient::executeBridge("cbridge/dev/value", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	MQ::MQClient::executeBridge("cbridge/dev/other", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	MQ::MQClient::executeBridge("cbridge/dev/value/1", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	MQ::MQClient::executeBridge("cbridge", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	MQ::MQClient::executeBridge("other/dev/value", (void*)s_msg, strlen(s_msg)+1, &s_published_cb);
+	TEST_ASSERT_EQUAL(getHeapAllocCount(), allocs);
+	TEST_ASSERT_EQUAL(s_cbridge_any, 1);
+	TEST_ASSERT_EQUAL(s_cbridge_all, 4);
+
+	// handles resolve their bridges once, and again after a bridge is removed
+	MQ::PublishHandle handle;
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("cbridge/dev/value", &handle), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(handle.bridge_count, 2);
+	s_cbridge_any = s_cbridge_all = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("cbridge/+/value", &s_cbridge_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("cbridge/+/value", &s_cbridge_any_cb), -1);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(handle.bridge_count, 1);
+	TEST_ASSERT_EQUAL(s_cbridge_any, 1);
+	TEST_ASSERT_EQUAL(s_cbridge_all, 2);
+	MQ::MQClient::release(&handle);
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("cbridge/#", &s_cbridge_all_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the single-pass topic tokenizer, the wildcard pattern matching and the depth limit
+ */
+
+TEST_CASE("Check topic tokenizer ................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	MQ::TopicSpan spans[4];
+	TEST_ASSERT_EQUAL(MQ::splitTopic("/aa//b/ccc/", spans, 4), 3);
+	TEST_ASSERT_EQUAL(spans[0].from, 1);
+	TEST_ASSERT_EQUAL(spans[0].len, 2);
+	TEST_ASSERT_EQUAL(spans[1].from, 5);
+	TEST_ASSERT_EQUAL(spans[1].len, 1);
+	TEST_ASSERT_EQUAL(spans[2].from, 7);
+	TEST_ASSERT_EQUAL(spans[2].len, 3);
+	TEST_ASSERT_EQUAL(MQ::splitTopic("", spans, 4), 0);
+	TEST_ASSERT_EQUAL(MQ::splitTopic("a/b/c/d/e", spans, 4), 5);
+
+	TEST_ASSERT_TRUE(MQ::matchTopic("a/+/c", "a/b/c"));
+	TEST_ASSERT_TRUE(MQ::matchTopic("a/#", "a"));
+	TEST_ASSERT_TRUE(MQ::matchTopic("a/#", "a/b/c"));
+	TEST_ASSERT_FALSE(MQ::matchTopic("a/+/c", "a/b"));
+	TEST_ASSERT_FALSE(MQ::matchTopic("a/b", "a/bb"));
+	TEST_ASSERT_FALSE(MQ::matchTopic("a/b", "a/b/c"));
+
+	// topics deeper than MQ::MAX_TOKEN_LEVEL are rejected instead of overflowing the topic id
+	char deep[4 * (MQ::MAX_TOKEN_LEVEL + 1)] = "";
+	for(int i = 0; i <= MQ::MAX_TOKEN_LEVEL; i++){
+		strcat(deep, (i)? "/d" : "d");
+	}
+	s_subscribe_cb = callback(&subscriptionCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe(deep, &s_subscribe_cb), MQ::OUT_OF_BOUNDS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(deep, (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::OUT_OF_BOUNDS);
+	TEST_ASSERT_FALSE(MQ::MQClient::existsTopic(deep));
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the publish cache: hits, invalidation by subscriptions and bridges, CLOCK
+ * replacement and publications of a topic that is being published:
+ * pcache/a
+ * pcache/+
+ */
+static MQ::SubscribeCallback s_pcache_cb;
+static MQ::SubscribeCallback s_pcache_any_cb;
+static MQ::BridgeCallback s_pcache_bridge_cb;
+static uint32_t s_pcache_count = 0;
+static uint32_t s_pcache_bridged = 0;
+static void pcacheCb(const char* topic, void* msg, uint16_t msg_len){
+	s_pcache_count++;
+	// the nested publication of the same topic can not use its pinned cache entry
+	if(s_pcache_count == 1 && strcmp(topic, "pcache/a") == 0){
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	}
+}
+static void pcacheBridgeCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_pcache_bridged++;
+}
+
+TEST_CASE("Check publish cache ..................", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+
+	MQ::PublishCacheStats stats;
+	s_pcache_cb = callback(&pcacheCb);
+	s_pcache_any_cb = callback(&pcacheCb);
+	s_pcache_bridge_cb = callback(&pcacheBridgeCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(2), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("pcache/a", &s_pcache_cb), MQ::SUCCESS);
+
+	// first publication misses, the nested one bypasses the entry, the second one hits
+	s_pcache_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pcache_count, 2);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pcache_count, 3);
+	MQ::MQClient::getPublishCacheStats(&stats);
+	TEST_ASSERT_EQUAL(stats.hits, 1);
+	TEST_ASSERT_EQUAL(stats.misses, 2);
+
+	// a new subscription invalidates the entry
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("pcache/+", &s_pcache_any_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pcache_count, 5);
+	MQ::MQClient::getPublishCacheStats(&stats);
+	TEST_ASSERT_EQUAL(stats.misses, 3);
+
+	// so does a new bridge
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("pcache/#", &s_pcache_bridge_cb), MQ::SUCCESS);
+	s_pcache_bridged = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/a", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pcache_bridged, 2);
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("pcache/#", &s_pcache_bridge_cb), MQ::SUCCESS);
+	MQ::MQClient::getPublishCacheStats(&stats);
+	TEST_ASSERT_EQUAL(stats.hits, 2);
+	TEST_ASSERT_EQUAL(stats.misses, 4);
+
+	// two new topics in a 2-entry cache replace the least recently referenced one
+	MQ::MQClient::resetPublishCacheStats();
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/b", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pcache/c", (void*)s_msg, strlen(s_msg)+1, &s_published_cb), MQ::SUCCESS);
+	MQ::MQClient::getPublishCacheStats(&stats);
+	TEST_ASSERT_EQUAL(stats.misses, 2);
+	TEST_ASSERT_EQUAL(stats.evictions, 1);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(0), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("pcache/a", &s_pcache_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("pcache/+", &s_pcache_any_cb), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the publish prefilter: publications that can not match any subscription are rejected
+ * without registering their tokens nor allocating memory (the '#' subscription is suspended meanwhile):
+ * pfilter/a/temp
+ * nobody/+
+ */
+static MQ::SubscribeCallback s_pfilter_cb;
+static MQ::PublishCallback s_pfilter_published_cb;
+static uint32_t s_pfilter_count = 0;
+static int32_t s_pfilter_result = MQ::SUCCESS;
+static void pfilterCb(const char* topic, void* msg, uint16_t msg_len){
+	s_pfilter_count++;
+}
+static void pfilterPublishedCb(const char* topic, int32_t result){
+	s_pfilter_result = result;
+}
+
+TEST_CASE("Check publish prefilter ..............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	const char** tklist;
+	uint32_t tkcount, tkcount_prev;
+	s_pfilter_cb = callback(&pfilterCb);
+	s_pfilter_published_cb = callback(&pfilterPublishedCb);
+	bool all_topics = (MQ::MQClient::unsubscribe("#", &s_all_topics_cb) == MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("pfilter/a/temp", &s_pfilter_cb), MQ::SUCCESS);
+
+	// an unmatched publication does not touch the token dictionary nor the heap
+	MQ::MQClient::getInternalTokenList(tklist, tkcount_prev);
+	uint32_t allocs = getHeapAllocCount();
+	s_pfilter_count = 0;
+	s_pfilter_result = MQ::SUCCESS;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pfilter-none/a/temp", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::NOT_FOUND);
+	TEST_ASSERT_EQUAL(getHeapAllocCount(), allocs);
+	MQ::MQClient::getInternalTokenList(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_prev);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pfilter/a/temp", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_count, 1);
+
+	// wildcards let through every token of their level, and a removed subscription no longer does
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("nobody/+", &s_pfilter_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("nobody/here", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_count, 2);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("nobody/+", &s_pfilter_cb), MQ::SUCCESS);
+	MQ::MQClient::getInternalTokenList(tklist, tkcount_prev);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("nobody/there", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::NOT_FOUND);
+	MQ::MQClient::getInternalTokenList(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_prev);
+
+	// batch entries are filtered one by one
+	MQ::PublishEntry entries[] = {
+		{"nobody/there", (void*)s_msg, (uint32_t)(strlen(s_msg)+1)},
+		{"pfilter/a/temp", (void*)s_msg, (uint32_t)(strlen(s_msg)+1)},
+	};
+	int32_t results[2];
+	TEST_ASSERT_EQUAL(MQ::MQBroker::publishBatchReq(entries, 2, results), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(results[0], MQ::NOT_FOUND);
+	TEST_ASSERT_EQUAL(results[1], MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_count, 3);
+
+	// with the publish cache enabled, unmatched topics register no tokens and do not keep a cache entry,
+	// so they do not evict the entries of the matched topics
+	MQ::PublishCacheStats stats;
+	TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(4), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pfilter/a/temp", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	MQ::MQClient::resetPublishCacheStats();
+	MQ::MQClient::getInternalTokenList(tklist, tkcount_prev);
+	for(int i = 0; i < 8; i++){
+		char topic[32];
+		sprintf(topic, "nobody/cached%d/temp", i);
+		s_pfilter_result = MQ::SUCCESS;
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(topic, (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+		TEST_ASSERT_EQUAL(s_pfilter_result, MQ::NOT_FOUND);
+	}
+	MQ::MQClient::getInternalTokenList(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_prev);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("pfilter/a/temp", (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::SUCCESS);
+	MQ::MQClient::getPublishCacheStats(&stats);
+	TEST_ASSERT_EQUAL(stats.hits, 1);
+	TEST_ASSERT_EQUAL(stats.evictions, 0);
+	TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(0), MQ::SUCCESS);
+
+	// an unmatched handle stays without subscribers nor tokens until a subscription can match it
+	MQ::PublishHandle handle;
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("nobody/handle/temp", &handle), MQ::SUCCESS);
+	s_pfilter_result = MQ::SUCCESS;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::NOT_FOUND);
+	MQ::MQClient::getInternalTokenList(tklist, tkcount);
+	TEST_ASSERT_EQUAL(tkcount, tkcount_prev);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("nobody/handle/+", &s_pfilter_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, (void*)s_msg, strlen(s_msg)+1, &s_pfilter_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_result, MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_pfilter_count, 6);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("nobody/handle/+", &s_pfilter_cb), MQ::SUCCESS);
+	MQ::MQClient::release(&handle);
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("pfilter/a/temp", &s_pfilter_cb), MQ::SUCCESS);
+	if(all_topics){
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("#", &s_all_topics_cb), MQ::SUCCESS);
+	}
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Check the token collection: the tokens of transient topics are released, the dictionary
+ * is compacted in steps, and the moved tokens keep working for subscriptions, handles, retained
+ * messages and bridges:
+ * gc/+/value
+ * gc/live?/value
+ * gc/late/value
+ * gc/ret/+
+ */
+static MQ::SubscribeCallback s_gc_cb;
+static MQ::BridgeCallback s_gc_bridge_cb;
+static uint32_t s_gc_count = 0;
+static uint32_t s_gc_bridged = 0;
+static void gcCb(const char* topic, void* msg, uint16_t msg_len){
+	s_gc_count++;
+}
+static void gcBridgeCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_gc_bridged++;
+}
+
+TEST_CASE("Check token collection ...............", "[MQLib]") {
+
+	// Execute test pre-requisites
+	executePrerequisites();
+	char topic[32];
+	const char** tklist;
+	uint32_t tkcount, tkcount_prev;
+	uint32_t value = 1;
+	MQ::TokenCollectStats stats, stats_prev;
+	MQ::PublishHandle handle;
+	s_gc_cb = callback(&gcCb);
+	s_gc_bridge_cb = callback(&gcBridgeCb);
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("gc/+/value", &s_gc_cb), MQ::SUCCESS);
+
+	// transient topics register tokens that no subscription references
+	for(int i = 0; i < 20; i++){
+		sprintf(topic, "gc/req%dx/value", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(topic, &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	}
+
+	// tokens registered after them are moved to the released slots
+	for(char c = 'a'; c < 'k'; c++){
+		sprintf(topic, "gc/live%c/value", c);
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe(topic, &s_gc_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("gc/late/value", &s_gc_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve("gc/late/value", &handle), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(1024), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("gc/ret/value", &value, sizeof(value), &s_published_cb, MQ::PublishRetain), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::addBridge("gc/brg/#", &s_gc_bridge_cb), MQ::SUCCESS);
+	MQ::MQBroker::getTokenCollectStats(&stats_prev);
+	TEST_ASSERT_TRUE(stats_prev.unreferenced >= 20);
+
+	// a zero budget pass completes a single step
+	MQ::MQClient::getInternalTokenList(tklist, tkcount_prev);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::collectTokensReq(0), MQ::SUCCESS);
+	MQ::MQBroker::getTokenCollectStats(&stats);
+	TEST_ASSERT_EQUAL(stats.passes, stats_prev.passes + 1);
+	TEST_ASSERT_EQUAL(stats.moved, stats_prev.moved + 8);
+	TEST_ASSERT_TRUE(stats.unreferenced > 0);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::collectTokensReq(1000000), MQ::SUCCESS);
+	MQ::MQBroker::getTokenCollectStats(&stats);
+	TEST_ASSERT_EQUAL(stats.unreferenced, 0);
+	TEST_ASSERT_TRUE(stats.freed >= stats_prev.freed + 20);
+	MQ::MQClient::getInternalTokenList(tklist, tkcount);
+	TEST_ASSERT_TRUE(tkcount + 20 <= tkcount_prev);
+
+	// moved tokens resolve to the same topics
+	MQ::topic_t id;
+	char name[32];
+	MQ::MQClient::getTopicId(&id, "gc/late/value");
+	MQ::MQClient::getTopicName(name, sizeof(name), &id);
+	TEST_ASSERT_EQUAL_STRING(name, "gc/late/value");
+	TEST_ASSERT_TRUE(MQ::MQClient::existsTopic("gc/livej/value"));
+	s_gc_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("gc/late/value", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("gc/livej/value", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_gc_count, 4);
+
+	// handles resolved before the collection are refreshed, also in lock-free mode
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(true), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish(&handle, &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_gc_count, 8);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(false), MQ::SUCCESS);
+	MQ::MQClient::release(&handle);
+
+	// retained messages and bridges keep their tokens
+	s_gc_count = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("gc/ret/+", &s_gc_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_gc_count, 1);
+	s_gc_bridged = 0;
+	TEST_ASSERT_EQUAL(MQ::MQClient::publish("gc/brg/value", &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(s_gc_bridged, 1);
+
+	// publications to transient topics no longer exhaust the dictionary, the collection runs
+	// automatically once it is close to full
+	stats_prev = stats;
+	for(uint32_t i = 0; i < (1UL << MQ_TOKEN_BITS) + 64 && stats.passes == stats_prev.passes; i++){
+		sprintf(topic, "gc/seq%ux/value", (unsigned)i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(topic, &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+		MQ::MQBroker::getTokenCollectStats(&stats);
+	}
+	TEST_ASSERT_TRUE(stats.passes > stats_prev.passes);
+	for(int i = 0; i < 64; i++){
+		sprintf(topic, "gc/post%dx/value", i);
+		TEST_ASSERT_EQUAL(MQ::MQClient::publish(topic, &value, sizeof(value), &s_published_cb), MQ::SUCCESS);
+	}
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge("gc/brg/#", &s_gc_bridge_cb), 0);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setRetainedStore(0), MQ::SUCCESS);
+	for(char c = 'a'; c < 'k'; c++){
+		sprintf(topic, "gc/live%c/value", c);
+		TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe(topic, &s_gc_cb), MQ::SUCCESS);
+	}
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("gc/late/value", &s_gc_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("gc/ret/+", &s_gc_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("gc/+/value", &s_gc_cb), MQ::SUCCESS);
+}
+
 //------------------------------------------------------------------------------------
 //-- PREREQUISITES -------------------------------------------------------------------
 //------------------------------------------------------------------------------------
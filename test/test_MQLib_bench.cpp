@@ -0,0 +1,1080 @@
+/*
+ * test_MQLib_bench.cpp
+ *
+ *	Benchmark file for MQLib module
+ */
+
+
+//------------------------------------------------------------------------------------
+//-- TEST HEADERS --------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+#include "unity.h"
+#include "mbed.h"
+#include "AppConfig.h"
+#include "MQLib.h"
+#include "TopicMatcher.h"
+#include "TopicTable.h"
+
+
+#if ESP_PLATFORM == 1 || (__MBED__ == 1 && defined(ENABLE_TEST_DEBUGGING) && defined(ENABLE_TEST_MQLib))
+
+
+//------------------------------------------------------------------------------------
+//-- SPECIFIC COMPONENTS FOR TESTING -------------------------------------------------
+//------------------------------------------------------------------------------------
+
+static const char* _MODULE_ = "[BENCH_MQLib]...";
+#define _EXPR_	(true)
+
+/** Token ids reserved for wildcards (NotUsed, '+', '#', Invalid, Numeric) */
+static const MQ::token_t s_first_token = 5;
+
+/** Number of publications per measurement */
+static const uint32_t s_num_publish = 256;
+
+/** Subscription used by the matching benchmarks */
+struct BenchTopic{
+	MQ::topic_t id;
+};
+
+/** Subscription index under test */
+typedef TopicTree<BenchTopic, MQ::token_t> TopicIndex;
+
+/** Vectorised subscription matcher under test */
+typedef TopicMatcher<BenchTopic, MQ::token_t> TopicScan;
+
+/** Match counter for the subscription index visitor */
+static uint32_t s_tree_hits = 0;
+static void countTreeHit(BenchTopic* topic){
+	s_tree_hits++;
+}
+
+/** Match counter for the vectorised matcher visitor */
+static uint32_t s_scan_hits = 0;
+static void countScanHit(BenchTopic* topic){
+	s_scan_hits++;
+}
+
+
+//------------------------------------------------------------------------------------
+//-- HELPERS -------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+/**
+ * @brief Builds a synthetic 4-level subscription id. Roughly 10% of them use '+' at
+ * level 1, another 10% at level 3, and 2% end with '#' at level 2.
+ */
+static void buildSubscriptionId(MQ::topic_t* id, uint32_t i){
+	memset(id, 0, sizeof(MQ::topic_t));
+	id->tk[0] = s_first_token + (i % 4);
+	id->tk[1] = s_first_token + ((i / 4) % 50);
+	id->tk[2] = s_first_token + ((i / 200) % 50);
+	id->tk[3] = s_first_token + (i % 37);
+	if((i % 10) == 1){
+		id->tk[1] = 1;
+	}
+	if((i % 10) == 2){
+		id->tk[3] = 1;
+	}
+	if((i % 50) == 3){
+		id->tk[2] = 2;
+		id->tk[3] = 0;
+	}
+}
+
+/**
+ * @brief Builds a synthetic 4-level publication id
+ */
+static void buildPublishId(MQ::topic_t* id, uint32_t j){
+	memset(id, 0, sizeof(MQ::topic_t));
+	id->tk[0] = s_first_token + (j % 4);
+	id->tk[1] = s_first_token + ((j * 3) % 50);
+	id->tk[2] = s_first_token + ((j * 5) % 50);
+	id->tk[3] = s_first_token + (j % 37);
+}
+
+
+/**
+ * @brief Compares the linear scan over a list of topics with the vectorised matcher and
+ * the subscription index for a given number of subscriptions.
+ */
+static void benchTopicMatching(uint32_t num_subscriptions){
+	BenchTopic* topics = new BenchTopic[num_subscriptions];
+	TEST_ASSERT_NOT_NULL(topics);
+	List<BenchTopic> list;
+	TopicIndex tree(MQ::MAX_TOKEN_LEVEL);
+	TopicScan scan(MQ::MAX_TOKEN_LEVEL);
+	for(uint32_t i = 0; i < num_subscriptions; i++){
+		buildSubscriptionId(&topics[i].id, i);
+		TEST_ASSERT_EQUAL(list.addItem(&topics[i]), List<BenchTopic>::SUCCESS);
+		TEST_ASSERT_EQUAL(tree.addItem(topics[i].id.tk, &topics[i]), TopicIndex::SUCCESS);
+		TEST_ASSERT_EQUAL(scan.addItem(topics[i].id.tk, &topics[i]), TopicScan::SUCCESS);
+	}
+
+	MQ::topic_t pub;
+	Timer tm;
+
+	// linear scan, as done by MQBroker::publishReq before the subscription index
+	uint32_t list_hits = 0;
+	tm.start();
+	for(uint32_t j = 0; j < s_num_publish; j++){
+		buildPublishId(&pub, j);
+		BenchTopic* topic = list.getFirstItem();
+		while(topic){
+			if(MQ::MQBroker::matchIds(&topic->id, &pub)){
+				list_hits++;
+			}
+			topic = list.getNextItem();
+		}
+	}
+	int list_us = tm.read_us();
+
+	// subscription index
+	s_tree_hits = 0;
+	void (*visitor)(BenchTopic*) = &countTreeHit;
+	tm.reset();
+	tm.start();
+	for(uint32_t j = 0; j < s_num_publish; j++){
+		buildPublishId(&pub, j);
+		tree.match(pub.tk, visitor);
+	}
+	int tree_us = tm.read_us();
+
+	// vectorised matcher (TOPICMATCHER_VECTOR_BYTES per compare)
+	s_scan_hits = 0;
+	void (*scan_visitor)(BenchTopic*) = &countScanHit;
+	tm.reset();
+	tm.start();
+	for(uint32_t j = 0; j < s_num_publish; j++){
+		buildPublishId(&pub, j);
+		scan.match(pub.tk, scan_visitor);
+	}
+	int scan_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "subscriptions=%d, publish=%d, matches=%d, list_scan=%dus, topic_matcher(%d bytes)=%dus, topic_tree=%dus",
+			num_subscriptions, s_num_publish, list_hits, list_us, TOPICMATCHER_VECTOR_BYTES, scan_us, tree_us);
+
+	// all methods must find the same subscriptions
+	TEST_ASSERT_EQUAL(list_hits, s_tree_hits);
+	TEST_ASSERT_EQUAL(list_hits, s_scan_hits);
+
+	list.removeAll();
+	delete[] topics;
+}
+
+
+/**
+ * @brief Resolves every level of a topic name into token ids, by a linear strncmp scan
+ * over the token list (as done by MQBroker::createTopicId before the token dictionary)
+ * or through a HashMap dictionary.
+ * @return Number of resolved levels
+ */
+static uint32_t resolveTopic(const char* name, const char** tokens, uint32_t num_tokens, HashMap<uint16_t>* dict){
+	uint32_t resolved = 0;
+	uint16_t from = 0, to = 0;
+	while(name[from]){
+		to = from;
+		while(name[to] && name[to] != '/'){
+			to++;
+		}
+		if(dict){
+			uint16_t tk;
+			if(dict->getItem(&name[from], to - from, &tk)){
+				resolved++;
+			}
+		}
+		else{
+			for(uint32_t i = 0; i < num_tokens; i++){
+				if(strncmp(tokens[i], &name[from], to - from) == 0){
+					resolved++;
+					break;
+				}
+			}
+		}
+		from = (name[to])? (to + 1) : to;
+	}
+	return resolved;
+}
+
+
+/**
+ * @brief Compares topic id creation through a linear token scan and through a hash
+ * dictionary, for a given number of registered tokens.
+ */
+static void benchTokenLookup(uint32_t num_tokens){
+	static const uint32_t num_topics = 128;
+	char* pool = new char[num_tokens * 8];
+	const char** tokens = new const char*[num_tokens];
+	char (*topics)[32] = new char[num_topics][32];
+	TEST_ASSERT_NOT_NULL(pool);
+	TEST_ASSERT_NOT_NULL(tokens);
+	TEST_ASSERT_NOT_NULL(topics);
+	HashMap<uint16_t> dict(num_tokens);
+	for(uint32_t i = 0; i < num_tokens; i++){
+		sprintf(&pool[i * 8], "t%05u", (unsigned)i);
+		tokens[i] = &pool[i * 8];
+		TEST_ASSERT_EQUAL(dict.addItem(tokens[i], (uint16_t)i), HashMap<uint16_t>::SUCCESS);
+	}
+	uint32_t seed = 1;
+	for(uint32_t j = 0; j < num_topics; j++){
+		uint32_t tk[4];
+		for(int l = 0; l < 4; l++){
+			seed = seed * 1103515245 + 12345;
+			tk[l] = (seed >> 8) % num_tokens;
+		}
+		sprintf(topics[j], "t%05u/t%05u/t%05u/t%05u", (unsigned)tk[0], (unsigned)tk[1], (unsigned)tk[2], (unsigned)tk[3]);
+	}
+
+	Timer tm;
+	uint32_t scan_levels = 0;
+	tm.start();
+	for(uint32_t j = 0; j < num_topics; j++){
+		scan_levels += resolveTopic(topics[j], tokens, num_tokens, 0);
+	}
+	int scan_us = tm.read_us();
+
+	uint32_t dict_levels = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t j = 0; j < num_topics; j++){
+		dict_levels += resolveTopic(topics[j], tokens, num_tokens, &dict);
+	}
+	int dict_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "tokens=%d, topics=%d, token_scan=%dus, token_dict=%dus",
+			num_tokens, num_topics, scan_us, dict_us);
+
+	TEST_ASSERT_EQUAL(scan_levels, num_topics * 4);
+	TEST_ASSERT_EQUAL(dict_levels, num_topics * 4);
+
+	delete[] topics;
+	delete[] tokens;
+	delete[] pool;
+}
+
+
+/** Topic layout used by MQBroker before the topic table */
+struct BenchListTopic{
+	MQ::topic_t id;
+	char* name;
+	List<MQ::Subscriber>* subscriber_list;
+};
+
+
+/**
+ * @brief Topic storage: topics allocated one by one, each one with its own list of heap
+ * allocated subscribers, vs the
+ * contiguous TopicTable. Every pass visits all the subscribers of all the topics, as a
+ * fan-out does. Timer based, as cache misses are not available on every target.
+ */
+static void benchTopicStorage(uint32_t num_topics){
+	static const uint32_t num_subscribers = 4;
+	static const uint32_t num_passes = 200;
+	BenchListTopic** topics = new BenchListTopic*[num_topics];
+	TopicTable<MQ::topic_t, MQ::Subscriber> table(num_topics);
+	TEST_ASSERT_NOT_NULL(topics);
+	char name[32];
+	MQ::Subscriber sbc = {0, 0, 0};
+	for(uint32_t i = 0; i < num_topics; i++){
+		uint32_t row;
+		sprintf(name, "bench/table/%u", (unsigned)i);
+		topics[i] = new BenchListTopic;
+		buildSubscriptionId(&topics[i]->id, i);
+		topics[i]->name = new char[strlen(name) + 1];
+		strcpy(topics[i]->name, name);
+		topics[i]->subscriber_list = new List<MQ::Subscriber>();
+		TEST_ASSERT_EQUAL(table.addTopic(name, &topics[i]->id, &row), (TopicTable<MQ::topic_t, MQ::Subscriber>::SUCCESS));
+		for(uint32_t s = 0; s < num_subscribers; s++){
+			sbc.flags = (uint8_t)(i + s);
+			MQ::Subscriber* item = new MQ::Subscriber(sbc);
+			TEST_ASSERT_EQUAL(topics[i]->subscriber_list->addItem(item), List<MQ::Subscriber>::SUCCESS);
+			TEST_ASSERT_EQUAL(table.addSubscriber(row, sbc), (TopicTable<MQ::topic_t, MQ::Subscriber>::SUCCESS));
+		}
+	}
+
+	Timer tm;
+	uint32_t list_sum = 0;
+	tm.start();
+	for(uint32_t p = 0; p < num_passes; p++){
+		for(uint32_t i = 0; i < num_topics; i++){
+			for(MQ::Subscriber* s : *topics[i]->subscriber_list){
+				list_sum += s->flags;
+			}
+		}
+	}
+	int list_us = tm.read_us();
+
+	uint32_t table_sum = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t p = 0; p < num_passes; p++){
+		for(uint32_t row = 0; row < table.getTopicCount(); row++){
+			const MQ::Subscriber* s = table.getSubscribers(row);
+			for(uint16_t i = 0; i < table.getSubscriberCount(row); i++){
+				table_sum += s[i].flags;
+			}
+		}
+	}
+	int table_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "topics=%d, subscribers=%d, passes=%d, topic_list=%dus, topic_table=%dus",
+			num_topics, num_topics * num_subscribers, num_passes, list_us, table_us);
+
+	TEST_ASSERT_EQUAL(list_sum, table_sum);
+
+	for(uint32_t i = 0; i < num_topics; i++){
+		for(MQ::Subscriber* s : *topics[i]->subscriber_list){
+			delete s;
+		}
+		topics[i]->subscriber_list->removeAll();
+		delete topics[i]->subscriber_list;
+		delete[] topics[i]->name;
+		delete topics[i];
+	}
+	delete[] topics;
+}
+
+
+/** Publication counters */
+static uint32_t s_bench_received = 0;
+static void benchSubscriptionCb(const char* topic, void* msg, uint16_t msg_len){
+	s_bench_received++;
+}
+static void benchPublishedCb(const char* topic, int32_t result){
+}
+static MQ::SubscribeCallback s_bench_subscribe_cb;
+static MQ::PublishCallback s_bench_published_cb;
+
+
+/**
+ * @brief Starts the broker if not done yet by other tests
+ */
+static void benchStartBroker(){
+	if(!MQ::MQBroker::ready()){
+		TEST_ASSERT_EQUAL(MQ::MQBroker::start(64), MQ::SUCCESS);
+	}
+	s_bench_subscribe_cb = callback(&benchSubscriptionCb);
+	s_bench_published_cb = callback(&benchPublishedCb);
+}
+
+
+/**
+ * @brief Counts the bridge patterns that match a topic by splitting both into strings,
+ * as done by MQClient::executeBridge before the compiled bridge patterns
+ */
+static uint32_t legacyBridgeMatches(const std::vector<std::string>& patterns, const char* name){
+	uint32_t matches = 0;
+	std::string topic(name);
+	std::string delimiter = "/";
+	std::vector<std::string> topicSplit;
+	size_t pos = 0;
+	std::string token;
+	while ((pos = topic.find(delimiter)) != std::string::npos) {
+		token = topic.substr(0, pos);
+		topicSplit.push_back(token);
+		topic.erase(0, pos + delimiter.length());
+		if((pos = topic.find(delimiter)) == std::string::npos)
+			topicSplit.push_back(topic);
+	}
+	for(const std::string& pattern : patterns){
+		std::string topicB(pattern);
+		size_t topicPos = 0;
+		bool proccess = true;
+		bool defProccess = false;
+		while ((pos = topicB.find(delimiter)) != std::string::npos) {
+			token = topicB.substr(0, pos);
+			if(token.compare("#")==0){
+				defProccess = true;
+				break;
+			}
+			else if(topicPos >= topicSplit.size() || (token.compare(topicSplit[topicPos])!=0 && token.compare("+")!=0)){
+				proccess = false;
+				break;
+			}
+			topicPos++;
+			topicB.erase(0, pos + delimiter.length());
+		}
+		if(defProccess || (proccess && topicPos+1 == topicSplit.size() && (topicB.compare(topicSplit[topicPos])==0 || topicB.compare("+")==0))){
+			matches++;
+		}
+	}
+	return matches;
+}
+
+
+/** Bridge counter */
+static uint32_t s_bench_bridged = 0;
+static void benchBridgeCb(const char* topic, void* data, uint16_t datasize, MQ::PublishCallback* publisher){
+	s_bench_bridged++;
+}
+
+
+/**
+ * @brief Compares the string based bridge matching with the compiled bridge patterns for
+ * a given number of bridges, one of which matches the published topic
+ */
+static void benchBridgeMatching(uint32_t num_bridges){
+	static const uint32_t num_publish = 10000;
+	static const char* topic = "bench/bridge/dev/sensor/value";
+	MQ::BridgeCallback* bridges = new MQ::BridgeCallback[num_bridges + 1];
+	char (*patterns)[32] = new char[num_bridges + 1][32];
+	TEST_ASSERT_NOT_NULL(bridges);
+	TEST_ASSERT_NOT_NULL(patterns);
+	std::vector<std::string> legacy;
+	for(uint32_t i = 0; i < num_bridges; i++){
+		sprintf(patterns[i], (i & 1)? "bench/bridge/%u/+/value" : "bench/other/%u/#", (unsigned)i);
+		bridges[i] = callback(&benchBridgeCb);
+		TEST_ASSERT_EQUAL(MQ::MQClient::addBridge(patterns[i], &bridges[i]), MQ::SUCCESS);
+		legacy.push_back(patterns[i]);
+	}
+	uint32_t expected = 0;
+	if(num_bridges){
+		strcpy(patterns[num_bridges], "bench/bridge/+/sensor/value");
+		bridges[num_bridges] = callback(&benchBridgeCb);
+		TEST_ASSERT_EQUAL(MQ::MQClient::addBridge(patterns[num_bridges], &bridges[num_bridges]), MQ::SUCCESS);
+		legacy.push_back(patterns[num_bridges]);
+		expected = 1;
+	}
+
+	Timer tm;
+	uint32_t legacy_matches = 0;
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		legacy_matches += legacyBridgeMatches(legacy, topic);
+	}
+	int legacy_us = tm.read_us();
+
+	uint32_t data = 0;
+	s_bench_bridged = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::executeBridge(topic, &data, sizeof(data), &s_bench_published_cb);
+	}
+	int compiled_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "bridges=%d, publish=%d, string_split=%dus, compiled=%dus",
+			num_bridges, num_publish, legacy_us, compiled_us);
+
+	TEST_ASSERT_EQUAL(legacy_matches, num_publish * expected);
+	TEST_ASSERT_EQUAL(s_bench_bridged, num_publish * expected);
+
+	for(uint32_t i = 0; i < num_bridges + expected; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::removeBridge(patterns[i], &bridges[i]), MQ::SUCCESS);
+	}
+	delete[] patterns;
+	delete[] bridges;
+}
+
+
+/**
+ * @brief Extracts the next level of a topic from 'from', scanning the whole name on every
+ * call, as done by MQBroker::getNextDelimiter before the single-pass tokenizer
+ */
+static void legacyNextDelimiter(const char* name, uint8_t* from, uint8_t* to){
+	int len = strlen(name);
+	if(*from >= len){
+		*from = len;
+		*to = len;
+		return;
+	}
+	if(name[*from] == '/'){
+		(*from)++;
+	}
+	*to = *from;
+	for(int i = *from; i <= len; i++){
+		if(name[i] == 0 || name[i] == '/'){
+			*to = i;
+			break;
+		}
+	}
+}
+
+
+/**
+ * @brief Compares the per-level delimiter search with the single-pass tokenizer for topics
+ * of a given depth
+ */
+static void benchTopicTokenizer(uint8_t levels){
+	static const uint32_t num_topics = 100000;
+	char name[128] = "";
+	for(uint8_t i = 0; i < levels; i++){
+		sprintf(&name[strlen(name)], (i)? "/level%u" : "level%u", (unsigned)i);
+	}
+
+	Timer tm;
+	uint32_t legacy_levels = 0;
+	tm.start();
+	for(uint32_t j = 0; j < num_topics; j++){
+		uint8_t from = 0, to = 0;
+		legacyNextDelimiter(name, &from, &to);
+		while(from < to){
+			legacy_levels++;
+			from = to + 1;
+			legacyNextDelimiter(name, &from, &to);
+		}
+	}
+	int legacy_us = tm.read_us();
+
+	uint32_t split_levels = 0;
+	MQ::TopicSpan spans[MQ::MAX_TOKEN_LEVEL];
+	tm.reset();
+	tm.start();
+	for(uint32_t j = 0; j < num_topics; j++){
+		split_levels += MQ::splitTopic(name, spans, MQ::MAX_TOKEN_LEVEL);
+	}
+	int split_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "levels=%d, topics=%d, next_delimiter=%dus, split_topic=%dus",
+			levels, num_topics, legacy_us, split_us);
+
+	TEST_ASSERT_EQUAL(legacy_levels, num_topics * levels);
+	TEST_ASSERT_EQUAL(split_levels, num_topics * levels);
+}
+
+
+//------------------------------------------------------------------------------------
+//-- TEST CASES ----------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Topic matching: list scan vs subscription index
+ */
+TEST_CASE("Bench topic matching .................", "[MQLib][bench]") {
+	benchTopicMatching(10);
+	benchTopicMatching(100);
+	benchTopicMatching(1000);
+	benchTopicMatching(10000);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Topic id creation: token list scan vs token dictionary. The 60k case uses
+ * 16-bit token ids.
+ */
+TEST_CASE("Bench token lookup ...................", "[MQLib][bench]") {
+	benchTokenLookup(50);
+	benchTokenLookup(250);
+	benchTokenLookup(60000);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Publication by topic name vs publication through a pre-resolved handle
+ */
+TEST_CASE("Bench publish handles ................", "[MQLib][bench]") {
+	static const uint32_t num_publish = 10000;
+	static const char* topic = "bench/handle/dev/sensor/value";
+	uint32_t data = 0;
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe(topic, &s_bench_subscribe_cb), MQ::SUCCESS);
+
+	Timer tm;
+	s_bench_received = 0;
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::publish(topic, &data, sizeof(data), &s_bench_published_cb);
+	}
+	int name_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_received, num_publish);
+
+	MQ::PublishHandle handle;
+	TEST_ASSERT_EQUAL(MQ::MQClient::resolve(topic, &handle), MQ::SUCCESS);
+	s_bench_received = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::publish(&handle, &data, sizeof(data), &s_bench_published_cb);
+	}
+	int handle_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_received, num_publish);
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "publish=%d, by_name=%dus, by_handle=%dus", num_publish, name_us, handle_us);
+
+	MQ::MQClient::release(&handle);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe(topic, &s_bench_subscribe_cb), MQ::SUCCESS);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Fan-out of a 4KB payload to 10 read-only subscribers: copy vs zero-copy delivery
+ */
+TEST_CASE("Bench zero-copy delivery .............", "[MQLib][bench]") {
+	static const uint32_t num_publish = 10000;
+	static const uint32_t num_subscribers = 10;
+	static const uint32_t payload_size = 4096;
+	static const char* topic = "bench/zcopy/dev/sensor/value";
+	MQ::SubscribeCallback subscribers[num_subscribers];
+	char* payload = new char[payload_size];
+	TEST_ASSERT_NOT_NULL(payload);
+	memset(payload, 0x55, payload_size);
+	benchStartBroker();
+	for(uint32_t i = 0; i < num_subscribers; i++){
+		subscribers[i] = callback(&benchSubscriptionCb);
+		TEST_ASSERT_EQUAL(MQ::MQClient::subscribe(topic, &subscribers[i]), MQ::SUCCESS);
+	}
+
+	Timer tm;
+	s_bench_received = 0;
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::publish(topic, payload, payload_size, &s_bench_published_cb);
+	}
+	int copy_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_received, num_publish * num_subscribers);
+
+	MQ::MQBroker::setZeroCopy(true);
+	s_bench_received = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::publish(topic, payload, payload_size, &s_bench_published_cb);
+	}
+	int zero_copy_us = tm.read_us();
+	MQ::MQBroker::setZeroCopy(false);
+	TEST_ASSERT_EQUAL(s_bench_received, num_publish * num_subscribers);
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "publish=%d, subscribers=%d, payload=%d, copy=%dus, zero_copy=%dus",
+			num_publish, num_subscribers, payload_size, copy_us, zero_copy_us);
+
+	for(uint32_t i = 0; i < num_subscribers; i++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe(topic, &subscribers[i]), MQ::SUCCESS);
+	}
+	delete[] payload;
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Small block allocation: malloc/free vs Heap slab pool
+ */
+TEST_CASE("Bench heap pool ......................", "[MQLib][bench]") {
+	static const uint32_t num_allocs = 100000;
+	static const uint32_t burst = 16;
+	void* ptr[burst];
+
+	Timer tm;
+	tm.start();
+	for(uint32_t i = 0; i < num_allocs; i += burst){
+		for(uint32_t j = 0; j < burst; j++){
+			ptr[j] = malloc(8 + (j * 8));
+		}
+		for(uint32_t j = 0; j < burst; j++){
+			free(ptr[j]);
+		}
+	}
+	int malloc_us = tm.read_us();
+
+	Heap::resetPoolStats();
+	tm.reset();
+	tm.start();
+	for(uint32_t i = 0; i < num_allocs; i += burst){
+		for(uint32_t j = 0; j < burst; j++){
+			ptr[j] = Heap::memAlloc(8 + (j * 8));
+		}
+		for(uint32_t j = 0; j < burst; j++){
+			Heap::memFree(ptr[j]);
+		}
+	}
+	int pool_us = tm.read_us();
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "allocs=%d, malloc=%dus, heap_pool=%dus", num_allocs, malloc_us, pool_us);
+	for(uint8_t i = 0; i < Heap::PoolClassCount; i++){
+		Heap::PoolStats st;
+		if(Heap::getPoolStats(i, &st)){
+			DEBUG_TRACE_I(_EXPR_, _MODULE_, "class=%d, hits=%d, misses=%d", st.block_size, st.hits, st.misses);
+		}
+	}
+}
+
+
+/** Multi-thread publisher for the throughput benchmark */
+struct BenchPublisher{
+	const char* topic;
+	uint32_t count;
+	void run(){
+		uint32_t data = 0;
+		for(uint32_t i = 0; i < count; i++){
+			MQ::MQClient::publish(topic, &data, sizeof(data), &s_bench_published_cb);
+		}
+	}
+};
+
+/** Subscriber doing a few microseconds of work per message */
+static std::atomic<uint32_t> s_bench_mt_received(0);
+static void benchWorkCb(const char* topic, void* msg, uint16_t msg_len){
+	volatile uint32_t acc = 0;
+	for(uint32_t i = 0; i < 2000; i++){
+		acc += i * (*(uint32_t*)msg);
+	}
+	s_bench_mt_received++;
+}
+
+
+/**
+ * @brief Publishes from num_threads threads at once and returns the elapsed time
+ */
+static int benchPublishThreads(uint32_t num_threads, uint32_t num_publish){
+	static const char* topics[] = {"bench/mt/0/value", "bench/mt/1/value", "bench/mt/2/value", "bench/mt/3/value",
+								   "bench/mt/4/value", "bench/mt/5/value", "bench/mt/6/value", "bench/mt/7/value"};
+	BenchPublisher publishers[8];
+	Thread threads[8];
+	s_bench_mt_received = 0;
+	Timer tm;
+	tm.start();
+	for(uint32_t i = 0; i < num_threads; i++){
+		publishers[i].topic = topics[i];
+		publishers[i].count = num_publish / num_threads;
+		threads[i].start(callback(&publishers[i], &BenchPublisher::run));
+	}
+	for(uint32_t i = 0; i < num_threads; i++){
+		threads[i].join();
+	}
+	int elapsed_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_mt_received.load(), (num_publish / num_threads) * num_threads);
+	return elapsed_us;
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Publication throughput from 1 to 8 publisher threads, with the broker mutex and
+ * with lock-free publications over subscription snapshots
+ */
+TEST_CASE("Bench multi-thread publish ...........", "[MQLib][bench]") {
+	static const uint32_t num_publish = 20000;
+	MQ::SubscribeCallback subscriber = callback(&benchWorkCb);
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/mt/+/value", &subscriber), MQ::SUCCESS);
+
+	for(uint32_t threads = 1; threads <= 8; threads <<= 1){
+		int locked_us = benchPublishThreads(threads, num_publish);
+		TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(true), MQ::SUCCESS);
+		int lock_free_us = benchPublishThreads(threads, num_publish);
+		TEST_ASSERT_EQUAL(MQ::MQBroker::setLockFreePublish(false), MQ::SUCCESS);
+		DEBUG_TRACE_I(_EXPR_, _MODULE_, "threads=%d, publish=%d, locked=%d msg/s, lock_free=%d msg/s", threads, num_publish,
+				(int)((num_publish * 1000000ULL) / locked_us), (int)((num_publish * 1000000ULL) / lock_free_us));
+	}
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/mt/+/value", &subscriber), MQ::SUCCESS);
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Cost paid by the producer: direct publication vs enqueueing into the ISR ring
+ * (the ring is drained outside the measured time)
+ */
+TEST_CASE("Bench publish from ISR ...............", "[MQLib][bench]") {
+	static const uint32_t num_publish = 20000;
+	static const uint16_t ring_size = 512;
+	MQ::SubscribeCallback subscriber = callback(&benchWorkCb);
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/isr/value", &subscriber), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startIsrQueue(ring_size, false), MQ::SUCCESS);
+	uint32_t value = 1;
+
+	s_bench_mt_received = 0;
+	Timer tm;
+	tm.start();
+	for(uint32_t i = 0; i < num_publish; i++){
+		MQ::MQClient::publish("bench/isr/value", &value, sizeof(value), &s_bench_published_cb);
+	}
+	int direct_us = tm.read_us();
+
+	int enqueue_us = 0;
+	int drain_us = 0;
+	int max_block_us = 0;
+	for(uint32_t i = 0; i < num_publish; i += ring_size){
+		tm.reset();
+		for(uint32_t j = 0; j < ring_size; j++){
+			MQ::MQClient::publishFromISR("bench/isr/value", &value, sizeof(value));
+		}
+		int block_us = tm.read_us();
+		enqueue_us += block_us;
+		max_block_us = (block_us > max_block_us)? block_us : max_block_us;
+		tm.reset();
+		MQ::MQBroker::processIsrRequests();
+		drain_us += tm.read_us();
+	}
+	uint32_t num_enqueued = ((num_publish + ring_size - 1) / ring_size) * ring_size;
+	TEST_ASSERT_EQUAL(MQ::MQBroker::getIsrDropCount(), 0);
+	TEST_ASSERT_EQUAL(s_bench_mt_received.load(), num_publish + num_enqueued);
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "publish=%d, direct=%dns/msg, isr_enqueue=%dns/msg (worst block %dns/msg), drain=%dns/msg", num_publish,
+			(int)((direct_us * 1000ULL) / num_publish), (int)((enqueue_us * 1000ULL) / num_enqueued),
+			(int)((max_block_us * 1000ULL) / ring_size), (int)((drain_us * 1000ULL) / num_enqueued));
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::startIsrQueue(0), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/isr/value", &subscriber), MQ::SUCCESS);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Republishing chain of 64 levels, dispatched recursively and breadth-first:
+ * elapsed time and peak stack from the root publication to the deepest subscriber call
+ */
+static uint32_t s_bench_chain_count = 0;
+static void benchChainCb(const char* topic, void* msg, uint16_t msg_len){
+	uint32_t level = *(uint32_t*)msg;
+	s_bench_chain_count++;
+	if(level < 64){
+		level++;
+		MQ::MQClient::publish("bench/chain", &level, sizeof(level), &s_bench_published_cb);
+	}
+}
+
+TEST_CASE("Bench nested publish .................", "[MQLib][bench]") {
+	static const uint32_t num_publish = 1000;
+	MQ::SubscribeCallback subscriber = callback(&benchChainCb);
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/chain", &subscriber), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(false), MQ::SUCCESS);
+
+	for(int queued = 0; queued < 2; queued++){
+		TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(queued == 1, 255, 64), MQ::SUCCESS);
+		MQ::MQBroker::resetNestedDispatchStats();
+		s_bench_chain_count = 0;
+		uint32_t level = 0;
+		Timer tm;
+		tm.start();
+		for(uint32_t i = 0; i < num_publish; i++){
+			MQ::MQClient::publish("bench/chain", &level, sizeof(level), &s_bench_published_cb);
+		}
+		int elapsed_us = tm.read_us();
+		TEST_ASSERT_EQUAL(s_bench_chain_count, num_publish * 65);
+		MQ::NestedDispatchStats stats;
+		MQ::MQBroker::getNestedDispatchStats(&stats);
+		DEBUG_TRACE_I(_EXPR_, _MODULE_, "mode=%s, chains=%d, depth=%d, time=%dus, peak_stack=%d bytes, peak_queue=%d", (queued)? "breadth-first" : "recursive",
+				num_publish, stats.peak_level, elapsed_us, stats.peak_stack, stats.peak_queue);
+	}
+
+	TEST_ASSERT_EQUAL(MQ::MQBroker::setNestedDispatch(false), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/chain", &subscriber), MQ::SUCCESS);
+}
+
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Batch of N publications on different topics: N individual publishes vs one
+ * publishBatch (single broker request, single id resolution pass, shared copy buffer)
+ */
+static void benchBatchPublish(uint16_t batch_size){
+	static const uint32_t num_batches = 200;
+	char (*topics)[32] = new char[batch_size][32];
+	MQ::PublishEntry* entries = new MQ::PublishEntry[batch_size];
+	int32_t* results = new int32_t[batch_size];
+	TEST_ASSERT_NOT_NULL(topics);
+	TEST_ASSERT_NOT_NULL(entries);
+	TEST_ASSERT_NOT_NULL(results);
+	uint32_t data = 0;
+	for(uint16_t i = 0; i < batch_size; i++){
+		// combinations of a few tokens, so that the token dictionary does not fill up
+		sprintf(topics[i], "bench/batch/%c/%c/%c", 'a' + (i % 8), 'a' + ((i / 8) % 8), 'a' + ((i / 64) % 8));
+		entries[i].name = topics[i];
+		entries[i].data = &data;
+		entries[i].datasize = sizeof(data);
+	}
+
+	Timer tm;
+	s_bench_received = 0;
+	tm.start();
+	for(uint32_t n = 0; n < num_batches; n++){
+		for(uint16_t i = 0; i < batch_size; i++){
+			MQ::MQClient::publish(entries[i].name, entries[i].data, entries[i].datasize, &s_bench_published_cb);
+		}
+	}
+	int single_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_received, num_batches * batch_size);
+
+	s_bench_received = 0;
+	tm.reset();
+	tm.start();
+	for(uint32_t n = 0; n < num_batches; n++){
+		MQ::MQClient::publishBatch(entries, batch_size, results);
+	}
+	int batch_us = tm.read_us();
+	TEST_ASSERT_EQUAL(s_bench_received, num_batches * batch_size);
+
+	DEBUG_TRACE_I(_EXPR_, _MODULE_, "batch_size=%d, batches=%d, single=%dns/msg, batch=%dns/msg", batch_size, num_batches,
+			(int)((single_us * 1000ULL) / (num_batches * batch_size)), (int)((batch_us * 1000ULL) / (num_batches * batch_size)));
+
+	delete[] results;
+	delete[] entries;
+	delete[] topics;
+}
+
+TEST_CASE("Bench batch publish ..................", "[MQLib][bench]") {
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/batch/#", &s_bench_subscribe_cb), MQ::SUCCESS);
+	benchBatchPublish(10);
+	benchBatchPublish(50);
+	benchBatchPublish(200);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/batch/#", &s_bench_subscribe_cb), MQ::SUCCESS);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Topic storage: topics allocated one by one vs the contiguous topic table
+ */
+TEST_CASE("Bench topic storage ..................", "[MQLib][bench]") {
+	benchTopicStorage(100);
+	benchTopicStorage(1000);
+	benchTopicStorage(10000);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Bridge matching on publish: string splitting vs compiled bridge patterns
+ */
+TEST_CASE("Bench bridge matching ................", "[MQLib][bench]") {
+	benchStartBroker();
+	benchBridgeMatching(0);
+	benchBridgeMatching(10);
+	benchBridgeMatching(100);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Topic tokenization: per-level delimiter search vs single-pass tokenizer
+ */
+TEST_CASE("Bench topic tokenizer ................", "[MQLib][bench]") {
+	benchTopicTokenizer(2);
+	benchTopicTokenizer(6);
+	benchTopicTokenizer(10);
+}
+
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Publication by name of 256 distinct topics: without cache vs with a 256 and a
+ * 64-entry publish cache
+ */
+TEST_CASE("Bench publish cache ..................", "[MQLib][bench]") {
+	static const uint32_t num_topics = 256;
+	static const uint32_t num_publish = 20000;
+	static const uint16_t cache_sizes[] = {0, 256, 64};
+	char (*topics)[32] = new char[num_topics][32];
+	TEST_ASSERT_NOT_NULL(topics);
+	for(uint32_t i = 0; i < num_topics; i++){
+		sprintf(topics[i], "bench/cache/%u/value", (unsigned)i);
+	}
+	uint32_t data = 0;
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/cache/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+
+	for(uint8_t c = 0; c < sizeof(cache_sizes)/sizeof(cache_sizes[0]); c++){
+		TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(cache_sizes[c]), MQ::SUCCESS);
+		MQ::MQClient::resetPublishCacheStats();
+		Timer tm;
+		s_bench_received = 0;
+		tm.start();
+		for(uint32_t i = 0; i < num_publish; i++){
+			MQ::MQClient::publish(topics[i % num_topics], &data, sizeof(data), &s_bench_published_cb);
+		}
+		int us = tm.read_us();
+		TEST_ASSERT_EQUAL(s_bench_received, num_publish);
+		MQ::PublishCacheStats stats;
+		MQ::MQClient::getPublishCacheStats(&stats);
+		DEBUG_TRACE_I(_EXPR_, _MODULE_, "topics=%d, publish=%d, cache=%d, time=%dus, hits=%d, misses=%d, evictions=%d",
+				num_topics, num_publish, cache_sizes[c], us, stats.hits, stats.misses, stats.evictions);
+	}
+
+	TEST_ASSERT_EQUAL(MQ::MQClient::setPublishCache(0), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/cache/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+	delete[] topics;
+}
+//---------------------------------------------------------------------------
+/**
+ * @brief Publication by name of topics that nobody subscribes to: without vs with the publish
+ * prefilter. Also reports the tokens registered in the dictionary by the unmatched publications.
+ * A '#' subscription left by other test cases lets every publication through the prefilter
+ */
+TEST_CASE("Bench publish prefilter ..............", "[MQLib][bench]") {
+	static const uint32_t num_topics = 32;
+	static const uint32_t num_publish = 20000;
+	char (*topics)[32] = new char[num_topics][32];
+	TEST_ASSERT_NOT_NULL(topics);
+	for(uint32_t i = 0; i < num_topics; i++){
+		sprintf(topics[i], "bench/idle/node%u/status", (unsigned)i);
+	}
+	uint32_t data = 0;
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/prefilter/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+
+	// the prefiltered run goes first, before the unmatched publications register their tokens
+	for(uint8_t enable = 2; enable-- > 0;){
+		MQ::MQBroker::setPublishPrefilter(enable != 0);
+		const char** tklist;
+		uint32_t tk_before, tk_after;
+		MQ::MQClient::getInternalTokenList(tklist, tk_before);
+		Timer tm;
+		s_bench_received = 0;
+		tm.start();
+		for(uint32_t i = 0; i < num_publish; i++){
+			MQ::MQClient::publish(topics[i % num_topics], &data, sizeof(data), &s_bench_published_cb);
+		}
+		int us = tm.read_us();
+		TEST_ASSERT_EQUAL(s_bench_received, 0);
+		MQ::MQClient::getInternalTokenList(tklist, tk_after);
+		DEBUG_TRACE_I(_EXPR_, _MODULE_, "topics=%d, publish=%d, prefilter=%d, time=%dus, new tokens=%d",
+				num_topics, num_publish, enable, us, tk_after - tk_before);
+	}
+
+	MQ::MQBroker::setPublishPrefilter(true);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/prefilter/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+	delete[] topics;
+}
+
+//---------------------------------------------------------------------------
+/**
+ * @brief Publication to transient topics (one token per request id) with the automatic token
+ * collection enabled vs disabled. Reports the failed publications once the dictionary is full,
+ * the collection passes and the longest collection pause
+ */
+TEST_CASE("Bench token collection ...............", "[MQLib][bench]") {
+	static const uint32_t num_publish = 2000;
+	static const uint32_t default_budget = 500;
+	static const uint32_t budgets[] = {default_budget, 0};
+	char topic[32];
+	uint32_t data = 0;
+	benchStartBroker();
+	TEST_ASSERT_EQUAL(MQ::MQClient::subscribe("bench/gc/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+
+	for(uint8_t b = 0; b < sizeof(budgets)/sizeof(budgets[0]); b++){
+		MQ::MQBroker::setTokenCollectBudget(budgets[b]);
+		MQ::TokenCollectStats prev, stats;
+		MQ::MQBroker::getTokenCollectStats(&prev);
+		uint32_t failed = 0;
+		Timer tm;
+		s_bench_received = 0;
+		tm.start();
+		for(uint32_t i = 0; i < num_publish; i++){
+			sprintf(topic, "bench/gc/%u_%u/value", (unsigned)b, (unsigned)i);
+			if(MQ::MQClient::publish(topic, &data, sizeof(data), &s_bench_published_cb) != MQ::SUCCESS){
+				failed++;
+			}
+		}
+		int us = tm.read_us();
+		TEST_ASSERT_EQUAL(s_bench_received, num_publish - failed);
+		MQ::MQBroker::getTokenCollectStats(&stats);
+		DEBUG_TRACE_I(_EXPR_, _MODULE_, "publish=%d, budget=%dus, time=%dus, failed=%d, passes=%d, freed=%d, peak pause=%dus",
+				num_publish, budgets[b], us, failed, stats.passes - prev.passes, stats.freed - prev.freed, stats.peak_pause);
+	}
+
+	// releases the tokens left by the run without collection
+	MQ::MQBroker::setTokenCollectBudget(default_budget);
+	TEST_ASSERT_EQUAL(MQ::MQClient::unsubscribe("bench/gc/+/value", &s_bench_subscribe_cb), MQ::SUCCESS);
+	TEST_ASSERT_EQUAL(MQ::MQBroker::collectTokensReq(1000000), MQ::SUCCESS);
+}
+
+
+#endif